@@ -0,0 +1,451 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "host_client.h"
+#include "pkt_utils.h"
+#include <stdio.h>
+#include <string.h>
+
+#define CLIENT_IDLE                     ( 0 )
+#define CLIENT_SYN_SENT                 ( 1 )
+#define CLIENT_ESTABLISHED              ( 2 )               // request sent - reading the response
+#define CLIENT_LAST_ACK                 ( 3 )               // both FINs sent - waiting for ours to be ACKed
+#define CLIENT_FIN_WAIT                 ( 4 )               // upload: everything ACKed, and our FIN sent - waiting for the server's
+
+#define TCP_FIN                         ( 0x01 )
+#define TCP_SYN                         ( 0x02 )
+#define TCP_RST                         ( 0x04 )
+#define TCP_PSH                         ( 0x08 )
+#define TCP_ACK                         ( 0x10 )
+
+#define CLIENT_MSS                      ( 1460 )
+#define CLIENT_TIMEOUT_US               ( 2000000 )         // the link is lossless, so this only catches a stuck stack
+#define CLIENT_RTO_US                   ( 20000 )           // upload: go back to the last ACK if nothing has been ACKed for this long
+#define CLIENT_IPERF_PORT               ( 5001 )
+#define CLIENT_IPERF_HEADER             ( 24 )              // lwiperf_settings_t - then the data
+
+static const uint8_t    g_client_mac[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 };
+
+static inline void put16( uint8_t* p, uint32_t v )
+{
+    p[ 0 ] = (uint8_t)( v >> 8 );
+    p[ 1 ] = (uint8_t)( v >> 0 );
+}
+
+static inline void put32( uint8_t* p, uint32_t v )
+{
+    put16( p, v >> 16 );
+    put16( p + 2, v );
+}
+
+static inline uint32_t get16( const uint8_t* p )
+{
+    return( ( p[ 0 ] << 8 ) | p[ 1 ] );
+}
+
+static inline uint32_t get32( const uint8_t* p )
+{
+    return( ( get16( p ) << 16 ) | get16( p + 2 ) );
+}
+
+void host_client_init( host_client* hc, rmiieth_config* cfg, uint32_t server_ip, const char* path, int requests )
+{
+    memset( hc, 0, sizeof( host_client ) );
+    hc->cfg = cfg;
+    memcpy( hc->mac, g_client_mac, 6 );
+    hc->ip = server_ip + 1;
+    hc->server_ip = server_ip;
+    hc->server_port = 80;
+    hc->path = path;
+    hc->requests = requests;
+    hc->state = CLIENT_IDLE;
+    hc->port = 49152;
+}
+
+// one upload of 'bytes' bytes (iperf2 header included) to lwiperf's server, instead of HTTP requests
+void host_client_init_upload( host_client* hc, rmiieth_config* cfg, uint32_t server_ip, uint32_t bytes )
+{
+    host_client_init( hc, cfg, server_ip, NULL, 1 );
+    hc->server_port = CLIENT_IPERF_PORT;
+    hc->upload_bytes = ( bytes < CLIENT_IPERF_HEADER ) ? CLIENT_IPERF_HEADER : bytes;
+}
+
+bool host_client_done( host_client* hc )
+{
+    return( hc->state == CLIENT_IDLE && (int)( hc->completed + hc->failed ) >= hc->requests );
+}
+
+//
+// sending
+//
+
+static void client_send_tcp( host_client* hc, uint8_t flags, const uint8_t* payload, int length )
+{
+    uint8_t     f[ 14 + 20 + 24 + CLIENT_MSS ];
+    int         opt_len = ( flags & TCP_SYN ) ? 4 : 0;
+    int         tcp_len = 20 + opt_len + length;
+    uint8_t*    ip = &f[ 14 ];
+    uint8_t*    tcp = &f[ 14 + 20 ];
+
+    memcpy( &f[ 0 ], hc->cfg->mac_addr, 6 );
+    memcpy( &f[ 6 ], hc->mac, 6 );
+    put16( &f[ 12 ], 0x0800 );
+
+    ip[ 0 ] = 0x45;
+    ip[ 1 ] = 0;
+    put16( &ip[ 2 ], 20 + tcp_len );
+    put16( &ip[ 4 ], hc->ip_id++ );
+    put16( &ip[ 6 ], 0x4000 );                              // don't fragment
+    ip[ 8 ] = 64;
+    ip[ 9 ] = 6;
+    put16( &ip[ 10 ], 0 );
+    put32( &ip[ 12 ], hc->ip );
+    put32( &ip[ 16 ], hc->server_ip );
+    uint16_t    csum = pkt_checksum_finish( pkt_checksum_add( ip, 20, 0 ) );
+    ip[ 10 ] = (uint8_t)( csum >> 0 );
+    ip[ 11 ] = (uint8_t)( csum >> 8 );
+
+    put16( &tcp[ 0 ], hc->port );
+    put16( &tcp[ 2 ], hc->server_port );
+    put32( &tcp[ 4 ], hc->snd_nxt );
+    put32( &tcp[ 8 ], ( flags & TCP_ACK ) ? hc->rcv_nxt : 0 );
+    tcp[ 12 ] = ( ( 20 + opt_len ) / 4 ) << 4;
+    tcp[ 13 ] = flags;
+    put16( &tcp[ 14 ], 0xffff );                            // window
+    put16( &tcp[ 16 ], 0 );
+    put16( &tcp[ 18 ], 0 );
+    if( opt_len )
+    {
+        tcp[ 20 ] = 2;                                      // MSS
+        tcp[ 21 ] = 4;
+        put16( &tcp[ 22 ], CLIENT_MSS );
+    }
+    memcpy( &tcp[ 20 + opt_len ], payload, length );
+
+    uint8_t     pseudo[ 4 ] = { 0, 6, (uint8_t)( tcp_len >> 8 ), (uint8_t)tcp_len };
+    uint32_t    sum = pkt_checksum_add( &ip[ 12 ], 8, 0 );
+    sum = pkt_checksum_add( pseudo, 4, sum );
+    csum = pkt_checksum_finish( pkt_checksum_add( tcp, tcp_len, sum ) );
+    tcp[ 16 ] = (uint8_t)( csum >> 0 );
+    tcp[ 17 ] = (uint8_t)( csum >> 8 );
+
+    rmiieth_host_inject( hc->cfg, f, 14 + 20 + tcp_len );
+
+    hc->snd_nxt += length + ( ( flags & ( TCP_SYN | TCP_FIN ) ) ? 1 : 0 );
+}
+
+static void client_send_arp_reply( host_client* hc, const uint8_t* req )
+{
+    uint8_t     f[ 14 + 28 ];
+
+    memcpy( &f[ 0 ], &req[ 6 ], 6 );
+    memcpy( &f[ 6 ], hc->mac, 6 );
+    put16( &f[ 12 ], 0x0806 );
+    memcpy( &f[ 14 ], &req[ 14 ], 6 );                      // hardware/protocol types and lengths
+    put16( &f[ 20 ], 2 );                                   // reply
+    memcpy( &f[ 22 ], hc->mac, 6 );
+    put32( &f[ 28 ], hc->ip );
+    memcpy( &f[ 32 ], &req[ 22 ], 10 );                     // the requester's MAC and IP
+    rmiieth_host_inject( hc->cfg, f, sizeof( f ) );
+}
+
+// the iperf2 header (no flags - so no test back the other way - and one thread), then digits, as iperf sends
+static void client_upload_data( host_client* hc, uint32_t offset, uint8_t* data, int length )
+{
+    uint8_t     header[ CLIENT_IPERF_HEADER ];
+    memset( header, 0, sizeof( header ) );
+    put32( &header[ 4 ], 1 );
+    put32( &header[ 8 ], CLIENT_IPERF_PORT );
+
+    for( int i = 0 ; i < length ; i++, offset++ )
+    {
+        data[ i ] = ( offset < CLIENT_IPERF_HEADER ) ? header[ offset ] : '0' + ( offset - CLIENT_IPERF_HEADER ) % 10;
+    }
+}
+
+// send as much as the stack's window allows - and our FIN, once it has ACKed everything
+static void client_upload( host_client* hc )
+{
+    uint8_t     data[ CLIENT_MSS ];
+    uint32_t    end = hc->data_seq + hc->upload_bytes;
+
+    if( hc->snd_una == end )
+    {
+        hc->response_ok = true;
+        hc->state = CLIENT_FIN_WAIT;
+        client_send_tcp( hc, TCP_FIN | TCP_ACK, NULL, 0 );
+        return;
+    }
+
+    while( true )
+    {
+        uint32_t    in_flight = hc->snd_nxt - hc->snd_una;
+        int         length = end - hc->snd_nxt;
+        if( length > CLIENT_MSS )
+        {
+            length = CLIENT_MSS;
+        }
+        if( length <= 0 || in_flight + length > hc->snd_wnd )
+        {
+            break;
+        }
+        client_upload_data( hc, hc->snd_nxt - hc->data_seq, data, length );
+        client_send_tcp( hc, TCP_ACK, data, length );
+        if( (int32_t)( hc->snd_nxt - hc->snd_max ) > 0 )
+        {
+            hc->snd_max = hc->snd_nxt;
+        }
+    }
+}
+
+// go back to the oldest unacknowledged byte, and send everything from there again
+static void client_upload_go_back( host_client* hc )
+{
+    hc->snd_nxt = hc->snd_una;
+    hc->dup_acks = 0;
+    hc->retransmits++;
+    hc->progress_us = time_us_32();
+    client_upload( hc );
+}
+
+static void client_finish( host_client* hc, bool ok )
+{
+    if( ok && hc->response_ok )
+    {
+        hc->completed++;
+        hc->latency_us += time_us_32() - hc->started_us;
+    }
+    else
+    {
+        hc->failed++;
+    }
+    hc->state = CLIENT_IDLE;
+}
+
+// starts the next request, once the last one has finished - and gives up on one that has stalled
+void host_client_poll( host_client* hc )
+{
+    if( hc->state == CLIENT_IDLE )
+    {
+        if( (int)( hc->completed + hc->failed ) >= hc->requests )
+        {
+            return;
+        }
+        hc->port = ( hc->port == 65535 ) ? 49152 : hc->port + 1;
+        hc->snd_nxt = time_us_32() * 64;
+        hc->rcv_nxt = 0;
+        hc->response_bytes = 0;
+        hc->response_ok = false;
+        hc->started_us = time_us_32();
+        hc->progress_us = hc->started_us;
+        hc->state = CLIENT_SYN_SENT;
+        client_send_tcp( hc, TCP_SYN, NULL, 0 );
+    }
+    else if( time_us_32() - hc->progress_us > CLIENT_TIMEOUT_US )
+    {
+        client_send_tcp( hc, TCP_RST | TCP_ACK, NULL, 0 );
+        client_finish( hc, false );
+    }
+    else if( hc->upload_bytes && hc->state == CLIENT_ESTABLISHED )
+    {
+        // frames the RX queue had no room for leave the stack waiting for them - and if they were the last ones
+        // in flight, it has nothing to send duplicate ACKs for
+        if( hc->snd_una != hc->snd_max && time_us_32() - hc->progress_us > CLIENT_RTO_US )
+        {
+            client_upload_go_back( hc );
+        }
+        else
+        {
+            client_upload( hc );
+        }
+    }
+}
+
+//
+// receiving - called with each frame the stack transmits
+//
+
+static void client_tcp_input( host_client* hc, const uint8_t* ip, int ip_hdr_len, int ip_len )
+{
+    const uint8_t*  tcp = &ip[ ip_hdr_len ];
+    int             tcp_len = ip_len - ip_hdr_len;
+    if( tcp_len < 20 )
+    {
+        return;
+    }
+
+    uint8_t     pseudo[ 4 ] = { 0, 6, (uint8_t)( tcp_len >> 8 ), (uint8_t)tcp_len };
+    uint32_t    sum = pkt_checksum_add( &ip[ 12 ], 8, 0 );
+    sum = pkt_checksum_add( pseudo, 4, sum );
+    if( pkt_checksum_finish( pkt_checksum_add( tcp, tcp_len, sum ) ) != 0 )
+    {
+        hc->csum_errors++;
+        return;
+    }
+
+    if( hc->state == CLIENT_IDLE || get16( &tcp[ 0 ] ) != hc->server_port || get16( &tcp[ 2 ] ) != hc->port )
+    {
+        return;
+    }
+
+    uint8_t         flags = tcp[ 13 ];
+    uint32_t        seq = get32( &tcp[ 4 ] );
+    uint32_t        ack = get32( &tcp[ 8 ] );
+    int             hdr_len = ( tcp[ 12 ] >> 4 ) * 4;
+    const uint8_t*  data = &tcp[ hdr_len ];
+    int             data_len = tcp_len - hdr_len;
+
+    if( flags & TCP_RST )
+    {
+        client_finish( hc, false );
+        return;
+    }
+
+    switch( hc->state )
+    {
+        case CLIENT_SYN_SENT:
+        {
+            if( ( flags & ( TCP_SYN | TCP_ACK ) ) != ( TCP_SYN | TCP_ACK ) || ack != hc->snd_nxt )
+            {
+                return;
+            }
+            hc->rcv_nxt = seq + 1;
+            hc->state = CLIENT_ESTABLISHED;
+            hc->progress_us = time_us_32();
+            if( hc->upload_bytes )
+            {
+                hc->data_seq = hc->snd_nxt;
+                hc->snd_una = hc->snd_nxt;
+                hc->snd_max = hc->snd_nxt;
+                hc->snd_wnd = get16( &tcp[ 14 ] );
+                hc->dup_acks = 0;
+                client_upload( hc );
+                break;
+            }
+            char    request[ 256 ];
+            int     request_len = snprintf( request, sizeof( request ), "GET %s HTTP/1.0\r\nHost: rmiieth\r\n\r\n", hc->path );
+            client_send_tcp( hc, TCP_ACK | TCP_PSH, (const uint8_t*)request, request_len );
+            break;
+        }
+
+        case CLIENT_ESTABLISHED:
+        {
+            if( hc->upload_bytes )
+            {
+                // the server only ever sends ACKs (and its FIN, after ours)
+                if( !( flags & TCP_ACK ) || (int32_t)( ack - hc->snd_una ) < 0 || (int32_t)( ack - hc->snd_max ) > 0 )
+                {
+                    return;
+                }
+                hc->snd_wnd = get16( &tcp[ 14 ] );
+                if( ack != hc->snd_una )
+                {
+                    hc->bytes += ack - hc->snd_una;
+                    hc->snd_una = ack;
+                    hc->dup_acks = 0;
+                    hc->progress_us = time_us_32();
+                    if( (int32_t)( hc->snd_nxt - ack ) < 0 )
+                    {
+                        hc->snd_nxt = ack;                          // ACKed beyond where we went back to
+                    }
+                }
+                else if( hc->snd_una != hc->snd_max && ++hc->dup_acks == 3 )
+                {
+                    client_upload_go_back( hc );
+                    return;
+                }
+                client_upload( hc );
+                return;
+            }
+            if( seq != hc->rcv_nxt )
+            {
+                client_send_tcp( hc, TCP_ACK, NULL, 0 );            // not what we expected - say what we do expect
+                return;
+            }
+            if( data_len > 0 )
+            {
+                if( !hc->response_bytes )
+                {
+                    hc->response_ok = data_len >= 12 && ( memcmp( data, "HTTP/1.0 200", 12 ) == 0 || memcmp( data, "HTTP/1.1 200", 12 ) == 0 );
+                }
+                hc->response_bytes += data_len;
+                hc->bytes += data_len;
+                hc->rcv_nxt += data_len;
+            }
+            if( flags & TCP_FIN )
+            {
+                // the server is done - close our side too
+                hc->rcv_nxt++;
+                hc->state = CLIENT_LAST_ACK;
+                client_send_tcp( hc, TCP_FIN | TCP_ACK, NULL, 0 );
+            }
+            else if( data_len > 0 )
+            {
+                client_send_tcp( hc, TCP_ACK, NULL, 0 );
+            }
+            break;
+        }
+
+        case CLIENT_FIN_WAIT:
+        {
+            if( flags & TCP_FIN )
+            {
+                hc->rcv_nxt = seq + data_len + 1;
+                client_send_tcp( hc, TCP_ACK, NULL, 0 );
+                client_finish( hc, ( flags & TCP_ACK ) && ack == hc->snd_nxt );
+            }
+            break;
+        }
+
+        case CLIENT_LAST_ACK:
+        {
+            if( ( flags & TCP_ACK ) && ack == hc->snd_nxt )
+            {
+                client_finish( hc, true );
+            }
+            break;
+        }
+    }
+}
+
+void host_client_link( void* ctx, const uint8_t* frame, int length )
+{
+    host_client*    hc = (host_client*)ctx;
+    if( length < 14 || ( !( frame[ 0 ] & 1 ) && memcmp( frame, hc->mac, 6 ) != 0 ) )
+    {
+        return;
+    }
+
+    uint32_t        type = get16( &frame[ 12 ] );
+    if( type == 0x0806 )
+    {
+        // an ARP request for our address
+        if( length >= 14 + 28 && get16( &frame[ 20 ] ) == 1 && get32( &frame[ 38 ] ) == hc->ip )
+        {
+            client_send_arp_reply( hc, frame );
+        }
+        return;
+    }
+
+    const uint8_t*  ip = &frame[ 14 ];
+    if( type != 0x0800 || length < 14 + 20 || ( ip[ 0 ] >> 4 ) != 4 )
+    {
+        return;
+    }
+    int             ip_hdr_len = ( ip[ 0 ] & 0x0f ) * 4;
+    int             ip_len = get16( &ip[ 2 ] );
+    if( ip_hdr_len < 20 || ip_len < ip_hdr_len || 14 + ip_len > length || get32( &ip[ 16 ] ) != hc->ip )
+    {
+        return;
+    }
+    if( pkt_checksum_finish( pkt_checksum_add( ip, ip_hdr_len, 0 ) ) != 0 )
+    {
+        hc->csum_errors++;
+        return;
+    }
+    if( ip[ 9 ] == 6 )
+    {
+        client_tcp_input( hc, ip, ip_hdr_len, ip_len );
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef HOST_CLIENT_H
+#define HOST_CLIENT_H
+
+#include "rmiieth_host.h"
+
+/*
+ * host_client
+ *
+ * A scripted HTTP client on the far end of the host backend's link - it makes one HTTP/1.0 GET at a time, each on a
+ * new TCP connection, speaking raw ethernet frames (ARP, IPv4 and just enough TCP for a lossless link). It checks the
+ * IP and TCP checksums of everything the stack sends, so the checksum offload is exercised too.
+ *
+ *      host_client_init( &hc, cfg, server_ip, "/index.html", 1000 );
+ *      rmiieth_host_set_link( host_client_link, &hc );
+ *
+ *      while( !host_client_done( &hc ) )
+ *      {
+ *          host_client_poll( &hc );
+ *          ... run the stack ...
+ *      }
+ *
+ * Or, instead of making requests, it uploads to lwiperf's iperf2 server (port 5001) - one connection, sending as fast
+ * as the stack's window allows:
+ *
+ *      host_client_init_upload( &hc, cfg, server_ip, 100000000 );
+ *
+ * The upload recovers from frames that the RX queue had no room for (go-back-N, on three duplicate ACKs or a stall),
+ * so that undersized queues show up as lost throughput rather than as a failure.
+ *
+ * Addresses are in host byte order.
+ */
+
+typedef struct
+{
+    rmiieth_config* cfg;
+    uint8_t         mac[ 6 ];                               // our MAC address
+    uint32_t        ip;                                     // our IP address
+    uint32_t        server_ip;
+    uint16_t        server_port;
+    const char*     path;                                   // what to GET
+    int             requests;                               // # of requests to make
+    uint32_t        upload_bytes;                           // upload: bytes to send, iperf2 header included (0 = make requests)
+
+    // state
+    int             state;
+    uint16_t        port;                                   // our port for the current connection
+    uint32_t        snd_nxt;
+    uint32_t        rcv_nxt;
+    uint32_t        response_bytes;                         // bytes of the current response so far
+    bool            response_ok;                            // the current response started with a 200 status line
+    uint32_t        started_us;                             // when the current request was started
+    uint32_t        progress_us;                            // when the current request last made progress
+    uint32_t        data_seq;                               // upload: sequence # of the first byte
+    uint32_t        snd_una;                                // upload: oldest unacknowledged sequence #
+    uint32_t        snd_max;                                // upload: highest sequence # sent
+    uint32_t        snd_wnd;                                // upload: the stack's receive window
+    int             dup_acks;                               // upload: duplicate ACKs in a row
+    uint16_t        ip_id;
+
+    // results
+    uint32_t        completed;                              // # of requests that got a 200 response
+    uint32_t        failed;                                 // # of requests that timed out, were reset, or didn't get a 200
+    uint64_t        bytes;                                  // response bytes received (headers included), or bytes uploaded
+    uint32_t        retransmits;                            // upload: # of times we went back to the last ACK
+    uint64_t        latency_us;                             // total time from SYN to the connection being closed
+    uint32_t        csum_errors;                            // # of frames from the stack with a bad IP or TCP checksum
+} host_client;
+
+
+extern void host_client_init( host_client* hc, rmiieth_config* cfg, uint32_t server_ip, const char* path, int requests );
+extern void host_client_init_upload( host_client* hc, rmiieth_config* cfg, uint32_t server_ip, uint32_t bytes );
+extern void host_client_link( void* ctx, const uint8_t* frame, int length );
+extern void host_client_poll( host_client* hc );
+extern bool host_client_done( host_client* hc );
+
+
+#endif
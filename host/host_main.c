@@ -0,0 +1,220 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_host.h"
+#include "rmiieth_netif.h"
+#include "host_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/ip_addr.h"
+#include "lwip/timeouts.h"
+#include "lwip/apps/httpd.h"
+#include "lwip/apps/lwiperf.h"
+#include "netif/ethernet.h"
+
+//
+// host build of the lwIP + httpd firmware - the netif glue, responder and httpd run against the host backend, with
+// a scripted HTTP client (or a capture file) on the other end of the link
+//
+//      rmiieth_host [-n requests] [-u path] [-w out.pcap]       time requests from the scripted client
+//      rmiieth_host -r in.pcap [-w out.pcap]                   replay a capture into the stack
+//      rmiieth_host -i bytes [-w out.pcap]                     upload to lwiperf's iperf2 server
+//
+// Build with -DRMIIETH_LWIP_PROFILE=lwipopts_throughput.h (see lwipopts.h) to run the same with another profile, and
+// with -DRMIIETH_HTTPD_FSDATA=ON to serve prebuilt content (see rmiieth_makefsdata.py) rather than lwIP's fsdata.
+//
+
+#if RMIIETH_HTTPD_FSDATA
+extern const pkt_checksum_table rmiieth_fsdata_checksums[];
+extern const int rmiieth_fsdata_checksum_count;
+#endif
+
+static uint8_t g_fake_mac[ 6 ] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05
+};
+
+static rmiieth_config g_cfg;
+static rmiieth_responder g_responder;
+static host_client g_client;
+
+u32_t sys_now( void )
+{
+    return( (u32_t)( time_us_64() / 1000 ) );
+}
+
+static void usage( void )
+{
+    printf( "usage: rmiieth_host [-n requests] [-u path] [-i upload_bytes] [-w out.pcap] [-r in.pcap]\n" );
+    exit( 1 );
+}
+
+// lwiperf's own view of the upload
+static void lwiperf_report( void* arg, enum lwiperf_report_type report_type, const ip_addr_t* local_addr, u16_t local_port,
+                            const ip_addr_t* remote_addr, u16_t remote_port, u32_t bytes_transferred, u32_t ms_duration,
+                            u32_t bandwidth_kbitpsec )
+{
+    printf( "lwiperf: %u bytes in %ums - %u kbit/s%s\n", (unsigned)bytes_transferred, (unsigned)ms_duration,
+            (unsigned)bandwidth_kbitpsec, ( report_type == LWIPERF_TCP_DONE_SERVER ) ? "" : " (aborted)" );
+}
+
+int main( int argc, char** argv )
+{
+    int         requests = 1000;
+    const char* path = "/index.html";
+    const char* pcap_out = NULL;
+    const char* replay = NULL;
+    uint32_t    upload = 0;
+
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        if( i + 1 >= argc )
+        {
+            usage();
+        }
+        if( !strcmp( argv[ i ], "-n" ) )
+        {
+            requests = atoi( argv[ ++i ] );
+        }
+        else if( !strcmp( argv[ i ], "-u" ) )
+        {
+            path = argv[ ++i ];
+        }
+        else if( !strcmp( argv[ i ], "-w" ) )
+        {
+            pcap_out = argv[ ++i ];
+        }
+        else if( !strcmp( argv[ i ], "-i" ) )
+        {
+            upload = strtoul( argv[ ++i ], NULL, 0 );
+        }
+        else if( !strcmp( argv[ i ], "-r" ) )
+        {
+            replay = argv[ ++i ];
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    //
+    // same driver config as the firmware - apart from cut-through, which the host backend doesn't model
+    //
+
+    rmiieth_set_default_config( &g_cfg );
+    memcpy( g_cfg.mac_addr, g_fake_mac, 6 );
+    g_cfg.rx_queue_buffer_size = RMIIETH_LWIP_RX_QUEUE_SIZE;           // see lwipopts.h
+    g_cfg.tx_queue_buffer_size = RMIIETH_LWIP_TX_QUEUE_SIZE;
+    g_cfg.rx_promiscuous = false;
+    g_cfg.flow_control = true;
+    g_cfg.rx_ctrl_queue_size = 2048;
+    g_cfg.tx_ctrl_queue_size = 2048;
+    g_cfg.rx_storm_control = true;
+    rmiieth_init( &g_cfg );
+
+    if( pcap_out && !rmiieth_host_pcap_open( pcap_out ) )
+    {
+        printf( "can't write %s\n", pcap_out );
+        return( 1 );
+    }
+    if( replay && !rmiieth_host_replay_open( replay ) )
+    {
+        printf( "can't read %s\n", replay );
+        return( 1 );
+    }
+
+    //
+    // lwIP - a fixed address, rather than DHCP, so that the run is repeatable
+    //
+
+    static struct netif         netif;
+    static struct ethernetif    eth;
+    ip4_addr_t                  addr, mask, gw;
+
+    lwip_init();
+    IP4_ADDR( &addr, 192, 168, 0, 2 );
+    IP4_ADDR( &mask, 255, 255, 255, 0 );
+    IP4_ADDR( &gw, 192, 168, 0, 1 );
+
+    memset( &eth, 0, sizeof( eth ) );
+    eth.rmiieth_cfg = &g_cfg;
+    rmiieth_responder_init( &g_responder, &g_cfg );
+    rmiieth_responder_set_ip( &g_responder, lwip_ntohl( ip4_addr_get_u32( &addr ) ) );
+    eth.responder = &g_responder;
+#if RMIIETH_HTTPD_FSDATA
+    eth.csum_tables = rmiieth_fsdata_checksums;
+    eth.csum_table_count = rmiieth_fsdata_checksum_count;
+#endif
+
+    netif_add( &netif, &addr, &mask, &gw, &eth, ethernetif_init, ethernet_input );
+    netif_set_default( &netif );
+    netif_set_up( &netif );
+    netif_set_link_up( &netif );
+    httpd_init();
+    lwiperf_start_tcp_server_default( lwiperf_report, NULL );
+
+    if( !replay )
+    {
+        if( upload )
+        {
+            host_client_init_upload( &g_client, &g_cfg, lwip_ntohl( ip4_addr_get_u32( &addr ) ), upload );
+        }
+        else
+        {
+            host_client_init( &g_client, &g_cfg, lwip_ntohl( ip4_addr_get_u32( &addr ) ), path, requests );
+        }
+        rmiieth_host_set_link( host_client_link, &g_client );
+    }
+
+    //
+    // the firmware's main loop - with the client taking its turn
+    //
+
+    uint64_t    start_us = time_us_64();
+    while( replay ? ( rmiieth_host_replay_active() || rmiieth_rx_packet_available( &g_cfg ) ) : !host_client_done( &g_client ) )
+    {
+        sys_check_timeouts();
+        if( !replay )
+        {
+            host_client_poll( &g_client );
+        }
+        if( !rmiieth_lwip_poll( &netif ) )
+        {
+            rmiieth_lwip_wait( &netif );
+        }
+    }
+    double      secs = ( time_us_64() - start_us ) / 1e6;
+
+    const rmiieth_host_stats*   stats = rmiieth_host_get_stats();
+    if( upload )
+    {
+        printf( "uploaded %llu bytes in %.3fs - %.1f Mbit/s, %u retransmits, %u checksum errors%s\n",
+                (unsigned long long)g_client.bytes, secs, g_client.bytes * 8 / secs / 1e6, g_client.retransmits,
+                g_client.csum_errors, g_client.failed ? " - FAILED" : "" );
+    }
+    else if( !replay )
+    {
+        printf( "%u requests in %.3fs - %.0f requests/s, %.1fus mean latency\n", g_client.completed, secs,
+                g_client.completed / secs, g_client.completed ? (double)g_client.latency_us / g_client.completed : 0.0 );
+        printf( "%u failed, %llu response bytes, %u checksum errors\n", g_client.failed,
+                (unsigned long long)g_client.bytes, g_client.csum_errors );
+    }
+    else
+    {
+        printf( "replayed %u frames in %.3fs - %.0f frames/s\n", stats->rx_frames, secs, stats->rx_frames / secs );
+    }
+    printf( "RX %u frames (%u dropped, %u filtered), TX %u frames (%u bad), %llu bytes\n", stats->rx_frames, stats->rx_dropped,
+            g_cfg.rx_filtered, stats->tx_frames, stats->tx_bad, (unsigned long long)stats->tx_bytes );
+    if( !replay && !upload )
+    {
+        printf( "%.0f bytes sent per request, %u payload pieces with precalculated checksums\n",
+                g_client.completed ? (double)stats->tx_bytes / g_client.completed : 0.0, eth.csum_pieces_used );
+    }
+
+    rmiieth_host_pcap_close();
+    return( ( !replay && g_client.failed ) || g_client.csum_errors || stats->tx_bad ? 1 : 0 );
+}
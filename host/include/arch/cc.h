@@ -0,0 +1,14 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_ARCH_CC_H
+#define RMIIETH_HOST_ARCH_CC_H
+
+// lwIP port for the host build - lwIP's defaults (printf/abort, stdint types) cover everything else
+#include <stdlib.h>
+
+#define LWIP_TIMEVAL_PRIVATE            0
+#define LWIP_RAND()                     ( (u32_t)rand() )
+
+#endif
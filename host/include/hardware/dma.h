@@ -0,0 +1,15 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_HARDWARE_DMA_H
+#define RMIIETH_HOST_HARDWARE_DMA_H
+
+#include "pico.h"
+
+typedef struct
+{
+    uint32_t    ctrl;
+} dma_channel_config;
+
+#endif
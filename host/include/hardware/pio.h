@@ -0,0 +1,26 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_HARDWARE_PIO_H
+#define RMIIETH_HOST_HARDWARE_PIO_H
+
+#include "pico.h"
+
+// only the types that rmiieth_config refers to - the host backend has no state machines
+typedef struct pio_hw pio_hw_t;
+typedef pio_hw_t* PIO;
+
+// there's nothing behind these - rmiieth_set_default_config() just needs something to put in cfg->pio
+#define pio0                            ( (PIO)NULL )
+#define pio1                            ( (PIO)NULL )
+
+typedef struct
+{
+    uint32_t    clkdiv;
+    uint32_t    execctrl;
+    uint32_t    shiftctrl;
+    uint32_t    pinctrl;
+} pio_sm_config;
+
+#endif
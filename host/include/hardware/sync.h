@@ -0,0 +1,48 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_HARDWARE_SYNC_H
+#define RMIIETH_HOST_HARDWARE_SYNC_H
+
+#include "pico.h"
+
+// everything runs on one thread - there are no interrupts to hold off, and nothing to wake
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+static inline void __sev( void )
+{
+}
+
+static inline void __wfe( void )
+{
+}
+
+static inline uint32_t save_and_disable_interrupts( void )
+{
+    return( 0 );
+}
+
+static inline void restore_interrupts( uint32_t status )
+{
+    (void)status;
+}
+
+static inline uint32_t spin_lock_blocking( spin_lock_t* lock )
+{
+    (void)lock;
+    return( 0 );
+}
+
+static inline void spin_unlock( spin_lock_t* lock, uint32_t saved_irq )
+{
+    (void)lock;
+    (void)saved_irq;
+}
+
+#endif
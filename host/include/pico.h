@@ -0,0 +1,22 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_PICO_H
+#define RMIIETH_HOST_PICO_H
+
+//
+// host build - just enough of the Pico SDK for the driver's headers, pkt_queue/pkt_utils and the lwIP glue
+//
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define __not_in_flash_func( func_name )    func_name
+#define __time_critical_func( func_name )   func_name
+#define __scratch_x( group )
+#define __scratch_y( group )
+
+#endif
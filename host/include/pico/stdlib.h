@@ -0,0 +1,47 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_PICO_STDLIB_H
+#define RMIIETH_HOST_PICO_STDLIB_H
+
+#include "pico.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef uint64_t absolute_time_t;
+
+// a stopped clock, for the self-tests (0 = the real one) - see rmiieth_host_set_clock()
+extern uint64_t g_host_clock_us;
+
+static inline uint64_t time_us_64( void )
+{
+    if( g_host_clock_us )
+    {
+        return( g_host_clock_us );
+    }
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 );
+}
+
+static inline uint32_t time_us_32( void )
+{
+    return( (uint32_t)time_us_64() );
+}
+
+static inline absolute_time_t make_timeout_time_ms( uint32_t ms )
+{
+    return( time_us_64() + (uint64_t)ms * 1000 );
+}
+
+static inline void tight_loop_contents( void )
+{
+}
+
+// see host/rmiieth_host.c
+extern void sleep_ms( uint32_t ms );
+extern bool best_effort_wfe_or_timeout( absolute_time_t timeout_timestamp );
+
+#endif
@@ -0,0 +1,459 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_host.h"
+#include "rmiieth_common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct
+{
+    rmiieth_host_link_fn    link_fn;
+    void*                   link_ctx;
+    pkt_gen                 gen;                            // encodes injected frames as the RX DMA would capture them
+    FILE*                   pcap;
+    rmiieth_host_pcap_reader replay;
+    uint8_t                 replay_frame[ PKT_GEN_MAX_FRAME ];
+    int                     replay_length;                  // frame read from the replay file, waiting for room in the RX queue (0 if none)
+    int32_t                 rx_dma_bytes;                   // raw bytes of the current frame that have "arrived" so far
+    rmiieth_host_stats      stats;
+} rmiieth_host;
+
+static rmiieth_host g_host;
+
+uint64_t            g_host_clock_us;                        // see time_us_64() in include/pico/stdlib.h
+
+static int host_rx_frame( rmiieth_config* cfg, const uint8_t* frame, int length );
+static void host_rx_arm( rmiieth_config* cfg );
+
+void rmiieth_host_set_link( rmiieth_host_link_fn fn, void* ctx )
+{
+    g_host.link_fn = fn;
+    g_host.link_ctx = ctx;
+}
+
+const rmiieth_host_stats* rmiieth_host_get_stats( void )
+{
+    return( &g_host.stats );
+}
+
+//
+// SDK stand-ins
+//
+
+// stops the clock at 'us' (which the tests move on themselves), or restarts it if 0
+void rmiieth_host_set_clock( uint64_t us )
+{
+    g_host_clock_us = us;
+}
+
+void sleep_ms( uint32_t ms )
+{
+    usleep( ms * 1000 );
+}
+
+// nothing can arrive while we sleep - the link only runs from rmiieth_poll() - so just sleep until the timeout
+bool best_effort_wfe_or_timeout( absolute_time_t timeout_timestamp )
+{
+    uint64_t    now = time_us_64();
+    if( timeout_timestamp > now )
+    {
+        usleep( timeout_timestamp - now );
+    }
+    return( true );
+}
+
+//
+// pcap files
+//
+
+static void pcap_write32( FILE* f, uint32_t v )
+{
+    fwrite( &v, 4, 1, f );
+}
+
+bool rmiieth_host_pcap_open( const char* path )
+{
+    rmiieth_host_pcap_close();
+    g_host.pcap = fopen( path, "wb" );
+    if( !g_host.pcap )
+    {
+        return( false );
+    }
+
+    // classic pcap - version 2.4, ethernet
+    pcap_write32( g_host.pcap, 0xa1b2c3d4 );
+    pcap_write32( g_host.pcap, 0x00040002 );
+    pcap_write32( g_host.pcap, 0 );
+    pcap_write32( g_host.pcap, 0 );
+    pcap_write32( g_host.pcap, 65535 );
+    pcap_write32( g_host.pcap, 1 );
+    return( true );
+}
+
+void rmiieth_host_pcap_close( void )
+{
+    if( g_host.pcap )
+    {
+        fclose( g_host.pcap );
+        g_host.pcap = NULL;
+    }
+}
+
+static void pcap_record( const uint8_t* frame, int length )
+{
+    if( !g_host.pcap )
+    {
+        return;
+    }
+    uint64_t    now = time_us_64();
+    pcap_write32( g_host.pcap, (uint32_t)( now / 1000000 ) );
+    pcap_write32( g_host.pcap, (uint32_t)( now % 1000000 ) );
+    pcap_write32( g_host.pcap, length );
+    pcap_write32( g_host.pcap, length );
+    fwrite( frame, 1, length, g_host.pcap );
+}
+
+static bool reader_read32( rmiieth_host_pcap_reader* rd, uint32_t* v )
+{
+    if( fread( v, 4, 1, rd->f ) != 1 )
+    {
+        return( false );
+    }
+    if( rd->swap )
+    {
+        *v = __builtin_bswap32( *v );
+    }
+    return( true );
+}
+
+// pcap (microsecond or nanosecond) or pcapng, in either byte order
+bool rmiieth_host_pcap_reader_open( rmiieth_host_pcap_reader* rd, const char* path )
+{
+    uint32_t    magic;
+
+    memset( rd, 0, sizeof( rmiieth_host_pcap_reader ) );
+    rd->f = fopen( path, "rb" );
+    if( !rd->f || fread( &magic, 4, 1, rd->f ) != 1 )
+    {
+        goto fail;
+    }
+
+    rd->ng = ( magic == 0x0a0d0d0a );
+    if( rd->ng )
+    {
+        fseek( rd->f, 0, SEEK_SET );                                // the section header is read like any other block
+        return( true );
+    }
+
+    rd->swap = ( magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1 );
+    if( ( magic != 0xa1b2c3d4 && magic != 0xa1b23c4d && !rd->swap ) || fseek( rd->f, 24, SEEK_SET ) )
+    {
+        goto fail;
+    }
+    return( true );
+
+fail:
+    rmiieth_host_pcap_reader_close( rd );
+    return( false );
+}
+
+void rmiieth_host_pcap_reader_close( rmiieth_host_pcap_reader* rd )
+{
+    if( rd->f )
+    {
+        fclose( rd->f );
+        rd->f = NULL;
+    }
+}
+
+// returns the frame's length, or -1 at the end of the file - frames longer than max_length are skipped
+int rmiieth_host_pcap_read( rmiieth_host_pcap_reader* rd, uint8_t* frame, int max_length )
+{
+    uint32_t    hdr[ 4 ];
+
+    while( rd->f )
+    {
+        uint32_t    cap_len;
+        long        next;
+        if( !rd->ng )
+        {
+            // ts_sec, ts_usec, incl_len, orig_len
+            for( int i = 0 ; i < 4 ; i++ )
+            {
+                if( !reader_read32( rd, &hdr[ i ] ) )
+                {
+                    return( -1 );
+                }
+            }
+            cap_len = hdr[ 2 ];
+            next = ftell( rd->f ) + cap_len;
+        }
+        else
+        {
+            // block type, block length - then, for an EPB, interface, timestamp (2 words), captured and original length
+            long    start = ftell( rd->f );
+            if( fread( hdr, 4, 3, rd->f ) != 3 )
+            {
+                return( -1 );
+            }
+            if( hdr[ 0 ] == 0x0a0d0d0a )
+            {
+                // a new section - which may have the other byte order
+                rd->swap = ( hdr[ 2 ] == 0x4d3c2b1a );
+            }
+            uint32_t    type = rd->swap ? __builtin_bswap32( hdr[ 0 ] ) : hdr[ 0 ];
+            uint32_t    block_len = rd->swap ? __builtin_bswap32( hdr[ 1 ] ) : hdr[ 1 ];
+            if( block_len < 12 )
+            {
+                return( -1 );
+            }
+            next = start + block_len;
+            if( type != 6 )
+            {
+                fseek( rd->f, next, SEEK_SET );
+                continue;
+            }
+            if( !reader_read32( rd, &hdr[ 0 ] ) || !reader_read32( rd, &hdr[ 1 ] ) || !reader_read32( rd, &cap_len ) )
+            {
+                return( -1 );
+            }
+            fseek( rd->f, 4, SEEK_CUR );
+        }
+
+        if( cap_len > (uint32_t)max_length )
+        {
+            fseek( rd->f, next, SEEK_SET );
+            continue;
+        }
+        if( fread( frame, 1, cap_len, rd->f ) != cap_len )
+        {
+            return( -1 );
+        }
+        fseek( rd->f, next, SEEK_SET );
+        return( cap_len );
+    }
+    return( -1 );
+}
+
+bool rmiieth_host_replay_open( const char* path )
+{
+    g_host.replay_length = 0;
+    return( rmiieth_host_pcap_reader_open( &g_host.replay, path ) );
+}
+
+bool rmiieth_host_replay_active( void )
+{
+    return( g_host.replay.f || g_host.replay_length );
+}
+
+// feed the replay file into RX, as far as the RX queue has room
+static void replay_feed( rmiieth_config* cfg )
+{
+    while( g_host.replay.f )
+    {
+        if( !g_host.replay_length )
+        {
+            int     length = rmiieth_host_pcap_read( &g_host.replay, g_host.replay_frame, sizeof( g_host.replay_frame ) );
+            if( length < 0 )
+            {
+                rmiieth_host_pcap_reader_close( &g_host.replay );
+                return;
+            }
+            g_host.replay_length = length;
+        }
+        if( host_rx_frame( cfg, g_host.replay_frame, g_host.replay_length ) < 0 )
+        {
+            // no room - try again once the consumer has caught up
+            return;
+        }
+        g_host.replay_length = 0;
+    }
+}
+
+//
+// init - the rest of the driver is rmiieth_common.c, as on the Pico
+//
+
+bool rmiieth_probe( rmiieth_config* cfg )
+{
+    return( true );
+}
+
+void rmiieth_init( rmiieth_config* cfg )
+{
+    // only the plain RX ring - split RX and the shared arena are all about the Pico's DMA and SRAM
+    assert( !cfg->rx_split_dma && !cfg->arena_size );
+
+    rmiieth_init_queues( cfg );
+    pkt_gen_init( &g_host.gen, 0x12345678 );
+}
+
+//
+// RX - what the RX state machine, DMA and IRQ would have done
+//
+
+#define HOST_CT_STEP_BYTES              ( 64 )              // cut-through: raw bytes that arrive between polls
+
+// as rmiieth_rx_try_start() - there's always a reservation waiting for the next frame, if the RX queue has room for one
+static bool host_rx_start( rmiieth_config* cfg )
+{
+    if( !cfg->rx_current_pkt )
+    {
+        cfg->rx_current_pkt = pkt_queue_reserve_pkt( &cfg->rx_queue, RX_RESERVE_BYTES( cfg ) );
+        if( !cfg->rx_current_pkt )
+        {
+            return( false );
+        }
+        cfg->rx_current_contig = cfg->rx_current_pkt->hdr.data_bytes;
+        host_rx_arm( cfg );
+    }
+    return( true );
+}
+
+// as rmiieth_rx_arm() - anything cut-through had done in the reservation is abandoned
+static void host_rx_arm( rmiieth_config* cfg )
+{
+    cfg->rx_arm_count++;
+    g_host.rx_dma_bytes = 0;
+}
+
+int32_t rmiieth_rx_dma_bytes( rmiieth_config* cfg )
+{
+    return( g_host.rx_dma_bytes );
+}
+
+// returns 1 if the frame was queued, 0 if it was dropped (see rmiieth_rx_sort), or -1 if there was no room for it
+static int host_rx_frame( rmiieth_config* cfg, const uint8_t* frame, int length )
+{
+    // frames that don't fit in a reservation would only have failed validation - the DMA stops short
+    if( PKT_GEN_RAW_BYTES( length ) > RX_RESERVE_BYTES( cfg ) )
+    {
+        cfg->rx_filtered++;
+        return( 0 );
+    }
+    if( !host_rx_start( cfg ) )
+    {
+        return( -1 );
+    }
+
+    // no DMA here - the frame is encoded straight into the reservation
+    pkt_queue_pkt*  pkt = cfg->rx_current_pkt;
+    int             raw_len = pkt_gen_encode( &g_host.gen, frame, length, pkt->data, RX_RESERVE_BYTES( cfg ), NULL );
+
+    // cut-through - the frame "arrives" a piece at a time, with the consumer polling as it does (from before the
+    // first byte)
+    if( cfg->rx_cut_through )
+    {
+        for( g_host.rx_dma_bytes = 0 ; g_host.rx_dma_bytes < raw_len ; g_host.rx_dma_bytes += HOST_CT_STEP_BYTES )
+        {
+            rmiieth_rx_cut_through( cfg );
+        }
+    }
+    g_host.rx_dma_bytes = raw_len;
+#if PKT_QUEUE_TIMESTAMPS
+    pkt->hdr.timestamp = time_us_32();
+#endif
+
+    int             sort = rmiieth_rx_sort( cfg, pkt, raw_len );
+    if( sort != RMIIETH_RX_SORT_COMMIT )
+    {
+        // receive the next frame into the same space
+        host_rx_arm( cfg );
+        if( sort == RMIIETH_RX_SORT_DROP )
+        {
+            return( 0 );
+        }
+    }
+    else
+    {
+        if( rmiieth_rx_ct_active( cfg, pkt ) )
+        {
+            cfg->rx_ct_committed = true;
+        }
+        cfg->rx_current_pkt = NULL;
+        pkt_queue_commit_pkt( &cfg->rx_queue, pkt, raw_len );
+        host_rx_start( cfg );
+    }
+    pcap_record( frame, length );
+
+    g_host.stats.rx_frames++;
+    g_host.stats.rx_bytes += length;
+    if( !cfg->rx_polling )
+    {
+        cfg->events |= RMIIETH_EVENT_RX;
+    }
+    return( 1 );
+}
+
+// returns false if the frame was dropped, or there was no room for it
+bool rmiieth_host_inject( rmiieth_config* cfg, const uint8_t* frame, int length )
+{
+    int     rc = host_rx_frame( cfg, frame, length );
+    if( rc < 0 )
+    {
+        g_host.stats.rx_dropped++;
+    }
+    return( rc > 0 );
+}
+
+//
+// TX - what the TX DMA and state machine would have done
+//
+
+// 'data' is preamble, SFD, frame and FCS - as the TX state machine would clock it out
+static void host_tx( const uint8_t* data, int length )
+{
+    static const uint8_t    preamble[ 8 ] = { 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0xd5 };
+
+    int         frame_len = length - 8 - 4;
+    if( frame_len < 60 || memcmp( data, preamble, 8 ) != 0 )
+    {
+        g_host.stats.tx_bad++;
+        return;
+    }
+    uint32_t    fcs = pkt_generate_fcs( (uint8_t*)&data[ 8 ], frame_len );
+    const uint8_t*  f = &data[ 8 + frame_len ];
+    if( fcs != ( f[ 0 ] | ( f[ 1 ] << 8 ) | ( f[ 2 ] << 16 ) | ( (uint32_t)f[ 3 ] << 24 ) ) )
+    {
+        g_host.stats.tx_bad++;
+        return;
+    }
+
+    g_host.stats.tx_frames++;
+    g_host.stats.tx_bytes += frame_len;
+    pcap_record( &data[ 8 ], frame_len );
+    if( g_host.link_fn )
+    {
+        g_host.link_fn( g_host.link_ctx, &data[ 8 ], frame_len );
+    }
+}
+
+// sends everything that has been scheduled (the link may inject replies as it goes), and tops up RX from the replay file
+void rmiieth_poll( rmiieth_config* cfg )
+{
+    // the TX channel is always idle - each packet goes out as soon as it's picked, and is retired by the next pick
+    pkt_queue_pkt*  p;
+    bool            sent = false;
+    while( ( p = rmiieth_tx_next( cfg ) ) )
+    {
+        host_tx( p->data + 8, p->hdr.data_bytes );
+        sent = true;
+    }
+    if( sent )
+    {
+        cfg->events |= RMIIETH_EVENT_TX;
+    }
+    rmiieth_tx_sample_stats( cfg );
+
+    // RX may have run out of room since the last frame arrived
+    host_rx_start( cfg );
+    if( cfg->rx_cut_through )
+    {
+        rmiieth_rx_cut_through( cfg );
+    }
+    replay_feed( cfg );
+}
@@ -0,0 +1,80 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_HOST_H
+#define RMIIETH_HOST_H
+
+#include "rmiieth.h"
+#include "pkt_gen.h"
+
+/*
+ * rmiieth_host
+ *
+ * The rmiieth_xxx API on Linux, for profiling everything above the PIO/DMA layer - the lwIP glue, the responder, the
+ * packet queues and the driver's own logic (rmiieth_common.c) are the same code as on the Pico. This file only stands
+ * in for the PIO, DMA and interrupts. There is one interface, and instead of a PHY it has a "link":
+ *
+ *  - frames passed to rmiieth_host_inject() are encoded the way the RX state machine delivers them (by pkt_gen -
+ *    preamble, SFD and FCS, at a random dibit offset, with trailing idle bits), and committed to the RX queue, as the
+ *    RX IRQ would. So the consumer still has to find the preamble, realign the frame and check the FCS.
+ *  - rmiieth_poll() sends the committed TX packets - their preamble and FCS are checked, and the frame is handed
+ *    to the link callback (the other end of the wire).
+ *
+ * The link can also be a pcap file: rmiieth_host_replay_open() feeds a capture into RX (as fast as the RX queue
+ * drains), and rmiieth_host_pcap_open() records both directions. The capture reader is also available on its own:
+ *
+ *      rmiieth_host_pcap_reader_open( &rd, "in.pcapng" );
+ *      while( ( len = rmiieth_host_pcap_read( &rd, frame, sizeof( frame ) ) ) >= 0 ) ...
+ *      rmiieth_host_pcap_reader_close( &rd );
+ *
+ * There are no interrupts - rmiieth_poll() does the work of the TX DMA IRQ, and rmiieth_host_inject() that of the RX
+ * IRQ (through the same rmiieth_rx_sort(), so the RX filter, storm control and the control-plane queue all apply), so
+ * the link callback may inject a reply straight away. Split RX and the shared arena aren't supported. With
+ * cut-through, each injected frame arrives a piece at a time, and is polled as it does.
+ *
+ * rmiieth_host_set_clock() stops time_us_64() and time_us_32() at a given time, so that the tests can step it.
+ */
+
+// the other end of the link - called with each frame we transmit, without preamble or FCS
+typedef void (*rmiieth_host_link_fn)( void* ctx, const uint8_t* frame, int length );
+
+typedef struct
+{
+    uint32_t        rx_frames;                              // # of frames injected into the RX queue
+    uint32_t        rx_dropped;                             // # of frames the RX queue had no room for
+    uint64_t        rx_bytes;                               // frame bytes injected
+    uint32_t        tx_frames;                              // # of frames sent
+    uint32_t        tx_bad;                                 // # of TX packets with a bad preamble or FCS
+    uint64_t        tx_bytes;                               // frame bytes sent
+} rmiieth_host_stats;
+
+typedef struct
+{
+    FILE*           f;
+    bool            ng;                                     // pcapng, rather than pcap
+    bool            swap;                                   // written with the other byte order
+} rmiieth_host_pcap_reader;
+
+
+extern void rmiieth_host_set_link( rmiieth_host_link_fn fn, void* ctx );
+extern bool rmiieth_host_inject( rmiieth_config* cfg, const uint8_t* frame, int length );
+extern bool rmiieth_host_pcap_open( const char* path );
+extern void rmiieth_host_pcap_close( void );
+extern bool rmiieth_host_replay_open( const char* path );
+extern bool rmiieth_host_replay_active( void );
+extern const rmiieth_host_stats* rmiieth_host_get_stats( void );
+extern void rmiieth_host_set_clock( uint64_t us );
+extern bool rmiieth_host_pcap_reader_open( rmiieth_host_pcap_reader* rd, const char* path );
+extern int  rmiieth_host_pcap_read( rmiieth_host_pcap_reader* rd, uint8_t* frame, int max_length );
+extern void rmiieth_host_pcap_reader_close( rmiieth_host_pcap_reader* rd );
+
+// self-tests, through the backend (see rmiieth_tests.c) - each returns its # of failures
+extern int  rmiieth_rx_ctrl_test( void );
+extern int  rmiieth_rx_ct_ctrl_test( void );
+extern int  rmiieth_rx_storm_test( void );
+extern int  rmiieth_capture_test( void );
+extern int  rmiieth_responder_test( void );
+
+
+#endif
@@ -0,0 +1,825 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_host.h"
+#include "rmiieth_common.h"
+#include "pkt_utils.h"
+#include "rmiieth_responder.h"
+#include "rmiieth_capture.h"
+#include <stdio.h>
+#include <string.h>
+
+//
+// self-tests of the driver's own logic (rmiieth_common.c), through the host backend - see rmiieth_tests.c
+//
+
+static const uint8_t    g_test_mac[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+static const uint8_t    g_test_peer[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 };
+
+static uint8_t          g_test_rx_buffer[ 16384 ] __attribute__((aligned(4)));
+static uint8_t          g_test_tx_buffer[ 8192 ] __attribute__((aligned(4)));
+static uint8_t          g_test_rx_ctrl_buffer[ 2048 ] __attribute__((aligned(4)));
+static uint8_t          g_test_tx_ctrl_buffer[ 2048 ] __attribute__((aligned(4)));
+
+// the config main.c uses, with our own buffers
+static void test_config( rmiieth_config* cfg, int32_t rx_size, int32_t rx_ctrl_size )
+{
+    rmiieth_set_default_config( cfg );
+    memcpy( cfg->mac_addr, g_test_mac, 6 );
+    cfg->rx_queue_buffer = g_test_rx_buffer;
+    cfg->rx_queue_buffer_size = rx_size;
+    cfg->tx_queue_buffer = g_test_tx_buffer;
+    cfg->tx_queue_buffer_size = sizeof( g_test_tx_buffer );
+    cfg->rx_ctrl_queue_buffer = g_test_rx_ctrl_buffer;
+    cfg->rx_ctrl_queue_size = rx_ctrl_size;
+    cfg->tx_ctrl_queue_buffer = g_test_tx_ctrl_buffer;
+    cfg->tx_ctrl_queue_size = sizeof( g_test_tx_ctrl_buffer );
+    rmiieth_init( cfg );
+}
+
+// an ethernet header from the peer, to us - returns the length of the frame, padded to the minimum
+static int test_frame( uint8_t* frame, uint16_t type, uint8_t ip_proto, int length )
+{
+    if( length < 60 )
+    {
+        length = 60;
+    }
+    memset( frame, 0, length );
+    memcpy( &frame[ 0 ], g_test_mac, 6 );
+    memcpy( &frame[ 6 ], g_test_peer, 6 );
+    frame[ 12 ] = (uint8_t)( type >> 8 );
+    frame[ 13 ] = (uint8_t)( type >> 0 );
+    if( type == 0x0800 )
+    {
+        frame[ 14 ] = 0x45;
+        frame[ 16 ] = (uint8_t)( ( length - 14 ) >> 8 );
+        frame[ 17 ] = (uint8_t)( ( length - 14 ) >> 0 );
+        frame[ 23 ] = ip_proto;
+    }
+    for( int i = 34 ; i < length ; i++ )
+    {
+        frame[ i ] = (uint8_t)i;
+    }
+    return( length );
+}
+
+//
+// rmiieth_rx_ctrl_test
+//
+// With a control queue, bulk frames are only committed to the RX ring while it keeps headroom for the next reservation
+// (rmiieth_rx_bulk_fits()). Check that rings of each size - starting with RMIIETH_STATIC_RX_SIZE - either take
+// full-sized bulk frames or have the control queue disabled, and that control frames still get through once bulk
+// frames are being dropped.
+//
+
+int rmiieth_rx_ctrl_test( void )
+{
+    static rmiieth_config   cfg;
+    static rmiieth_rx_frame frames[ 16 ];
+    static uint8_t          frame[ 1514 ];
+
+    rmiieth_set_default_config( &cfg );
+
+    int         failures = 0;
+    int32_t     reserve = RX_RESERVE_BYTES( &cfg ) + sizeof( pkt_queue_pkt_hdr );
+    int32_t     sizes[] = { RMIIETH_STATIC_RX_SIZE, 3 * reserve - 4, 3 * reserve, 6144, 8192, sizeof( g_test_rx_buffer ) };
+
+    for( int s = 0 ; s < (int)( sizeof( sizes ) / sizeof( sizes[ 0 ] ) ) ; s++ )
+    {
+        test_config( &cfg, sizes[ s ], sizeof( g_test_rx_ctrl_buffer ) );
+        bool        ctrl = ( sizes[ s ] >= 3 * reserve );
+        if( ( cfg.rx_ctrl_queue_size != 0 ) != ctrl )
+        {
+            printf( "%d byte ring: control queue %s\n", (int)sizes[ s ], ctrl ? "disabled" : "enabled" );
+            failures++;
+            continue;
+        }
+
+        // full-sized bulk frames, until the ring is full - there must be room for at least one
+        int         bulk = 0;
+        while( bulk < 16 && rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0800, 6, sizeof( frame ) ) ) )
+        {
+            bulk++;
+        }
+        if( bulk < 1 )
+        {
+            printf( "%d byte ring: only %d full-sized bulk frames fit\n", (int)sizes[ s ], bulk );
+            failures++;
+        }
+
+        // ... but an ARP must still get in, with room left for the next one
+        if( ctrl )
+        {
+            if( cfg.rx_bulk_dropped != 1 || !cfg.rx_current_pkt )
+            {
+                printf( "%d byte ring: %u bulk frames dropped, %s RX reservation\n", (int)sizes[ s ],
+                        (unsigned)cfg.rx_bulk_dropped, cfg.rx_current_pkt ? "with an" : "without an" );
+                failures++;
+            }
+            for( int i = 0 ; i < 2 ; i++ )
+            {
+                if( !rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0806, 0, 42 ) ) )
+                {
+                    printf( "%d byte ring: ARP %d dropped after %d bulk frames\n", (int)sizes[ s ], i, bulk );
+                    failures++;
+                }
+            }
+            int         count = rmiieth_rx_ctrl_get_packets( &cfg, frames, 16 );
+            if( count != 2 || cfg.rx_ctrl_frames != 2 )
+            {
+                printf( "%d byte ring: %d control frames queued\n", (int)sizes[ s ], count );
+                failures++;
+            }
+            rmiieth_rx_ctrl_consume_packets( &cfg, count );
+        }
+
+        // everything that was accepted reaches the consumer, intact
+        int         bulk_length = test_frame( frame, 0x0800, 6, sizeof( frame ) );
+        int         count = rmiieth_rx_get_packets( &cfg, frames, 16 );
+        int         good = 0;
+        for( int i = 0 ; i < count ; i++ )
+        {
+            int     length = frames[ i ].length;
+            good += ( pkt_validate( frames[ i ].data, &length ) && length == bulk_length &&
+                      memcmp( frames[ i ].data, frame, length ) == 0 );
+        }
+        if( count != bulk || good != bulk )
+        {
+            printf( "%d byte ring: %d bulk frames accepted, %d received, %d intact\n", (int)sizes[ s ], bulk, count, good );
+            failures++;
+        }
+        rmiieth_rx_consume_packets( &cfg, count );
+
+        // and once they've been consumed, a bulk frame gets in again
+        if( !rmiieth_host_inject( &cfg, frame, bulk_length ) )
+        {
+            printf( "%d byte ring: bulk frame dropped after draining\n", (int)sizes[ s ] );
+            failures++;
+        }
+        rmiieth_rx_consume_packets( &cfg, rmiieth_rx_get_packets( &cfg, frames, 16 ) );
+
+        printf( "%5d byte ring: control queue %s, %d full-sized bulk frames\n", (int)sizes[ s ], ctrl ? "on " : "off", bulk );
+    }
+    return( failures );
+}
+
+//
+// rmiieth_rx_ct_ctrl_test
+//
+// Cut-through and the control queue together, as main.c configures them - cut-through mustn't take on control frames
+// (which would then go through the ring, as bulk), and must still validate the bulk frames ahead of the consumer. Then,
+// with the ring full of bulk frames, control frames must still get in.
+//
+
+int rmiieth_rx_ct_ctrl_test( void )
+{
+    static rmiieth_config   cfg;
+    static rmiieth_rx_frame frames[ 16 ];
+    static uint8_t          frame[ 1514 ];
+    static const int        bulk_sizes[] = { 1514, 60, 600 };
+
+    int         failures = 0;
+    int         ctrl_sent = 0;
+    int         bulk_sent = 0;
+    int         bulk_ok = 0;
+    int         ctrl_ok = 0;
+
+    test_config( &cfg, 8192, sizeof( g_test_rx_ctrl_buffer ) );
+    cfg.rx_cut_through = true;
+
+    // mixed traffic, drained as it goes
+    for( int i = 0 ; i < 300 ; i++ )
+    {
+        int     bulk_length = bulk_sizes[ i % 3 ];
+        rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0806, 0, 42 ) );
+        rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0800, 1, 98 ) );
+        ctrl_sent += 2;
+        if( rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0800, 6, bulk_length ) ) )
+        {
+            bulk_sent++;
+        }
+        rmiieth_poll( &cfg );
+
+        int     count = rmiieth_rx_ctrl_get_packets( &cfg, frames, 16 );
+        for( int j = 0 ; j < count ; j++ )
+        {
+            int     length = frames[ j ].length;
+            ctrl_ok += ( frames[ j ].validated == 0 && pkt_validate( frames[ j ].data, &length ) &&
+                         ( length == 60 || length == 98 ) );
+        }
+        rmiieth_rx_ctrl_consume_packets( &cfg, count );
+
+        count = rmiieth_rx_get_packets( &cfg, frames, 16 );
+        for( int j = 0 ; j < count ; j++ )
+        {
+            bulk_ok += ( frames[ j ].validated == 1 && frames[ j ].length == bulk_length &&
+                         memcmp( frames[ j ].data, frame, bulk_length ) == 0 );
+        }
+        rmiieth_rx_consume_packets( &cfg, count );
+    }
+    if( cfg.rx_ctrl_frames != (uint32_t)ctrl_sent || ctrl_ok != ctrl_sent || bulk_ok != bulk_sent || bulk_sent != 300 )
+    {
+        printf( "mixed: %d/%u/%d control frames sent/queued/intact, %d/%d bulk frames sent/validated ahead\n",
+                ctrl_sent, (unsigned)cfg.rx_ctrl_frames, ctrl_ok, bulk_sent, bulk_ok );
+        failures++;
+    }
+
+    // fill the ring with bulk frames - control frames must still get in
+    int         bulk = 0;
+    while( bulk < 16 && rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0800, 6, sizeof( frame ) ) ) )
+    {
+        bulk++;
+    }
+    uint32_t    ctrl_before = cfg.rx_ctrl_frames;
+    for( int i = 0 ; i < 4 ; i++ )
+    {
+        rmiieth_host_inject( &cfg, frame, test_frame( frame, 0x0806, 0, 42 ) );
+        rmiieth_poll( &cfg );
+    }
+    if( cfg.rx_bulk_dropped != 1 || cfg.rx_ctrl_frames != ctrl_before + 4 )
+    {
+        printf( "full ring: %u bulk frames dropped, %u of 4 control frames queued\n", (unsigned)cfg.rx_bulk_dropped,
+                (unsigned)( cfg.rx_ctrl_frames - ctrl_before ) );
+        failures++;
+    }
+    rmiieth_rx_ctrl_consume_packets( &cfg, rmiieth_rx_ctrl_get_packets( &cfg, frames, 16 ) );
+    rmiieth_rx_consume_packets( &cfg, rmiieth_rx_get_packets( &cfg, frames, 16 ) );
+
+    printf( "%d control frames through the control queue, %u bulk frames validated by cut-through\n", ctrl_sent + 4,
+            (unsigned)cfg.rx_ct_frames );
+    return( failures );
+}
+
+//
+// rmiieth_rx_storm_test
+//
+// Storm control's token buckets (rmiieth_rx_storm_pass()), on a stopped clock - each class passes its burst and then its
+// rate, a rate of 0 doesn't limit at all, and neither a long idle (where elapsed * rate would overflow), the largest
+// burst allowed, nor time_us_32() wrapping around upsets the arithmetic.
+//
+
+static const uint8_t    g_storm_dest[ RMIIETH_STORM_CLASSES ][ 6 ] = {
+    [ RMIIETH_STORM_BROADCAST ]         = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    [ RMIIETH_STORM_MULTICAST ]         = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x01 },
+    [ RMIIETH_STORM_UNKNOWN_UNICAST ]   = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x03 },
+};
+
+// 'count' frames of a class, back-to-back - returns how many got through
+static int test_storm( rmiieth_config* cfg, const uint8_t* dest, int count )
+{
+    static rmiieth_rx_frame frames[ 16 ];
+    static uint8_t          frame[ 60 ];
+
+    int         passed = 0;
+    test_frame( frame, 0x0800, 17, sizeof( frame ) );
+    memcpy( frame, dest, 6 );
+    for( int i = 0 ; i < count ; i++ )
+    {
+        passed += rmiieth_host_inject( cfg, frame, sizeof( frame ) );
+        rmiieth_rx_consume_packets( cfg, rmiieth_rx_get_packets( cfg, frames, 16 ) );
+    }
+    return( passed );
+}
+
+// (re)starts storm control at 'now', with full buckets
+static void test_storm_config( rmiieth_config* cfg, uint64_t now, uint32_t rate, uint32_t burst )
+{
+    rmiieth_host_set_clock( now );
+    test_config( cfg, sizeof( g_test_rx_buffer ), 0 );
+    cfg->rx_promiscuous = true;
+    cfg->rx_all_multicast = true;
+    cfg->rx_storm_control = true;
+    cfg->rx_storm_rate[ RMIIETH_STORM_BROADCAST ] = rate;
+    cfg->rx_storm_burst[ RMIIETH_STORM_BROADCAST ] = burst;
+    cfg->rx_storm_rate[ RMIIETH_STORM_MULTICAST ] = rate / 2;
+    cfg->rx_storm_burst[ RMIIETH_STORM_MULTICAST ] = burst / 2;
+    cfg->rx_storm_rate[ RMIIETH_STORM_UNKNOWN_UNICAST ] = 0;
+    cfg->rx_storm_burst[ RMIIETH_STORM_UNKNOWN_UNICAST ] = 0;
+    rmiieth_init( cfg );
+}
+
+static int test_storm_expect( const char* what, int passed, int expected )
+{
+    if( passed != expected )
+    {
+        printf( "%s: %d frames passed, expected %d\n", what, passed, expected );
+        return( 1 );
+    }
+    return( 0 );
+}
+
+int rmiieth_rx_storm_test( void )
+{
+    static rmiieth_config   cfg;
+
+    const uint8_t*  bcast = g_storm_dest[ RMIIETH_STORM_BROADCAST ];
+    const uint8_t*  mcast = g_storm_dest[ RMIIETH_STORM_MULTICAST ];
+    const uint8_t*  unknown = g_storm_dest[ RMIIETH_STORM_UNKNOWN_UNICAST ];
+    int             failures = 0;
+    uint64_t        now = 1000000;
+
+    // burst, then rate - 1000/sec (one frame per ms) for broadcast, 500/sec for multicast
+    test_storm_config( &cfg, now, 1000, 8 );
+    failures += test_storm_expect( "broadcast burst", test_storm( &cfg, bcast, 20 ), 8 );
+    failures += test_storm_expect( "multicast burst", test_storm( &cfg, mcast, 20 ), 4 );
+    failures += test_storm_expect( "unknown unicast (no limit)", test_storm( &cfg, unknown, 1000 ), 1000 );
+    failures += test_storm_expect( "our own address (not policed)", test_storm( &cfg, g_test_mac, 1000 ), 1000 );
+    int     bcast_rate = 0;
+    int     mcast_rate = 0;
+    for( int i = 0 ; i < 100 ; i++ )
+    {
+        rmiieth_host_set_clock( now += 1000 );
+        bcast_rate += test_storm( &cfg, bcast, 3 );
+        mcast_rate += test_storm( &cfg, mcast, 3 );
+    }
+    failures += test_storm_expect( "broadcast over 100ms", bcast_rate, 100 );
+    failures += test_storm_expect( "multicast over 100ms", mcast_rate, 50 );
+    if( cfg.rx_storm[ RMIIETH_STORM_BROADCAST ].dropped != 12 + 200 ||
+        cfg.rx_storm[ RMIIETH_STORM_UNKNOWN_UNICAST ].passed != 1000 )
+    {
+        printf( "policer counts: %u broadcast frames dropped, %u unknown unicast passed\n",
+                (unsigned)cfg.rx_storm[ RMIIETH_STORM_BROADCAST ].dropped,
+                (unsigned)cfg.rx_storm[ RMIIETH_STORM_UNKNOWN_UNICAST ].passed );
+        failures++;
+    }
+
+    // a partial top-up, then idles that refill the bucket - exactly full / rate, and one long enough that elapsed * rate
+    // wraps to almost nothing (the clamp mustn't be skipped)
+    rmiieth_host_set_clock( now += 3000 );
+    failures += test_storm_expect( "broadcast after 3ms", test_storm( &cfg, bcast, 20 ), 3 );
+    rmiieth_host_set_clock( now += 8000 );
+    failures += test_storm_expect( "broadcast after full / rate", test_storm( &cfg, bcast, 20 ), 8 );
+    rmiieth_host_set_clock( now += 4294968 );
+    failures += test_storm_expect( "broadcast after 2^32 / rate us", test_storm( &cfg, bcast, 20 ), 8 );
+
+    // the largest burst - 4000 frames, in millionths, only just fits in the 32-bit bucket
+    test_storm_config( &cfg, now, 1000, 4000 );
+    failures += test_storm_expect( "4000 frame burst", test_storm( &cfg, bcast, 4100 ), 4000 );
+    rmiieth_host_set_clock( now += 1000 );
+    failures += test_storm_expect( "4000 frame burst, then 1ms", test_storm( &cfg, bcast, 20 ), 1 );
+    rmiieth_host_set_clock( now += 10000000 );
+    failures += test_storm_expect( "4000 frame burst, after 10s", test_storm( &cfg, bcast, 4100 ), 4000 );
+
+    // time_us_32() wrapping around between frames
+    now = ( 1ull << 33 ) - 1500;
+    test_storm_config( &cfg, now, 1000, 8 );
+    failures += test_storm_expect( "burst before the wrap", test_storm( &cfg, bcast, 20 ), 8 );
+    rmiieth_host_set_clock( now += 3000 );
+    failures += test_storm_expect( "3ms, across the wrap", test_storm( &cfg, bcast, 20 ), 3 );
+    rmiieth_host_set_clock( now += 1000 );
+    failures += test_storm_expect( "1ms after the wrap", test_storm( &cfg, bcast, 20 ), 1 );
+
+    rmiieth_host_set_clock( 0 );
+    printf( "%u broadcast frames passed and %u dropped, in the last run\n",
+            (unsigned)cfg.rx_storm[ RMIIETH_STORM_BROADCAST ].passed,
+            (unsigned)cfg.rx_storm[ RMIIETH_STORM_BROADCAST ].dropped );
+    return( failures );
+}
+
+//
+// rmiieth_capture_test
+//
+// The capture producer and consumer (rmiieth_capture.c), on a small ring and a stopped clock - RX frames (some split
+// across the end of the RX ring) and TX frames go in faster than a slow sink takes them, a few bytes at a time. The
+// stream must parse as pcapng, with every captured frame intact, blocks wrapping around the end of the capture ring,
+// an epb_dropcount after each gap, and timestamps extended to 64 bits across a time_us_32() wrap.
+//
+
+#define TEST_CAPTURE_RING               ( 512 )
+#define TEST_CAPTURE_FRAMES             ( 200 )
+
+typedef struct
+{
+    uint8_t         data[ 65536 ];
+    int             length;
+    int             calls;
+} test_capture_sink;
+
+typedef struct
+{
+    uint64_t        timestamp;
+    uint32_t        flags;
+    int             length;
+    uint8_t         seed;
+    uint32_t        drops;                                  // frames dropped just before this one
+} test_capture_frame;
+
+// a slow link - takes 0, 7, 14, 21 or 28 bytes at a time
+static int test_capture_write( void* ctx, const uint8_t* data, int length )
+{
+    test_capture_sink*  sink = (test_capture_sink*)ctx;
+    int                 accept = ( sink->calls++ % 5 ) * 7;
+    if( accept > length )
+    {
+        accept = length;
+    }
+    if( accept > (int)sizeof( sink->data ) - sink->length )
+    {
+        accept = (int)sizeof( sink->data ) - sink->length;
+    }
+    memcpy( &sink->data[ sink->length ], data, accept );
+    sink->length += accept;
+    return( accept );
+}
+
+static uint32_t get_le32( const uint8_t* p )
+{
+    return( p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 ) | ( (uint32_t)p[ 3 ] << 24 ) );
+}
+
+// checks one Enhanced Packet Block against the frame that went in - returns its length, or 0 if it's wrong
+static int test_capture_epb( const uint8_t* p, int left, const test_capture_frame* f )
+{
+    int         pad_len = ( f->length + 3 ) & (~3);
+    int         block_len = 32 + pad_len + 12 + ( f->drops ? 12 : 0 );
+    if( left < block_len || get_le32( &p[ 0 ] ) != 6 || (int)get_le32( &p[ 4 ] ) != block_len ||
+        get_le32( &p[ 12 ] ) != (uint32_t)( f->timestamp >> 32 ) || get_le32( &p[ 16 ] ) != (uint32_t)f->timestamp ||
+        (int)get_le32( &p[ 20 ] ) != f->length || (int)get_le32( &p[ 24 ] ) != f->length )
+    {
+        return( 0 );
+    }
+    for( int i = 0 ; i < f->length ; i++ )
+    {
+        if( p[ 28 + i ] != (uint8_t)( f->seed + i ) )
+        {
+            return( 0 );
+        }
+    }
+    const uint8_t*  opt = &p[ 28 + pad_len ];
+    if( get_le32( &opt[ 0 ] ) != ( 2 | ( 4 << 16 ) ) || get_le32( &opt[ 4 ] ) != f->flags )
+    {
+        return( 0 );
+    }
+    opt += 8;
+    if( f->drops )
+    {
+        if( get_le32( &opt[ 0 ] ) != ( 4 | ( 8 << 16 ) ) || get_le32( &opt[ 4 ] ) != f->drops || get_le32( &opt[ 8 ] ) )
+        {
+            return( 0 );
+        }
+        opt += 12;
+    }
+    if( get_le32( &opt[ 0 ] ) != 0 || (int)get_le32( &opt[ 4 ] ) != block_len )
+    {
+        return( 0 );
+    }
+    return( block_len );
+}
+
+int rmiieth_capture_test( void )
+{
+    static rmiieth_capture      cap;
+    static uint8_t              ring[ TEST_CAPTURE_RING ] __attribute__((aligned(4)));
+    static test_capture_sink    sink;
+    static test_capture_frame   expected[ TEST_CAPTURE_FRAMES * 2 ];
+    static uint8_t              frame[ 300 ];
+    static uint8_t              wrap[ 300 ];
+
+    int         failures = 0;
+    int         count = 0;
+    int         straddled = 0;
+    int         attempts = 0;
+    uint32_t    drops = 0;
+    uint64_t    start = ( 3ull << 32 ) - 5000;              // time_us_32() wraps a few frames in
+    uint64_t    now = start;
+
+    memset( &sink, 0, sizeof( sink ) );
+    rmiieth_host_set_clock( now );
+    rmiieth_capture_init( &cap, ring, sizeof( ring ), test_capture_write, &sink );
+    cap.tx_enabled = true;
+
+    for( int i = 0 ; i < TEST_CAPTURE_FRAMES ; i++ )
+    {
+        rmiieth_host_set_clock( now += 700 );
+
+        // an RX frame - every third one split across the end of the RX ring
+        test_capture_frame* f = &expected[ count ];
+        f->timestamp = now;
+        f->flags = 1;
+        f->length = 60 + ( i * 37 ) % 200;
+        f->seed = (uint8_t)( i * 13 );
+        f->drops = drops;
+        for( int j = 0 ; j < f->length ; j++ )
+        {
+            frame[ j ] = (uint8_t)( f->seed + j );
+        }
+        rmiieth_rx_frame    rx = { .data = frame, .length = f->length, .timestamp_us = (uint32_t)now };
+        if( i % 3 == 0 )
+        {
+            rx.wrap_offset = f->length / 3;
+            rx.wrap_data = wrap;
+            memcpy( wrap, &frame[ rx.wrap_offset ], f->length - rx.wrap_offset );
+            memset( &frame[ rx.wrap_offset ], 0, f->length - rx.wrap_offset );
+        }
+        uint32_t    pos = cap.head & ( sizeof( ring ) - 1 );
+        uint32_t    head = cap.head;
+        attempts++;
+        if( rmiieth_capture_rx( &cap, &rx ) )
+        {
+            straddled += ( pos + ( cap.head - head ) > sizeof( ring ) );
+            count++;
+            drops = 0;
+        }
+        else
+        {
+            drops++;
+        }
+
+        // ... and every fourth time, a TX frame
+        if( i % 4 == 1 )
+        {
+            f = &expected[ count ];
+            f->timestamp = now;
+            f->flags = 2;
+            f->length = 60 + i % 40;
+            f->seed = (uint8_t)( i * 7 );
+            f->drops = drops;
+            for( int j = 0 ; j < f->length ; j++ )
+            {
+                frame[ j ] = (uint8_t)( f->seed + j );
+            }
+            attempts++;
+            if( rmiieth_capture_tx( &cap, frame, f->length ) )
+            {
+                count++;
+                drops = 0;
+            }
+            else
+            {
+                drops++;
+            }
+        }
+
+        rmiieth_capture_drain( &cap );
+    }
+    for( int i = 0 ; i < 1000 && cap.tail != cap.head ; i++ )
+    {
+        rmiieth_capture_drain( &cap );
+    }
+    rmiieth_host_set_clock( 0 );
+
+    // the header blocks, then every frame captured - in order
+    const uint8_t*  p = sink.data;
+    int             left = sink.length;
+    if( left < 48 || get_le32( &p[ 0 ] ) != 0x0a0d0d0a || get_le32( &p[ 4 ] ) != 28 || get_le32( &p[ 8 ] ) != 0x1a2b3c4d ||
+        get_le32( &p[ 24 ] ) != 28 || get_le32( &p[ 28 ] ) != 1 || get_le32( &p[ 32 ] ) != 20 || get_le32( &p[ 36 ] ) != 1 ||
+        get_le32( &p[ 44 ] ) != 20 )
+    {
+        printf( "bad section header or interface description\n" );
+        return( failures + 1 );
+    }
+    p += 48;
+    left -= 48;
+    int         drop_blocks = 0;
+    for( int i = 0 ; i < count ; i++ )
+    {
+        int     block_len = test_capture_epb( p, left, &expected[ i ] );
+        if( !block_len )
+        {
+            printf( "frame %d of %d (%d bytes, %u dropped before it) doesn't match\n", i, count, expected[ i ].length,
+                    (unsigned)expected[ i ].drops );
+            failures++;
+            break;
+        }
+        drop_blocks += ( expected[ i ].drops != 0 );
+        p += block_len;
+        left -= block_len;
+    }
+    if( left || cap.bytes_sent != (uint32_t)sink.length || (int)cap.captured != count ||
+        (int)( cap.captured + cap.dropped ) != attempts )
+    {
+        printf( "%d bytes left over, %u sent to a sink that took %d, %u + %u of %d frames captured + dropped\n", left,
+                (unsigned)cap.bytes_sent, sink.length, (unsigned)cap.captured, (unsigned)cap.dropped, attempts );
+        failures++;
+    }
+    if( !straddled || !drop_blocks || ( now >> 32 ) == ( start >> 32 ) )
+    {
+        printf( "not covered: %d blocks across the end of the ring, %d with a dropcount, clock from %llx to %llx\n",
+                straddled, drop_blocks, (unsigned long long)start, (unsigned long long)now );
+        failures++;
+    }
+
+    printf( "%u frames captured, %u dropped, %d blocks across the end of the ring, %u bytes in %d sink calls\n",
+            (unsigned)cap.captured, (unsigned)cap.dropped, straddled, (unsigned)cap.bytes_sent, sink.calls );
+    return( failures );
+}
+
+//
+// rmiieth_responder_test
+//
+// ARP and ICMP echo requests go in through the host backend, are fetched and validated as rmiieth_netif.c would, and
+// offered to the responder - then the replies that rmiieth_poll() sends are checked byte for byte against ones built
+// here from scratch. Requests that aren't for us, or that are damaged, must be left for the stack.
+//
+
+#define TEST_IP                         ( 0xc0a8000a )      // 192.168.0.10
+#define TEST_PEER_IP                    ( 0xc0a80002 )      // 192.168.0.2
+#define TEST_MAX_REPLIES                ( 8 )
+
+typedef struct
+{
+    int             count;
+    int             length[ TEST_MAX_REPLIES ];
+    uint8_t         frame[ TEST_MAX_REPLIES ][ 1514 ];
+} test_replies;
+
+static void test_link( void* ctx, const uint8_t* frame, int length )
+{
+    test_replies*   replies = (test_replies*)ctx;
+    if( replies->count < TEST_MAX_REPLIES && length <= 1514 )
+    {
+        memcpy( replies->frame[ replies->count ], frame, length );
+        replies->length[ replies->count++ ] = length;
+    }
+}
+
+static void put_be32( uint8_t* p, uint32_t v )
+{
+    p[ 0 ] = (uint8_t)( v >> 24 );
+    p[ 1 ] = (uint8_t)( v >> 16 );
+    p[ 2 ] = (uint8_t)( v >> 8 );
+    p[ 3 ] = (uint8_t)( v >> 0 );
+}
+
+// checksums are in memory byte order, as in pkt_utils
+static void put_checksum( uint8_t* p, const uint8_t* data, int length )
+{
+    p[ 0 ] = 0;
+    p[ 1 ] = 0;
+    uint16_t    csum = pkt_checksum_finish( pkt_checksum_add( (uint8_t*)data, length, 0 ) );
+    p[ 0 ] = (uint8_t)( csum >> 0 );
+    p[ 1 ] = (uint8_t)( csum >> 8 );
+}
+
+// an ARP request or reply, from 'src' to 'dest'
+static int test_arp( uint8_t* frame, uint16_t op, const uint8_t* dest, const uint8_t* src, uint32_t src_ip,
+                     const uint8_t* target, uint32_t target_ip )
+{
+    static const uint8_t    arp_hdr[ 6 ] = { 0x00, 0x01, 0x08, 0x00, 6, 4 };
+
+    memset( frame, 0, 60 );
+    memcpy( &frame[ 0 ], dest, 6 );
+    memcpy( &frame[ 6 ], src, 6 );
+    frame[ 12 ] = 0x08;
+    frame[ 13 ] = 0x06;
+    memcpy( &frame[ 14 ], arp_hdr, 6 );
+    frame[ 21 ] = (uint8_t)op;
+    memcpy( &frame[ 22 ], src, 6 );
+    put_be32( &frame[ 28 ], src_ip );
+    memcpy( &frame[ 32 ], target, 6 );
+    put_be32( &frame[ 38 ], target_ip );
+    return( 60 );
+}
+
+// an ICMP echo request or reply, with 'payload' bytes of data
+static int test_echo( uint8_t* frame, uint8_t type, const uint8_t* dest, const uint8_t* src, uint32_t src_ip,
+                      uint32_t dest_ip, uint8_t ttl, int payload )
+{
+    int         ip_len = 20 + 8 + payload;
+
+    memset( frame, 0, 60 );
+    memcpy( &frame[ 0 ], dest, 6 );
+    memcpy( &frame[ 6 ], src, 6 );
+    frame[ 12 ] = 0x08;
+    frame[ 13 ] = 0x00;
+
+    uint8_t*    ip = &frame[ 14 ];
+    ip[ 0 ] = 0x45;
+    ip[ 2 ] = (uint8_t)( ip_len >> 8 );
+    ip[ 3 ] = (uint8_t)( ip_len >> 0 );
+    ip[ 4 ] = 0x12;                                         // identification
+    ip[ 5 ] = 0x34;
+    ip[ 8 ] = ttl;
+    ip[ 9 ] = 1;
+    put_be32( &ip[ 12 ], src_ip );
+    put_be32( &ip[ 16 ], dest_ip );
+    put_checksum( &ip[ 10 ], ip, 20 );
+
+    uint8_t*    icmp = &ip[ 20 ];
+    icmp[ 0 ] = type;
+    icmp[ 4 ] = 0xbe;                                       // identifier, sequence
+    icmp[ 5 ] = 0xef;
+    icmp[ 7 ] = 0x01;
+    for( int i = 0 ; i < payload ; i++ )
+    {
+        icmp[ 8 + i ] = (uint8_t)( i * 7 );
+    }
+    put_checksum( &icmp[ 2 ], icmp, 8 + payload );
+
+    int         length = 14 + ip_len;
+    return( ( length < 60 ) ? 60 : length );
+}
+
+// fetch, validate and offer each received frame to the responder, as rmiieth_netif.c does (control queue first) -
+// returns the # it handled
+static int test_respond( rmiieth_config* cfg, rmiieth_responder* r )
+{
+    static rmiieth_rx_frame frames[ 16 ];
+
+    int         handled = 0;
+    for( int ctrl = 1 ; ctrl >= 0 ; ctrl-- )
+    {
+        int     count = ctrl ? rmiieth_rx_ctrl_get_packets( cfg, frames, 16 ) : rmiieth_rx_get_packets( cfg, frames, 16 );
+        for( int i = 0 ; i < count ; i++ )
+        {
+            int     length = frames[ i ].length;
+            if( pkt_validate( frames[ i ].data, &length ) && rmiieth_responder_input( r, frames[ i ].data, length ) )
+            {
+                handled++;
+            }
+        }
+        if( ctrl )
+        {
+            rmiieth_rx_ctrl_consume_packets( cfg, count );
+        }
+        else
+        {
+            rmiieth_rx_consume_packets( cfg, count );
+        }
+    }
+    return( handled );
+}
+
+int rmiieth_responder_test( void )
+{
+    static rmiieth_config       cfg;
+    static rmiieth_responder    r;
+    static test_replies         replies;
+    static uint8_t              frame[ 1514 ];
+    static uint8_t              expected[ 1514 ];
+
+    static const uint8_t        broadcast[ 6 ] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    static const uint8_t        zero[ 6 ] = { 0 };
+    static const int            payloads[] = { 0, 56, 1472 };
+
+    int         failures = 0;
+
+    // through the control queue, and through the main one
+    for( int pass = 0 ; pass < 2 ; pass++ )
+    {
+        test_config( &cfg, 8192, pass ? 0 : sizeof( g_test_rx_ctrl_buffer ) );
+        rmiieth_responder_init( &r, &cfg );
+        rmiieth_responder_set_ip( &r, TEST_IP );
+        memset( &replies, 0, sizeof( replies ) );
+        rmiieth_host_set_link( test_link, &replies );
+        const char* via = pass ? "main queue" : "control queue";
+
+        // one ARP for us, and one for someone else
+        rmiieth_host_inject( &cfg, frame, test_arp( frame, 1, broadcast, g_test_peer, TEST_PEER_IP, zero, TEST_IP ) );
+        rmiieth_host_inject( &cfg, frame, test_arp( frame, 1, broadcast, g_test_peer, TEST_PEER_IP, zero, TEST_IP + 1 ) );
+        int         handled = test_respond( &cfg, &r );
+        rmiieth_poll( &cfg );
+
+        test_arp( expected, 2, g_test_peer, g_test_mac, TEST_IP, g_test_peer, TEST_PEER_IP );
+        if( handled != 1 || r.arp_replies != 1 || replies.count != 1 || replies.length[ 0 ] != 60 ||
+            memcmp( replies.frame[ 0 ], expected, 60 ) != 0 )
+        {
+            printf( "%s: ARP - %d handled, %d replies\n", via, handled, replies.count );
+            if( replies.count )
+            {
+                pkt_dump( replies.frame[ 0 ], replies.length[ 0 ], 64 );
+            }
+            failures++;
+        }
+
+        // echo requests of each size - then one for someone else, and one with a bad header checksum
+        for( int p = 0 ; p < (int)( sizeof( payloads ) / sizeof( payloads[ 0 ] ) ) ; p++ )
+        {
+            replies.count = 0;
+            int     length = test_echo( frame, 8, g_test_mac, g_test_peer, TEST_PEER_IP, TEST_IP, 17, payloads[ p ] );
+            rmiieth_host_inject( &cfg, frame, length );
+            if( p == 0 )
+            {
+                test_echo( frame, 8, g_test_mac, g_test_peer, TEST_PEER_IP, TEST_IP + 1, 17, 8 );
+                rmiieth_host_inject( &cfg, frame, length );
+                test_echo( frame, 8, g_test_mac, g_test_peer, TEST_PEER_IP, TEST_IP, 17, 8 );
+                frame[ 14 + 10 ] ^= 0x01;
+                rmiieth_host_inject( &cfg, frame, length );
+            }
+            handled = test_respond( &cfg, &r );
+            rmiieth_poll( &cfg );
+
+            test_echo( expected, 0, g_test_peer, g_test_mac, TEST_IP, TEST_PEER_IP, 64, payloads[ p ] );
+            if( handled != 1 || replies.count != 1 || replies.length[ 0 ] != length ||
+                memcmp( replies.frame[ 0 ], expected, length ) != 0 )
+            {
+                printf( "%s: %d byte echo - %d handled, %d replies\n", via, payloads[ p ], handled, replies.count );
+                if( replies.count )
+                {
+                    pkt_dump( replies.frame[ 0 ], replies.length[ 0 ], 64 );
+                }
+                failures++;
+            }
+        }
+        if( r.echo_replies != 3 || r.tx_full || rmiieth_host_get_stats()->tx_bad )
+        {
+            printf( "%s: %u echo replies, %u dropped, %u bad TX frames\n", via, (unsigned)r.echo_replies,
+                    (unsigned)r.tx_full, (unsigned)rmiieth_host_get_stats()->tx_bad );
+            failures++;
+        }
+        printf( "%s: %u ARP and %u echo replies\n", via, (unsigned)r.arp_replies, (unsigned)r.echo_replies );
+    }
+    rmiieth_host_set_link( NULL, NULL );
+    return( failures );
+}
@@ -0,0 +1,398 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_host.h"
+#include "pkt_gen.h"
+#include "pkt_queue.h"
+#include "pkt_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// RX replay harness - pushes synthetic (or captured) traffic, as raw RMII buffers from pkt_gen, through the same
+// queue and validation code as the RX path, as fast as it will go, and reports where the time goes and how many of
+// the corrupted frames were caught.
+//
+// Each batch goes through three stages, timed separately:
+//
+//      queue       reserve an RX-sized slot, copy the raw buffer in (standing in for the DMA) and commit it
+//      validate    find the SFD, realign and check the FCS - pkt_validate_split(), or pkt_progress_xxx() in
+//                  cut-through sized chunks (-m progress)
+//      consume     hand the slots back
+//
+// The raw buffers are generated up front (a pool of up to RX_REPLAY_POOL distinct frames, which is cycled through),
+// so the generator's own cost isn't counted.
+//
+
+#define RX_REPLAY_POOL                  ( 4096 )
+#define RX_REPLAY_CHUNK_BYTES           ( 256 )             // progress mode - as the driver's RX_CT_CHUNK_BYTES
+#define RX_REPLAY_MTU                   ( 1500 )
+#define RX_RESERVE_BYTES                ( ( RX_REPLAY_MTU + 52 ) & (~3) )
+
+#define STAGE_QUEUE                     ( 0 )
+#define STAGE_VALIDATE                  ( 1 )
+#define STAGE_CONSUME                   ( 2 )
+#define STAGES                          ( 3 )
+
+typedef struct
+{
+    uint8_t*    raw;
+    int         raw_len;
+    uint8_t*    frame;                                      // what should come out (padded to 60 bytes)
+    int         frame_len;
+    int         corruption;                                 // PKT_GEN_CORRUPT_xxx
+} rx_replay_entry;
+
+static const char*  g_stage_names[ STAGES ] = { "queue", "validate", "consume" };
+static const char*  g_corrupt_names[ PKT_GEN_CORRUPT_TYPES ] = { "none", "bitflip", "burst", "truncate", "preamble" };
+
+static rx_replay_entry  g_pool[ RX_REPLAY_POOL ];
+static int              g_pool_size;
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return( (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+static void usage( void )
+{
+    printf( "usage: rmiieth_rx_replay [options]\n"
+            "  -n frames       frames to replay (default 1000000)\n"
+            "  -s profile      imix | fixed:LEN | uniform:MIN-MAX (frame lengths without FCS, default imix)\n"
+            "  -p file         take the frames from a pcap/pcapng file instead\n"
+            "  -l pct          offered load, as a %% of 100Mbit line rate - sets the time budget per frame (default 100)\n"
+            "  -c pct          %% of frames to corrupt (default 0)\n"
+            "  -t types        corruptions to use - any of b(itflip), u (burst), t(runcate), p(reamble) (default all)\n"
+            "  -q bytes        RX queue size (default 8192)\n"
+            "  -x              split RX - frames wrap around the end of the queue\n"
+            "  -m mode         validate | progress (default validate)\n"
+            "  -o file         also write the raw buffers to a file\n"
+            "  -r seed         generator seed\n" );
+    exit( 1 );
+}
+
+static void pool_add( pkt_gen* pg, const uint8_t* frame, int length )
+{
+    rx_replay_entry*    e = &g_pool[ g_pool_size ];
+    e->raw = (uint8_t*)malloc( PKT_GEN_RAW_BYTES( length ) );
+    e->raw_len = pkt_gen_encode( pg, frame, length, e->raw, PKT_GEN_RAW_BYTES( length ), &e->corruption );
+    if( !e->raw_len || e->raw_len > RX_RESERVE_BYTES )
+    {
+        free( e->raw );
+        return;
+    }
+    e->frame_len = ( length < 60 ) ? 60 : length;
+    e->frame = (uint8_t*)calloc( 1, e->frame_len );
+    memcpy( e->frame, frame, length );
+    g_pool_size++;
+}
+
+// raw buffer file: for each frame, its raw length, the expected frame length (-1 if corrupted), then the raw bytes
+static void pool_write( const char* path )
+{
+    FILE*   f = fopen( path, "wb" );
+    if( !f )
+    {
+        printf( "can't write %s\n", path );
+        exit( 1 );
+    }
+    for( int i = 0 ; i < g_pool_size ; i++ )
+    {
+        int32_t     hdr[ 2 ] = { g_pool[ i ].raw_len, g_pool[ i ].corruption ? -1 : g_pool[ i ].frame_len };
+        fwrite( hdr, sizeof( hdr ), 1, f );
+        fwrite( g_pool[ i ].raw, 1, g_pool[ i ].raw_len, f );
+    }
+    fclose( f );
+}
+
+// copy a raw buffer into a reservation, across the end of the queue if it wraps - as the (split) RX DMA would
+static void queue_copy( pkt_queue* pq, pkt_queue_pkt* pkt, const uint8_t* raw, int raw_len )
+{
+    int32_t     contig = pkt_queue_pkt_contig_bytes( pq, pkt );
+    if( contig >= raw_len )
+    {
+        memcpy( pkt->data, raw, raw_len );
+    }
+    else
+    {
+        memcpy( pkt->data, raw, contig );
+        memcpy( pq->data, raw + contig, raw_len - contig );
+    }
+}
+
+static bool frame_matches( pkt_queue* pq, pkt_queue_pkt* pkt, int split, const rx_replay_entry* e, int length )
+{
+    if( length != e->frame_len )
+    {
+        return( false );
+    }
+    if( split >= length )
+    {
+        return( memcmp( pkt->data, e->frame, length ) == 0 );
+    }
+    return( memcmp( pkt->data, e->frame, split ) == 0 && memcmp( pq->data, &e->frame[ split ], length - split ) == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    uint32_t    frames = 1000000;
+    const char* profile = "imix";
+    const char* pcap = NULL;
+    const char* out = NULL;
+    int         load_pct = 100;
+    int         corrupt_pct = 0;
+    const char* corrupt_types = "butp";
+    int         queue_size = 8192;
+    bool        split = false;
+    bool        progress = false;
+    uint32_t    seed = 1;
+
+    for( int i = 1 ; i < argc ; i++ )
+    {
+        const char* a = argv[ i ];
+        if( !strcmp( a, "-x" ) )
+        {
+            split = true;
+            continue;
+        }
+        if( i + 1 >= argc || a[ 0 ] != '-' )
+        {
+            usage();
+        }
+        const char* v = argv[ ++i ];
+        switch( a[ 1 ] )
+        {
+            case 'n':   frames = strtoul( v, NULL, 0 );     break;
+            case 's':   profile = v;                        break;
+            case 'p':   pcap = v;                           break;
+            case 'l':   load_pct = atoi( v );               break;
+            case 'c':   corrupt_pct = atoi( v );            break;
+            case 't':   corrupt_types = v;                  break;
+            case 'q':   queue_size = atoi( v );             break;
+            case 'm':   progress = !strcmp( v, "progress" ); break;
+            case 'o':   out = v;                            break;
+            case 'r':   seed = strtoul( v, NULL, 0 );       break;
+            default:    usage();
+        }
+    }
+    if( load_pct <= 0 || queue_size < RX_RESERVE_BYTES + 16 )
+    {
+        usage();
+    }
+
+    //
+    // generate the pool of raw buffers
+    //
+
+    pkt_gen     pg;
+    pkt_gen_init( &pg, seed );
+    pg.corrupt_pct = corrupt_pct;
+    pg.corrupt_types = 0;
+    pg.corrupt_types |= strchr( corrupt_types, 'b' ) ? ( 1 << PKT_GEN_CORRUPT_BITFLIP ) : 0;
+    pg.corrupt_types |= strchr( corrupt_types, 'u' ) ? ( 1 << PKT_GEN_CORRUPT_BURST ) : 0;
+    pg.corrupt_types |= strchr( corrupt_types, 't' ) ? ( 1 << PKT_GEN_CORRUPT_TRUNCATE ) : 0;
+    pg.corrupt_types |= strchr( corrupt_types, 'p' ) ? ( 1 << PKT_GEN_CORRUPT_PREAMBLE ) : 0;
+
+    uint8_t     frame[ PKT_GEN_MAX_FRAME ];
+    if( pcap )
+    {
+        rmiieth_host_pcap_reader    rd;
+        int                         length;
+        if( !rmiieth_host_pcap_reader_open( &rd, pcap ) )
+        {
+            printf( "can't read %s\n", pcap );
+            return( 1 );
+        }
+        while( g_pool_size < RX_REPLAY_POOL && ( length = rmiieth_host_pcap_read( &rd, frame, RX_REPLAY_MTU + 14 ) ) >= 0 )
+        {
+            if( length >= 14 )
+            {
+                pool_add( &pg, frame, length );
+            }
+        }
+        rmiieth_host_pcap_reader_close( &rd );
+        profile = pcap;
+    }
+    else
+    {
+        static const uint8_t    dest[ 6 ] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 };
+        if( !strcmp( profile, "imix" ) )
+        {
+            pg.size_profile = PKT_GEN_SIZE_IMIX;
+        }
+        else if( sscanf( profile, "fixed:%d", &pg.size_min ) == 1 )
+        {
+            pg.size_profile = PKT_GEN_SIZE_FIXED;
+        }
+        else if( sscanf( profile, "uniform:%d-%d", &pg.size_min, &pg.size_max ) == 2 && pg.size_min <= pg.size_max )
+        {
+            pg.size_profile = PKT_GEN_SIZE_UNIFORM;
+        }
+        else
+        {
+            usage();
+        }
+        if( pg.size_min < 14 || pg.size_max > RX_REPLAY_MTU + 14 )
+        {
+            usage();
+        }
+        for( int i = 0 ; i < RX_REPLAY_POOL ; i++ )
+        {
+            int     length = pkt_gen_frame_length( &pg );
+            pkt_gen_build_frame( &pg, frame, length, dest );
+            pool_add( &pg, frame, length );
+        }
+    }
+    if( !g_pool_size )
+    {
+        printf( "no frames\n" );
+        return( 1 );
+    }
+    if( out )
+    {
+        pool_write( out );
+    }
+
+    // wire time of the pool's frames at 100Mbit - preamble, FCS and inter-frame gap included
+    uint64_t    wire_bits = 0;
+    for( int i = 0 ; i < g_pool_size ; i++ )
+    {
+        wire_bits += ( 8 + g_pool[ i ].frame_len + 4 + 12 ) * 8;
+    }
+    double      line_fps = 100e6 / ( (double)wire_bits / g_pool_size );
+    double      offered_fps = line_fps * load_pct / 100;
+
+    //
+    // replay
+    //
+
+    pkt_queue   pq;
+    pkt_queue_init( &pq, (uint8_t*)malloc( queue_size ), queue_size );
+    pkt_queue_set_split( &pq, split );
+
+    uint64_t    stage_ns[ STAGES ] = { 0 };
+    uint32_t    good = 0;
+    uint32_t    false_rejects = 0;
+    uint32_t    mismatched = 0;
+    uint32_t    corrupted[ PKT_GEN_CORRUPT_TYPES ] = { 0 };
+    uint32_t    detected[ PKT_GEN_CORRUPT_TYPES ] = { 0 };
+    uint64_t    frame_bytes = 0;
+    uint32_t    done = 0;
+    int         next = 0;
+
+    static pkt_queue_pkt*   batch[ RX_REPLAY_POOL ];
+    static int              batch_entry[ RX_REPLAY_POOL ];
+
+    while( done < frames )
+    {
+        int         ct = 0;
+        uint64_t    t0 = now_ns();
+        while( done + ct < frames && ct < RX_REPLAY_POOL )
+        {
+            rx_replay_entry*    e = &g_pool[ next ];
+            pkt_queue_pkt*      pkt = pkt_queue_reserve_pkt( &pq, RX_RESERVE_BYTES );
+            if( !pkt )
+            {
+                break;
+            }
+            queue_copy( &pq, pkt, e->raw, e->raw_len );
+            pkt_queue_commit_pkt( &pq, pkt, e->raw_len );
+            batch[ ct ] = pkt;
+            batch_entry[ ct ] = next;
+            ct++;
+            next = ( next + 1 ) % g_pool_size;
+        }
+        uint64_t    t1 = now_ns();
+        stage_ns[ STAGE_QUEUE ] += t1 - t0;
+
+        // validation is timed frame by frame, so that checking the results doesn't count
+        for( int i = 0 ; i < ct ; i++ )
+        {
+            pkt_queue_pkt*      pkt = batch[ i ];
+            rx_replay_entry*    e = &g_pool[ batch_entry[ i ] ];
+            int32_t             contig = pkt_queue_pkt_contig_bytes( &pq, pkt );
+            int                 wrap_at = ( contig < pkt->hdr.data_bytes ) ? contig : pkt->hdr.data_bytes;
+            uint8_t*            wrap = ( contig < pkt->hdr.data_bytes ) ? pq.data : NULL;
+            int                 length = pkt->hdr.data_bytes;
+            bool                ok;
+
+            uint64_t    v0 = now_ns();
+            if( progress )
+            {
+                pkt_progress    pp;
+                pkt_progress_init( &pp );
+                for( int avail = RX_REPLAY_CHUNK_BYTES ; avail < length ; avail += RX_REPLAY_CHUNK_BYTES )
+                {
+                    pkt_progress_feed( &pp, pkt->data, wrap_at, wrap, avail );
+                }
+                ok = pkt_progress_finish( &pp, pkt->data, wrap_at, wrap, &length );
+            }
+            else
+            {
+                ok = pkt_validate_split( pkt->data, wrap_at, wrap, &length );
+            }
+            stage_ns[ STAGE_VALIDATE ] += now_ns() - v0;
+
+            if( e->corruption == PKT_GEN_CORRUPT_NONE )
+            {
+                if( !ok )
+                {
+                    false_rejects++;
+                }
+                else if( !frame_matches( &pq, pkt, wrap_at, e, length ) )
+                {
+                    mismatched++;
+                }
+                else
+                {
+                    good++;
+                    frame_bytes += length;
+                }
+            }
+            else
+            {
+                corrupted[ e->corruption ]++;
+                detected[ e->corruption ] += !ok;
+            }
+        }
+
+        uint64_t    t2 = now_ns();
+        pkt_queue_consume_pkts( &pq, ct );
+        stage_ns[ STAGE_CONSUME ] += now_ns() - t2;
+        done += ct;
+    }
+
+    //
+    // report
+    //
+
+    uint64_t    total_ns = stage_ns[ STAGE_QUEUE ] + stage_ns[ STAGE_VALIDATE ] + stage_ns[ STAGE_CONSUME ];
+    double      fps = done / ( total_ns / 1e9 );
+
+    printf( "%s, %u frames (%d distinct), %s RX queue of %d bytes, %s\n", profile, done, g_pool_size,
+            split ? "split" : "ring", queue_size, progress ? "progress (cut-through)" : "pkt_validate_split" );
+    printf( "\n  stage         ns/frame\n" );
+    for( int i = 0 ; i < STAGES ; i++ )
+    {
+        printf( "  %-12s %9.1f\n", g_stage_names[ i ], (double)stage_ns[ i ] / done );
+    }
+    printf( "  %-12s %9.1f\n\n", "total", (double)total_ns / done );
+    printf( "%.0f frames/s, %.1f Mbit/s of good frame data\n", fps, frame_bytes * 8 / ( total_ns / 1e3 ) );
+    printf( "offered load %d%% of 100Mbit = %.0f frames/s (%.2fus per frame) - %.1fx headroom on this host\n",
+            load_pct, offered_fps, 1e6 / offered_fps, fps / offered_fps );
+
+    printf( "\ngood frames: %u accepted, %u rejected, %u accepted with the wrong length or contents\n", good, false_rejects, mismatched );
+    for( int i = 1 ; i < PKT_GEN_CORRUPT_TYPES ; i++ )
+    {
+        if( corrupted[ i ] )
+        {
+            printf( "%-9s %8u corrupted, %8u detected (%.4f%%)\n", g_corrupt_names[ i ], corrupted[ i ], detected[ i ],
+                    100.0 * detected[ i ] / corrupted[ i ] );
+        }
+    }
+    return( ( false_rejects || mismatched ) ? 1 : 0 );
+}
@@ -0,0 +1,79 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+//
+// rmiieth_tests - the self-tests, on the host
+//
+//      rmiieth_tests                       run them all
+//      rmiieth_tests pkt_checksum_test     ... or just the ones named
+//
+// Each test prints its own results, and returns its # of failures. The exit status is 1 if any of them failed, so
+// ctest runs each one as a test of its own (see host/CMakeLists.txt).
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "pkt_gen.h"
+#include "pkt_queue.h"
+#include "rmiieth_host.h"
+#include "pkt_utils.h"
+
+typedef struct
+{
+    const char*     name;
+    int             (*fn)( void );
+} rmiieth_test;
+
+static const rmiieth_test g_tests[] = {
+    { "pkt_checksum_test",          pkt_checksum_test },
+    { "pkt_progress_test",          pkt_progress_test },
+    { "pkt_gen_test",               pkt_gen_test },
+    { "pkt_queue_split_test",       pkt_queue_split_test },
+    { "pkt_queue_rebase_test",      pkt_queue_rebase_test },
+    { "rmiieth_rx_ctrl_test",       rmiieth_rx_ctrl_test },
+    { "rmiieth_rx_ct_ctrl_test",    rmiieth_rx_ct_ctrl_test },
+    { "rmiieth_rx_storm_test",      rmiieth_rx_storm_test },
+    { "rmiieth_capture_test",       rmiieth_capture_test },
+    { "rmiieth_responder_test",     rmiieth_responder_test },
+};
+
+#define NUM_TESTS                       ( (int)( sizeof( g_tests ) / sizeof( g_tests[ 0 ] ) ) )
+
+static bool run_test( const rmiieth_test* t )
+{
+    printf( "\n=== %s\n", t->name );
+    int     failures = t->fn();
+    printf( "=== %s: %s\n", t->name, failures ? "FAILED" : "passed" );
+    return( failures == 0 );
+}
+
+int main( int argc, char** argv )
+{
+    bool    ok = true;
+
+    if( argc < 2 )
+    {
+        for( int i = 0 ; i < NUM_TESTS ; i++ )
+        {
+            ok &= run_test( &g_tests[ i ] );
+        }
+        return( ok ? 0 : 1 );
+    }
+
+    for( int a = 1 ; a < argc ; a++ )
+    {
+        int     i = 0;
+        while( i < NUM_TESTS && strcmp( g_tests[ i ].name, argv[ a ] ) != 0 )
+        {
+            i++;
+        }
+        if( i == NUM_TESTS )
+        {
+            fprintf( stderr, "no test called %s\n", argv[ a ] );
+            return( 2 );
+        }
+        ok &= run_test( &g_tests[ i ] );
+    }
+    return( ok ? 0 : 1 );
+}
@@ -39,18 +39,98 @@
 #define LWIP_NETCONN                    0
 #define LWIP_SOCKET                     0
 #define LWIP_DHCP                       1
+#define LWIP_IGMP                       1
 #define LWIP_ICMP                       1
 #define LWIP_UDP                        1
 #define LWIP_TCP                        1
 #define ETH_PAD_SIZE                    0
 #define LWIP_IP_ACCEPT_UDP_PORT(p)      ((p) == PP_NTOHS(67))
 
+/* RMIIETH_STATIC_BUFFERS and the static queue sizes */
+#include "rmiieth_opts.h"
+
+#if RMIIETH_STATIC_BUFFERS
+/* The static TX ring only holds one full-sized frame (see rmiieth_opts.h), and lwIP needs a send buffer of at least
+ * two segments - so the segments have to be smaller */
+#define TCP_MSS                         536
+#else
 #define TCP_MSS                         (1500 /*mtu*/ - 20 /*iphdr*/ - 20 /*tcphhr*/)
+#endif
+
+/* A full-sized TCP segment's footprint in a queue - the queue's packet header (12 bytes at most, see
+ * PKT_QUEUE_TIMESTAMPS), TX counters, preamble, frame and FCS */
+#define RMIIETH_LWIP_QUEUE_SEGMENT      (12 + 8 + 8 + 14 + 20 + 20 + TCP_MSS + 4)
+
+/* Options profile (see RMIIETH_LWIP_PROFILE in CMakeLists.txt, e.g. lwipopts_throughput.h) - anything it defines
+ * takes precedence over the defaults below */
+#ifdef RMIIETH_LWIP_PROFILE
+#include RMIIETH_LWIP_PROFILE
+#endif
+
+#ifndef TCP_SND_BUF
 #define TCP_SND_BUF                     (2 * TCP_MSS)
+#endif
+
+/* The driver's RX and TX queue sizes, which main.c (and host/host_main.c) configure rmiieth with - the TCP options
+ * are sized against these. With RMIIETH_STATIC_BUFFERS, the queues are the static ones, whatever size is asked for -
+ * so the sizes default to those, and larger ones (from a profile, say) are refused, rather than TCP being sized
+ * against queues that aren't there */
+#if RMIIETH_STATIC_BUFFERS
+#ifndef RMIIETH_LWIP_RX_QUEUE_SIZE
+#define RMIIETH_LWIP_RX_QUEUE_SIZE      RMIIETH_STATIC_RX_SIZE
+#endif
+#ifndef RMIIETH_LWIP_TX_QUEUE_SIZE
+#define RMIIETH_LWIP_TX_QUEUE_SIZE      RMIIETH_STATIC_TX_SIZE
+#endif
+#if RMIIETH_LWIP_RX_QUEUE_SIZE > RMIIETH_STATIC_RX_SIZE
+#error "RMIIETH_LWIP_RX_QUEUE_SIZE is larger than the static RX ring - see RMIIETH_STATIC_RX_SIZE in rmiieth_opts.h"
+#endif
+#if RMIIETH_LWIP_TX_QUEUE_SIZE > RMIIETH_STATIC_TX_SIZE
+#error "RMIIETH_LWIP_TX_QUEUE_SIZE is larger than the static TX ring - see RMIIETH_STATIC_TX_SIZE in rmiieth_opts.h"
+#endif
+#endif
+
+#ifndef RMIIETH_LWIP_RX_QUEUE_SIZE
+#define RMIIETH_LWIP_RX_QUEUE_SIZE      8192
+#endif
+#ifndef RMIIETH_LWIP_TX_QUEUE_SIZE
+#define RMIIETH_LWIP_TX_QUEUE_SIZE      8192
+#endif
+
+/* lwIP can send a whole TCP_SND_BUF of segments in one go, and the glue drops any frame the TX queue has no room for
+ * (which TCP then has to retransmit) - so a full send buffer must fit */
+#if (TCP_SND_BUF / TCP_MSS) * RMIIETH_LWIP_QUEUE_SEGMENT > RMIIETH_LWIP_TX_QUEUE_SIZE
+#error "TCP_SND_BUF doesn't fit in RMIIETH_LWIP_TX_QUEUE_SIZE"
+#endif
 
 #define ETHARP_SUPPORT_STATIC_ENTRIES   1
 
+/* The rmiieth glue computes and checks IP/UDP/TCP checksums while copying frames in and out of the packet queues */
+#ifndef RMIIETH_CHECKSUM_OFFLOAD
+#define RMIIETH_CHECKSUM_OFFLOAD        1
+#endif
+
+#if RMIIETH_CHECKSUM_OFFLOAD
+#define CHECKSUM_GEN_IP                 0
+#define CHECKSUM_GEN_UDP                0
+#define CHECKSUM_GEN_TCP                0
+#define CHECKSUM_CHECK_IP               0
+#define CHECKSUM_CHECK_UDP              0
+#define CHECKSUM_CHECK_TCP              0
+#endif
+
+/* Prebuilt content (RMIIETH_HTTPD_FSDATA - see rmiieth_makefsdata.py) has its HTTP headers built in, gzipped bodies
+ * and precalculated checksums, and is sent straight from flash: with no SSI and no dynamic file reads, httpd passes
+ * the const data to tcp_write() by reference rather than copying it */
+#if RMIIETH_HTTPD_FSDATA
+#define HTTPD_FSDATA_FILE               "rmiieth_fsdata.c"
+#define HTTPD_PRECALCULATED_CHECKSUM    1
+#define LWIP_HTTPD_DYNAMIC_HEADERS      0
+#define LWIP_HTTPD_DYNAMIC_FILE_READ    0
+#define LWIP_HTTPD_CUSTOM_FILES         0
+#else
 #define LWIP_HTTPD_DYNAMIC_HEADERS      1
+#endif
 #define LWIP_HTTPD_CGI                  0
 #define LWIP_HTTPD_SSI                  0
 #define LWIP_HTTPD_SSI_INCLUDE_TAG      0
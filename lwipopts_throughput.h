@@ -0,0 +1,57 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef __LWIPOPTS_THROUGHPUT_H__
+#define __LWIPOPTS_THROUGHPUT_H__
+
+/*
+ * lwipopts_throughput.h
+ *
+ * lwIP options profile for bulk TCP at 100Mbit (see RMIIETH_LWIP_PROFILE) - the rmiieth_lwiperf target uses it by
+ * default. Included by lwipopts.h once TCP_MSS is defined, so everything here can be in terms of it.
+ *
+ * At 100Mbit a full-sized frame takes ~123us on the wire, and a window's worth of segments can arrive (or need to
+ * leave) back to back, so everything is sized so that a whole window fits without anything being dropped:
+ *
+ *      driver RX queue     holds TCP_WND of segments, even if the main loop doesn't get to any of them
+ *      driver TX queue     holds TCP_SND_BUF of segments (checked in lwipopts.h)
+ *      PBUF_POOL           holds TCP_WND of segments (out of order, or not yet read), plus an RX batch in flight
+ *      MEM_SIZE            holds TCP_SND_BUF of copied segments, plus their headers and some slack
+ *
+ * With the defaults, about 90K of RAM goes on the queues, pool and heap.
+ */
+
+#define RMIIETH_LWIP_RX_QUEUE_SIZE      16384
+#define RMIIETH_LWIP_TX_QUEUE_SIZE      16384
+
+/* TCP windows - 8 segments each way. The RX queue needs a reservation's worth of contiguous space to start each
+ * frame, on top of the frames already queued */
+#define TCP_WND                         (8 * TCP_MSS)
+#define TCP_SND_BUF                     (8 * TCP_MSS)
+
+#if (TCP_WND / TCP_MSS + 1) * RMIIETH_LWIP_QUEUE_SEGMENT > RMIIETH_LWIP_RX_QUEUE_SIZE
+#error "TCP_WND doesn't fit in RMIIETH_LWIP_RX_QUEUE_SIZE"
+#endif
+
+/* Segment queues - unsent and unacked segments (allowing for writes smaller than a segment), plus those held out of
+ * order. lwiperf's client sends from a const buffer without copying, so each of its segments also needs a PBUF_ROM */
+#define TCP_SND_QUEUELEN                (4 * TCP_SND_BUF / TCP_MSS)
+#define MEMP_NUM_TCP_SEG                (TCP_SND_QUEUELEN + TCP_WND / TCP_MSS)
+#define MEMP_NUM_PBUF                   TCP_SND_QUEUELEN
+
+/* One pool pbuf per received frame (PBUF_POOL_BUFSIZE defaults to a full frame) - a window's worth, plus the glue's
+ * RX batch (RMIIETH_LWIP_RX_BATCH in rmiieth_netif.c), plus a few for whatever else arrives */
+#define PBUF_POOL_SIZE                  (TCP_WND / TCP_MSS + 8 + 4)
+
+/* The heap - segments that tcp_write() copied, and the headers of those it didn't */
+#define MEM_SIZE                        (TCP_SND_BUF + 8192)
+
+/* Allocate full-sized pbufs for copied writes, so that following small writes are appended to the same segment
+ * rather than chaining pbufs - fewer, larger frames, and a single pbuf for the glue to copy out of for each */
+#define TCP_OVERSIZE                    TCP_MSS
+
+/* No timestamp option - it costs 12 bytes of every segment, and the RTT estimate doesn't need it on a LAN */
+#define LWIP_TCP_TIMESTAMPS             0
+
+#endif /* __LWIPOPTS_THROUGHPUT_H__ */
@@ -4,6 +4,7 @@
 
 #include "rmiieth.h"
 #include "rmiieth_md.h"
+#include "rmiieth_netif.h"
 #include "pkt_utils.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
@@ -11,16 +12,12 @@
 #include "hardware/clocks.h"
 #include "hardware/structs/pll.h"
 #include "hardware/structs/clocks.h"
+#include "hardware/uart.h"
+#include "pico/multicore.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include "lwip/opt.h"
 #include "lwip/def.h"
-#include "lwip/mem.h"
-#include "lwip/pbuf.h"
-#include "lwip/stats.h"
-#include "lwip/snmp.h"
-#include "lwip/ethip6.h"
-#include "lwip/etharp.h"
 #include "lwip/dhcp.h"
 #include "lwip/init.h"
 #include "lwip/netif.h"
@@ -33,251 +30,123 @@
 #include "lwip/prot/dhcp.h"
 #include "lwip/timeouts.h"
 #include "lwip/apps/httpd.h"
+#include "lwip/apps/lwiperf.h"
 #include "pkt_utils.h"
 #include <string.h>
 
-#define IFNAME0 'b'
-#define IFNAME1 'b'
+// answer ARP requests and pings in the driver (see rmiieth_responder.h), rather than passing them to lwIP
+#ifndef RMIIETH_LWIP_FAST_RESPONDER
+#define RMIIETH_LWIP_FAST_RESPONDER     1
+#endif
 
 static uint8_t g_fake_mac[ 6 ] = {
     0xa4,0xdd,0x7b,0xb6,0xf2,0x1d
 };
 
+#if RMIIETH_LWIP_FAST_RESPONDER
+static rmiieth_responder g_responder;
+#endif
 
+// stream a pcapng capture of all RX and TX traffic out of a second UART (see rmiieth_capture.h) - the ring is
+// drained by core 1. The CMake option also sets PKT_QUEUE_TIMESTAMPS, so that RX frames carry the time they arrived
+#ifndef RMIIETH_LWIP_CAPTURE
+#define RMIIETH_LWIP_CAPTURE            0
+#endif
+#ifndef RMIIETH_LWIP_CAPTURE_UART
+#define RMIIETH_LWIP_CAPTURE_UART       uart1
+#endif
+#ifndef RMIIETH_LWIP_CAPTURE_TX_PIN
+#define RMIIETH_LWIP_CAPTURE_TX_PIN     4
+#endif
+#ifndef RMIIETH_LWIP_CAPTURE_BAUD
+#define RMIIETH_LWIP_CAPTURE_BAUD       3000000
+#endif
+#ifndef RMIIETH_LWIP_CAPTURE_SIZE
+#define RMIIETH_LWIP_CAPTURE_SIZE       16384
+#endif
 
-struct ethernetif {
-    rmiieth_config* rmiieth_cfg;
-};
-
-static void ethernetif_input(struct netif *netif);
-
-static void low_level_init(struct netif *netif)
-{
-    struct ethernetif *ethernetif = netif->state;
-    struct pbuf *q;
-    rmiieth_config* cfg = (rmiieth_config*)ethernetif->rmiieth_cfg;
-
-    netif->hwaddr_len = ETHARP_HWADDR_LEN;
-    for( int i = 0 ; i < 6 ; i++ )
-    {
-        netif->hwaddr[ i ] = g_fake_mac[ i ];
-    }
-    netif->mtu = cfg->mtu;
-    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
-}
-
-static err_t low_level_output(struct netif *netif, struct pbuf *p)
-{
-    struct ethernetif *ethernetif = netif->state;
-    struct pbuf *q;
-    rmiieth_config* cfg = (rmiieth_config*)ethernetif->rmiieth_cfg;
-
-#if ETH_PAD_SIZE
-    pbuf_remove_header(p, ETH_PAD_SIZE); /* drop the padding word */
+#if RMIIETH_LWIP_CAPTURE && !PKT_QUEUE_TIMESTAMPS
+#warning "RMIIETH_LWIP_CAPTURE without PKT_QUEUE_TIMESTAMPS - RX frames are stamped when they're captured, not when they arrived"
 #endif
 
-    //
-    // compute required size
-    //
+// prebuilt httpd content (RMIIETH_HTTPD_FSDATA) comes with the checksums of what httpd sends - see rmiieth_makefsdata.py
+#if RMIIETH_HTTPD_FSDATA
+extern const pkt_checksum_table rmiieth_fsdata_checksums[];
+extern const int rmiieth_fsdata_checksum_count;
+#endif
 
-    int cc_len = 0;
-    for( q = p; q != NULL; q = q->next )
-    {
-        cc_len += q->len;
-    }
-    cc_len += 8;      // preamble
-    cc_len += 4;
-    if( cc_len < 72 ) // min length = 8 + 60 + 4 = 72
-    {
-        cc_len = 72;
-    }
+// the rmiieth_lwiperf target (RMIIETH_LWIPERF=1) runs an iperf2 server on port 5001 instead of httpd - and, if
+// RMIIETH_LWIPERF_CLIENT_IP is set, a client that sends to "iperf -s" at that address for 10s at a time, over and
+// over, once we have an address
+#ifndef RMIIETH_LWIPERF
+#define RMIIETH_LWIPERF                 0
+#endif
+#ifndef RMIIETH_LWIPERF_CLIENT_IP
+#define RMIIETH_LWIPERF_CLIENT_IP       ""
+#endif
 
-    //
-    // allocate packet
-    //
+#if RMIIETH_LWIPERF
+static bool g_lwiperf_client_idle = true;
 
-    uint8_t*    tx_buffer;
-    int32_t     tx_len = 0;
+static void lwiperf_report( void* arg, enum lwiperf_report_type report_type, const ip_addr_t* local_addr, u16_t local_port,
+                            const ip_addr_t* remote_addr, u16_t remote_port, u32_t bytes_transferred, u32_t ms_duration,
+                            u32_t bandwidth_kbitpsec )
+{
+    rmiieth_config* cfg = (rmiieth_config*)arg;
+    char            tmp[ 32 ];
+    bool            client = ( report_type == LWIPERF_TCP_DONE_CLIENT ) || ( local_port != LWIPERF_TCP_PORT_DEFAULT );
 
-    if( !rmiieth_tx_alloc_packet( cfg, cc_len, &tx_buffer) )
-    {
-        return( ERR_OK );           /// ?
-    }
+    printf( "iperf %s %s: %u bytes in %ums - %u kbit/s%s\n", client ? "to" : "from",
+            remote_addr ? ipaddr_ntoa_r( remote_addr, tmp, sizeof( tmp ) ) : "?",
+            bytes_transferred, ms_duration, bandwidth_kbitpsec,
+            ( report_type == LWIPERF_TCP_DONE_SERVER || report_type == LWIPERF_TCP_DONE_CLIENT ) ? "" : " (aborted)" );
 
-    //
-    // construct TX packet, including preamble and fcs
-    //
+    // what the driver had to drop along the way
+    const rmiieth_tx_class_stats*   bulk = &cfg->tx_class_stats[ RMIIETH_TX_CLASS_BULK ];
+    printf( "  TX bulk: %u sent, %u dropped, %d bytes high water - RX: %u bulk dropped, %u PAUSE frames sent\n",
+            bulk->sent, bulk->dropped, bulk->high_water, cfg->rx_bulk_dropped, cfg->pause_frames_sent );
 
-    tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;
-    tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0xd5;
-    for( q = p; q != NULL; q = q->next )
-    {
-        memcpy( &tx_buffer[ tx_len ], q->payload, q->len );
-        tx_len += q->len;
-    }
-    while( tx_len < 8 + 64 - 4 )
+    if( client )
     {
-        tx_buffer[ tx_len++ ] = 0x00;
+        g_lwiperf_client_idle = true;
     }
-    uint32_t fcs = pkt_generate_fcs( &tx_buffer[ 8 ], tx_len - 8 );
-    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >>  0 );
-    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >>  8 );
-    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >> 16 );
-    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >> 24 );
-
-    assert( cc_len == tx_len );
-
-    rmiieth_tx_commit_packet( cfg, tx_len );
-
-    MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
-    if (((u8_t *)p->payload)[0] & 1) {
-        /* broadcast or multicast packet*/
-        MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
-    } else {
-        /* unicast packet */
-        MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
-    }
-    /* increase ifoutdiscards or ifouterrors on error */
-
-#if ETH_PAD_SIZE
-    pbuf_add_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
-#endif
-
-    LINK_STATS_INC(link.xmit);
-
-    return ERR_OK;
 }
+#endif
 
+#if RMIIETH_LWIP_CAPTURE
+static rmiieth_capture g_capture;
+static uint8_t g_capture_buffer[ RMIIETH_LWIP_CAPTURE_SIZE ];
 
-
-static struct pbuf *low_level_input(struct netif *netif)
+// never blocks - whatever doesn't fit in the UART FIFO is left in the ring for next time
+static int capture_uart_sink( void* ctx, const uint8_t* data, int length )
 {
-    struct ethernetif *ethernetif = netif->state;
-    rmiieth_config* cfg = ethernetif->rmiieth_cfg;
-    struct pbuf *p = NULL;
-    struct pbuf *q;
-    uint8_t*    pkt;
-    int         pkt_len;
-
-    if( !rmiieth_rx_get_packet( cfg, &pkt, &pkt_len ) )
+    uart_inst_t*    uart = (uart_inst_t*)ctx;
+    int             sent = 0;
+    while( sent < length && uart_is_writable( uart ) )
     {
-        return( NULL );
+        uart_putc_raw( uart, data[ sent++ ] );
     }
-
-    if( !pkt_validate( pkt, &pkt_len ) )
-    {
-        LINK_STATS_INC(link.drop);
-        MIB2_STATS_NETIF_INC(netif, ifindiscards);
-        rmiieth_rx_consume_packet( cfg );
-        return( NULL );
-    }
-
-    p = pbuf_alloc(PBUF_RAW, pkt_len, PBUF_POOL);
-    if( !p )
-    {
-        rmiieth_rx_consume_packet( cfg );
-        return( NULL );
-    }
-
-    // we're good
-    int pos = 0;
-    for( q = p; q != NULL; q = q->next )
-    {
-        memcpy( q->payload, &pkt[ pos ], q->len );
-        pos += q->len;
-    }
-
-    MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
-    if (((u8_t *)p->payload)[0] & 1) {
-        MIB2_STATS_NETIF_INC(netif, ifinnucastpkts);
-    } else {
-        MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
-    }
-    LINK_STATS_INC(link.recv);
-    rmiieth_rx_consume_packet( cfg );
-    return p;
+    return( sent );
 }
 
-static void ethernetif_input(struct netif *netif)
+static void capture_core1_main( void )
 {
-  struct ethernetif *ethernetif;
-  struct eth_hdr *ethhdr;
-  struct pbuf *p;
-
-  ethernetif = netif->state;
-
-  p = low_level_input(netif);
-  if (p != NULL) {
-    if (netif->input(p, netif) != ERR_OK) {
-      LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
-      pbuf_free(p);
-      p = NULL;
+    while( true )
+    {
+        rmiieth_capture_drain( &g_capture );
+        tight_loop_contents();
     }
-  }
 }
 
-
-err_t ethernetif_init(struct netif *netif)
+static void capture_start( void )
 {
-  struct ethernetif *ethernetif;
-
-  LWIP_ASSERT("netif != NULL", (netif != NULL));
-
-#if LWIP_NETIF_HOSTNAME
-  /* Initialize interface hostname */
-  netif->hostname = "lwip";
-#endif /* LWIP_NETIF_HOSTNAME */
-
-  /*
-   * Initialize the snmp variables and counters inside the struct netif.
-   * The last argument should be replaced with your link speed, in units
-   * of bits per second.
-   */
-  MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
-
-  netif->name[0] = IFNAME0;
-  netif->name[1] = IFNAME1;
-  /* We directly use etharp_output() here to sethernetifave a function call.
-   * You can instead declare your own function an call etharp_output()
-   * from it if you have to do some checks before sending (e.g. if link
-   * is available...) */
-#if LWIP_IPV4
-  netif->output = etharp_output;
-#endif /* LWIP_IPV4 */
-#if LWIP_IPV6
-  netif->output_ip6 = ethip6_output;
-#endif /* LWIP_IPV6 */
-  netif->linkoutput = low_level_output;
-
-//  ethernetif->ethaddr = (struct eth_addr *) & (netif->hwaddr[0]);
-
-  /* initialize the hardware */
-  low_level_init(netif);
-
-  return ERR_OK;
+    uart_init( RMIIETH_LWIP_CAPTURE_UART, RMIIETH_LWIP_CAPTURE_BAUD );
+    gpio_set_function( RMIIETH_LWIP_CAPTURE_TX_PIN, GPIO_FUNC_UART );
+    rmiieth_capture_init( &g_capture, g_capture_buffer, sizeof( g_capture_buffer ), capture_uart_sink, RMIIETH_LWIP_CAPTURE_UART );
+    g_capture.tx_enabled = true;
+    multicore_launch_core1( capture_core1_main );
 }
-
-
-//
-//
-//
-//
-//
-
-
-
-void rmiieth_lwip_poll( struct netif* netif )
-{
-    struct ethernetif* ethernetif = netif->state;
-    rmiieth_config* cfg = ethernetif->rmiieth_cfg;
-
-    rmiieth_poll( cfg );
-    while( rmiieth_rx_packet_available( cfg ) )
-    {
-        ethernetif_input( netif );
-    }
-}
-
+#endif
 
 
 void main_lwip( rmiieth_config* cfg )
@@ -290,9 +159,19 @@ void main_lwip( rmiieth_config* cfg )
 
     lwip_init();
 
-
     memset( &rmiieth_ethernetif, 0, sizeof( rmiieth_ethernetif ) );
     rmiieth_ethernetif.rmiieth_cfg = cfg;
+#if RMIIETH_LWIP_FAST_RESPONDER
+    rmiieth_responder_init( &g_responder, cfg );
+    rmiieth_ethernetif.responder = &g_responder;
+#endif
+#if RMIIETH_LWIP_CAPTURE
+    rmiieth_ethernetif.capture = &g_capture;
+#endif
+#if RMIIETH_HTTPD_FSDATA
+    rmiieth_ethernetif.csum_tables = rmiieth_fsdata_checksums;
+    rmiieth_ethernetif.csum_table_count = rmiieth_fsdata_checksum_count;
+#endif
     rmiieth_netif.state = &rmiieth_ethernetif;
     nif = netif_add_noaddr( &rmiieth_netif, &rmiieth_ethernetif, ethernetif_init, ethernet_input );
 
@@ -301,13 +180,29 @@ void main_lwip( rmiieth_config* cfg )
     netif_set_link_up( &rmiieth_netif );
     rc = dhcp_start( &rmiieth_netif );
 
+#if RMIIETH_LWIPERF
+    lwiperf_start_tcp_server_default( lwiperf_report, cfg );
+#else
     httpd_init();
+#endif
 
     while( true )
     {
-        sleep_us( 1 );
         sys_check_timeouts();
-        rmiieth_lwip_poll( nif );
+        bool busy = rmiieth_lwip_poll( nif );
+
+#if RMIIETH_LWIPERF
+        // (re)start the client, whenever the last run has finished
+        if( RMIIETH_LWIPERF_CLIENT_IP[ 0 ] && g_lwiperf_client_idle && dhcp_supplied_address( nif ) )
+        {
+            ip_addr_t   server;
+            if( ipaddr_aton( RMIIETH_LWIPERF_CLIENT_IP, &server ) &&
+                lwiperf_start_tcp_client_default( &server, lwiperf_report, cfg ) )
+            {
+                g_lwiperf_client_idle = false;
+            }
+        }
+#endif
 
         // show link status periodically
         if( false )
@@ -326,6 +221,10 @@ void main_lwip( rmiieth_config* cfg )
         {
             printf( "DHCP State goes from %d to %d\n", prevDHCPState, dd->state );
             prevDHCPState = dd->state;
+#if RMIIETH_LWIP_FAST_RESPONDER
+            // only answer for an address that we actually hold
+            rmiieth_responder_set_ip( &g_responder, ( dd->state == DHCP_STATE_BOUND ) ? lwip_ntohl( ip4_addr_get_u32( netif_ip4_addr( nif ) ) ) : 0 );
+#endif
             if( dd->state == DHCP_STATE_BOUND )
             {
                 char    tmp[ 256 ];
@@ -336,15 +235,23 @@ void main_lwip( rmiieth_config* cfg )
             }
         }
 
+        // nothing more to do right now - sleep until there is
+        if( !busy )
+        {
+            rmiieth_lwip_wait( nif );
+        }
+
     }
 
 }
 
 
 
+// the driver state is touched by every interrupt - see RMIIETH_STATE_PLACEMENT in rmiieth_opts.h
+static rmiieth_config rmii_cfg RMIIETH_STATE_PLACEMENT;
+
 int main( int argc, char** argv )
 {
-    rmiieth_config     rmii_cfg;
 
     //
     // set system clock
@@ -359,6 +266,19 @@ int main( int argc, char** argv )
     //
 
     rmiieth_set_default_config( &rmii_cfg );
+    memcpy( rmii_cfg.mac_addr, g_fake_mac, 6 );
+    rmii_cfg.rx_queue_buffer_size = RMIIETH_LWIP_RX_QUEUE_SIZE;        // see lwipopts.h
+    rmii_cfg.tx_queue_buffer_size = RMIIETH_LWIP_TX_QUEUE_SIZE;
+    rmii_cfg.rx_promiscuous = false;
+    rmii_cfg.flow_control = true;
+    rmii_cfg.rx_ctrl_queue_size = 2048;
+    rmii_cfg.tx_ctrl_queue_size = 2048;
+    rmii_cfg.rx_storm_control = true;
+    rmii_cfg.rx_cut_through = true;
+#if RMIIETH_LWIP_CAPTURE
+    rmii_cfg.rx_promiscuous = true;             // capture everyone's traffic
+    capture_start();
+#endif
     rmiieth_init( &rmii_cfg );
     if( !rmiieth_probe( &rmii_cfg ) )
     {
@@ -373,10 +293,12 @@ int main( int argc, char** argv )
     //
 
     //  basic control:          0011 0011 0000 0000         enable auto-neg, restart auto-neg
-    //  autoneg-advert:         0000 0001 1000 0001         100Mbps, full duplex
+    //  autoneg-advert:         0000 0101 1000 0001         100Mbps, full duplex, PAUSE
 
     uint32_t basic_control = 0x3300;
-    rmiieth_md_writereg( &rmii_cfg, RMII_REG_AUTONEG_ADVERT, 0x181 );
+    rmiieth_md_writereg( &rmii_cfg, RMII_REG_AUTONEG_ADVERT,
+                         RMII_ADVERT_SELECTOR_802_3 | RMII_ADVERT_100_HALF_DUPLEX | RMII_ADVERT_100_FULL_DUPLEX |
+                         ( rmii_cfg.flow_control ? RMII_ADVERT_PAUSE : 0 ) );
     rmiieth_md_writereg( &rmii_cfg, RMII_REG_BASIC_CONTROL, basic_control );
     sleep_ms( 500 );
 
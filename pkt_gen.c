@@ -0,0 +1,258 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pkt_gen.h"
+#include "pkt_utils.h"
+
+#define PKT_GEN_FLUSH_DIBITS            ( 32 )              // eth_rx shifts in this many more dibits once CRS_DV drops
+
+static const uint8_t    g_pkt_gen_src[ 6 ] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+void pkt_gen_init( pkt_gen* pg, uint32_t seed )
+{
+    memset( pg, 0, sizeof( pkt_gen ) );
+    pg->rng = seed ? seed : 1;
+    pg->size_profile = PKT_GEN_SIZE_IMIX;
+    pg->size_min = 60;
+    pg->size_max = 1514;
+    pg->max_lead_dibits = 15;
+    pg->corrupt_pct = 0;
+    pg->corrupt_types = ( 1 << PKT_GEN_CORRUPT_BITFLIP ) | ( 1 << PKT_GEN_CORRUPT_BURST ) |
+                        ( 1 << PKT_GEN_CORRUPT_TRUNCATE ) | ( 1 << PKT_GEN_CORRUPT_PREAMBLE );
+}
+
+uint32_t pkt_gen_rand( pkt_gen* pg )
+{
+    pg->rng ^= pg->rng << 13;
+    pg->rng ^= pg->rng >> 17;
+    pg->rng ^= pg->rng << 5;
+    return( pg->rng );
+}
+
+int pkt_gen_frame_length( pkt_gen* pg )
+{
+    switch( pg->size_profile )
+    {
+        case PKT_GEN_SIZE_UNIFORM:
+            return( pg->size_min + pkt_gen_rand( pg ) % ( pg->size_max - pg->size_min + 1 ) );
+
+        case PKT_GEN_SIZE_IMIX:
+        {
+            uint32_t    r = pkt_gen_rand( pg ) % 12;
+            return( ( r < 7 ) ? 60 : ( r < 11 ) ? 590 : 1514 );
+        }
+
+        default:
+            return( pg->size_min );
+    }
+}
+
+// ethernet header (IEEE local experimental EtherType), a sequence number, then random bytes
+void pkt_gen_build_frame( pkt_gen* pg, uint8_t* frame, int length, const uint8_t* dest )
+{
+    memcpy( &frame[ 0 ], dest, 6 );
+    memcpy( &frame[ 6 ], g_pkt_gen_src, 6 );
+    frame[ 12 ] = 0x88;
+    frame[ 13 ] = 0xb5;
+    for( int i = 14 ; i < length ; i++ )
+    {
+        frame[ i ] = (uint8_t)pkt_gen_rand( pg );
+    }
+    if( length >= 18 )
+    {
+        frame[ 14 ] = (uint8_t)( pg->frames >> 24 );
+        frame[ 15 ] = (uint8_t)( pg->frames >> 16 );
+        frame[ 16 ] = (uint8_t)( pg->frames >>  8 );
+        frame[ 17 ] = (uint8_t)( pg->frames >>  0 );
+    }
+}
+
+static int pkt_gen_pick_corruption( pkt_gen* pg )
+{
+    if( !pg->corrupt_types || (int)( pkt_gen_rand( pg ) % 100 ) >= pg->corrupt_pct )
+    {
+        return( PKT_GEN_CORRUPT_NONE );
+    }
+    while( true )
+    {
+        int     type = 1 + pkt_gen_rand( pg ) % ( PKT_GEN_CORRUPT_TYPES - 1 );
+        if( pg->corrupt_types & ( 1 << type ) )
+        {
+            return( type );
+        }
+    }
+}
+
+// returns the # of raw bytes written (0 if they wouldn't fit in max_raw), and which corruption was applied
+int pkt_gen_encode( pkt_gen* pg, const uint8_t* frame, int length, uint8_t* raw, int max_raw, int* corruption )
+{
+    uint8_t     wire[ 8 + PKT_GEN_MAX_FRAME + 4 ];
+    int         frame_len = ( length < 60 ) ? 60 : length;
+    if( frame_len > PKT_GEN_MAX_FRAME )
+    {
+        return( 0 );
+    }
+
+    // preamble, SFD, frame, padding and FCS - as they go on the wire
+    memset( wire, 0x55, 7 );
+    wire[ 7 ] = 0xd5;
+    memcpy( &wire[ 8 ], frame, length );
+    memset( &wire[ 8 + length ], 0, frame_len - length );
+    uint32_t    fcs = pkt_generate_fcs( &wire[ 8 ], frame_len );
+    for( int i = 0 ; i < 4 ; i++ )
+    {
+        wire[ 8 + frame_len + i ] = (uint8_t)( fcs >> ( i * 8 ) );
+    }
+    int         wire_len = 8 + frame_len + 4;
+    int         wire_dibits = wire_len * 4;
+
+    int         type = pkt_gen_pick_corruption( pg );
+    switch( type )
+    {
+        case PKT_GEN_CORRUPT_BITFLIP:
+        {
+            int     bit = 64 + pkt_gen_rand( pg ) % ( ( frame_len + 4 ) * 8 );
+            wire[ bit >> 3 ] ^= 1 << ( bit & 7 );
+            break;
+        }
+        case PKT_GEN_CORRUPT_BURST:
+        {
+            int     burst = 1 + pkt_gen_rand( pg ) % 4;
+            int     pos = 8 + pkt_gen_rand( pg ) % ( frame_len - burst + 1 );
+            for( int i = 0 ; i < burst ; i++ )
+            {
+                wire[ pos + i ] ^= 1 + pkt_gen_rand( pg ) % 255;
+            }
+            break;
+        }
+        case PKT_GEN_CORRUPT_TRUNCATE:
+        {
+            // anywhere after the ethernet header, up to (but not including) the last dibit of the FCS
+            int     first = ( 8 + 14 ) * 4;
+            int     cut = first + pkt_gen_rand( pg ) % ( wire_dibits - first );
+
+            // if the dibits that are lost are all 00, what arrives is no different from the whole frame
+            bool    lost = false;
+            for( int d = cut ; d < wire_dibits && !lost ; d++ )
+            {
+                lost = ( wire[ d >> 2 ] >> ( ( d & 3 ) * 2 ) ) & 3;
+            }
+            if( lost )
+            {
+                wire_dibits = cut;
+            }
+            else
+            {
+                type = PKT_GEN_CORRUPT_NONE;
+            }
+            break;
+        }
+        case PKT_GEN_CORRUPT_PREAMBLE:
+        {
+            int     bit = 32 + pkt_gen_rand( pg ) % 32;
+            wire[ bit >> 3 ] ^= 1 << ( bit & 7 );
+            break;
+        }
+    }
+
+    // only whole words of the ISR are pushed to the DMA - the flush makes sure the frame itself always gets there
+    int         lead = ( pg->max_lead_dibits > 0 ) ? pkt_gen_rand( pg ) % ( pg->max_lead_dibits + 1 ) : 0;
+    int         raw_len = ( ( lead + wire_dibits + PKT_GEN_FLUSH_DIBITS ) / 16 ) * 4;
+    if( raw_len > max_raw )
+    {
+        return( 0 );
+    }
+
+    // the data is shifted in LSB first, so each dibit of delay moves the bitstream 2 bits up
+    int         shift = lead * 2;
+    int         byte_shift = shift >> 3;
+    int         bit_shift = shift & 7;
+    int         whole = wire_dibits >> 2;
+    memset( raw, 0, raw_len );
+    for( int i = 0 ; i <= whole && i < wire_len ; i++ )
+    {
+        uint8_t b = wire[ i ];
+        if( i == whole )
+        {
+            // a truncated frame's last, partial byte
+            b &= (uint8_t)( ( 1 << ( ( wire_dibits & 3 ) * 2 ) ) - 1 );
+        }
+        raw[ byte_shift + i ] |= (uint8_t)( b << bit_shift );
+        if( bit_shift )
+        {
+            raw[ byte_shift + i + 1 ] |= (uint8_t)( b >> ( 8 - bit_shift ) );
+        }
+    }
+
+    pg->frames++;
+    pg->corrupted[ type ]++;
+    if( corruption )
+    {
+        *corruption = type;
+    }
+    return( raw_len );
+}
+
+//
+// test - good frames must come back intact at every phase, and every corrupted one must be rejected
+//
+
+static uint8_t g_gen_test_raw[ PKT_GEN_RAW_BYTES( PKT_GEN_MAX_FRAME ) ];
+
+int pkt_gen_test( void )
+{
+    static const uint8_t    dest[ 6 ] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    pkt_gen     pg;
+    uint8_t     frame[ PKT_GEN_MAX_FRAME ];
+    int         failures = 0;
+    int         detected = 0;
+
+    pkt_gen_init( &pg, 1234 );
+    pg.size_profile = PKT_GEN_SIZE_UNIFORM;
+    pg.size_min = 14;
+    pg.size_max = 1514;
+    pg.corrupt_pct = 25;
+
+    for( int i = 0 ; i < 10000 ; i++ )
+    {
+        int     len = pkt_gen_frame_length( &pg );
+        int     corruption;
+        pkt_gen_build_frame( &pg, frame, len, dest );
+        int     raw_len = pkt_gen_encode( &pg, frame, len, g_gen_test_raw, sizeof( g_gen_test_raw ), &corruption );
+        if( !raw_len || ( raw_len & 3 ) || raw_len > PKT_GEN_RAW_BYTES( len ) )
+        {
+            failures++;
+            continue;
+        }
+
+        int     pkt_len = raw_len;
+        bool    ok = pkt_validate( g_gen_test_raw, &pkt_len );
+        if( corruption == PKT_GEN_CORRUPT_NONE )
+        {
+            if( !ok || pkt_len != ( len < 60 ? 60 : len ) || memcmp( g_gen_test_raw, frame, len ) != 0 )
+            {
+                if( failures++ < 10 )
+                {
+                    printf( "gen test: frame %d (%d bytes) not recovered\n", i, len );
+                }
+            }
+        }
+        else if( ok )
+        {
+            if( failures++ < 10 )
+            {
+                printf( "gen test: frame %d (%d bytes) - corruption %d not detected\n", i, len, corruption );
+            }
+        }
+        else
+        {
+            detected++;
+        }
+    }
+
+    printf( "gen test: %u frames, %d corrupted and detected, %d failures\n", pg.frames, detected, failures );
+    return( failures );
+}
@@ -0,0 +1,77 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef PKT_GEN_INCLUDED
+#define PKT_GEN_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * pkt_gen
+ *
+ * Synthetic RX traffic - encodes frames into raw buffers exactly as the eth_rx state machine and RX DMA capture them:
+ *
+ *  - a random number of idle (00) dibits, from CRS_DV rising, before the preamble - so the frame starts at any
+ *    dibit phase within the raw bytes
+ *  - preamble, SFD, frame (padded to 60 bytes) and FCS, LSB first
+ *  - the 32 dibits of idle that the state machine shifts in after CRS_DV drops, to flush the ISR - of which only
+ *    whole 32-bit words reach memory
+ *
+ * Optionally, some frames are corrupted on the way (see PKT_GEN_CORRUPT_xxx), so that error detection can be
+ * measured as well as speed. Frames can come from elsewhere (a capture file, say), or be made up according to a
+ * size profile:
+ *
+ *      pkt_gen_init( &pg, seed );
+ *      pg.size_profile = PKT_GEN_SIZE_IMIX;
+ *      pg.corrupt_pct = 10;
+ *
+ *      int     len = pkt_gen_frame_length( &pg );
+ *      pkt_gen_build_frame( &pg, frame, len, dest_mac );
+ *      int     raw_len = pkt_gen_encode( &pg, frame, len, raw, sizeof( raw ), &corruption );
+ *
+ * Everything is driven by the generator's own PRNG, so a given seed always produces the same traffic.
+ */
+
+// size profiles - frame lengths exclude the FCS
+#define PKT_GEN_SIZE_FIXED              ( 0 )               // always size_min
+#define PKT_GEN_SIZE_UNIFORM            ( 1 )               // uniform between size_min and size_max
+#define PKT_GEN_SIZE_IMIX               ( 2 )               // simple IMIX - 64, 594 and 1518 byte frames (with FCS), 7:4:1
+
+// corruption types
+#define PKT_GEN_CORRUPT_NONE            ( 0 )
+#define PKT_GEN_CORRUPT_BITFLIP         ( 1 )               // a single bit of the frame or FCS flipped
+#define PKT_GEN_CORRUPT_BURST           ( 2 )               // up to 4 consecutive bytes of the frame garbled
+#define PKT_GEN_CORRUPT_TRUNCATE        ( 3 )               // carrier lost part way through the frame
+#define PKT_GEN_CORRUPT_PREAMBLE        ( 4 )               // a bit flipped in the end of the preamble or the SFD
+#define PKT_GEN_CORRUPT_TYPES           ( 5 )
+
+#define PKT_GEN_MAX_FRAME               ( 1522 )            // longest frame (without FCS) - room for a VLAN tag
+
+// raw bytes needed for a frame of 'length' bytes, whatever its phase
+#define PKT_GEN_RAW_BYTES( length )     ( ( ( 15 + ( 8 + ( (length) < 60 ? 60 : (length) ) + 4 ) * 4 + 32 ) / 16 ) * 4 )
+
+typedef struct
+{
+    uint32_t    rng;                                        // xorshift32 state
+    int         size_profile;                               // PKT_GEN_SIZE_xxx
+    int         size_min;
+    int         size_max;
+    int         max_lead_dibits;                            // idle dibits before the preamble: 0 to this many (max 15)
+    int         corrupt_pct;                                // % of frames to corrupt
+    uint32_t    corrupt_types;                              // which corruptions to pick from - ( 1 << PKT_GEN_CORRUPT_xxx )
+    uint32_t    frames;                                     // # of frames encoded
+    uint32_t    corrupted[ PKT_GEN_CORRUPT_TYPES ];         // # of frames encoded, by corruption type
+} pkt_gen;
+
+
+void        pkt_gen_init( pkt_gen* pg, uint32_t seed );
+uint32_t    pkt_gen_rand( pkt_gen* pg );
+int         pkt_gen_frame_length( pkt_gen* pg );
+void        pkt_gen_build_frame( pkt_gen* pg, uint8_t* frame, int length, const uint8_t* dest );
+int         pkt_gen_encode( pkt_gen* pg, const uint8_t* frame, int length, uint8_t* raw, int max_raw, int* corruption );
+int         pkt_gen_test( void );
+
+
+#endif // #ifndef PKT_GEN_INCLUDED
@@ -3,9 +3,11 @@
  */
 
 #include "pkt_queue.h"
+#include "rmiieth_opts.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "pico.h"
 
 void pkt_queue_init( pkt_queue* pq, uint8_t* data, int32_t size )
@@ -14,6 +16,92 @@ void pkt_queue_init( pkt_queue* pq, uint8_t* data, int32_t size )
     pq->head = NULL;
     pq->tail = NULL;
     pq->size = size;
+    pq->split = false;
+}
+
+void pkt_queue_set_split( pkt_queue* pq, bool split )
+{
+    assert( !pq->tail );
+    assert( !( pq->size & 3 ) );
+    pq->split = split;
+}
+
+// # of data bytes before the packet wraps around the end of the buffer (only ever less than data_bytes in split mode)
+int32_t __time_critical_func( pkt_queue_pkt_contig_bytes )( pkt_queue* pq, pkt_queue_pkt* pkt )
+{
+    int32_t             contig = ( pq->data + pq->size ) - pkt->data;
+    return( contig < pkt->hdr.data_bytes ? contig : pkt->hdr.data_bytes );
+}
+
+// bytes occupied by packets (including reserved ones, headers and padding)
+int32_t __time_critical_func( pkt_queue_used_bytes )( pkt_queue* pq )
+{
+    if( !pq->tail )
+    {
+        return( 0 );
+    }
+    int32_t             rpos = ( (uint8_t*)pq->head ) - pq->data;
+    int32_t             wend = ( (uint8_t*)pq->tail ) - pq->data + pq->tail->hdr.mem_bytes;
+    return( ( wend > rpos ) ? ( wend - rpos ) : ( pq->size - rpos + wend ) );
+}
+
+bool pkt_queue_can_rebase( pkt_queue* pq, uint8_t* data, int32_t size )
+{
+    if( !pq->tail )
+    {
+        return( true );
+    }
+
+    // the packets must form one contiguous run - i.e. not wrap around the end of the current buffer...
+    uint8_t*            start = (uint8_t*)pq->head;
+    uint8_t*            end = ( (uint8_t*)pq->tail ) + pq->tail->hdr.mem_bytes;
+    if( start > (uint8_t*)pq->tail || end > pq->data + pq->size )
+    {
+        return( false );
+    }
+
+    // ... which lies within the new one
+    return( start >= data && end <= data + size );
+}
+
+void pkt_queue_rebase( pkt_queue* pq, uint8_t* data, int32_t size )
+{
+    assert( pkt_queue_can_rebase( pq, data, size ) );
+    assert( !( size & 3 ) );
+    pq->data = data;
+    pq->size = size;
+}
+
+static pkt_queue_pkt* __time_critical_func( pkt_queue_reserve_split )( pkt_queue* pq, int32_t max_size, int32_t required_bytes )
+{
+    pkt_queue_pkt*      pkt;
+    int32_t             rpos = ( (uint8_t*)pq->head ) - pq->data;
+    int32_t             wpos = ( (uint8_t*)pq->tail ) - pq->data;
+    wpos = ( wpos + pq->tail->hdr.mem_bytes ) % pq->size;
+
+    // the header (plus at least one word of data) must be contiguous - pad the tail packet if it isn't
+    if( rpos <= wpos && ( pq->size - wpos ) <= (int32_t)sizeof( pkt_queue_pkt_hdr ) )
+    {
+        if( rpos == 0 )
+        {
+            return( NULL );
+        }
+        pq->tail->hdr.mem_bytes += ( pq->size - wpos );
+        wpos = 0;
+    }
+
+    // keep at least one word free, so that a full queue can't look like an empty one
+    int32_t             free_bytes = ( rpos > wpos ) ? ( rpos - wpos ) : ( pq->size - wpos + rpos );
+    if( required_bytes >= free_bytes )
+    {
+        return( NULL );
+    }
+
+    pkt = (pkt_queue_pkt*)( &pq->data[ wpos ] );
+    pkt->hdr.mem_bytes = required_bytes;
+    pkt->hdr.data_bytes = max_size;
+    pq->tail = pkt;
+    return( pkt );
 }
 
 pkt_queue_pkt* __time_critical_func( pkt_queue_reserve_pkt )( pkt_queue* pq, int32_t max_size )
@@ -36,6 +124,17 @@ pkt_queue_pkt* __time_critical_func( pkt_queue_reserve_pkt )( pkt_queue* pq, int
         return( pkt );
     }
 
+    if( pq->split )
+    {
+        return( pkt_queue_reserve_split( pq, max_size, required_bytes ) );
+    }
+
+    // completely full? (the write position would otherwise alias the read position, and look like an empty buffer)
+    if( pkt_queue_used_bytes( pq ) == pq->size )
+    {
+        return( NULL );
+    }
+
     int32_t             rpos = ( (uint8_t*)pq->head ) - pq->data;
     int32_t             wpos = ( (uint8_t*)pq->tail ) - pq->data;
     wpos = ( wpos + pq->tail->hdr.mem_bytes ) % pq->size;
@@ -83,12 +182,24 @@ void __time_critical_func(pkt_queue_commit_pkt)( pkt_queue* pq, pkt_queue_pkt* p
     pkt->hdr.data_bytes = actual_size;
 }
 
-pkt_queue_pkt* pkt_queue_peek_pkt( pkt_queue* pq )
+pkt_queue_pkt* RMIIETH_HOT_FUNC( pkt_queue_peek_pkt )( pkt_queue* pq )
 {
     return( pq->head );
 }
 
-void pkt_queue_consume_pkt( pkt_queue* pq )
+pkt_queue_pkt* RMIIETH_HOT_FUNC( pkt_queue_next_pkt )( pkt_queue* pq, pkt_queue_pkt* pkt )
+{
+    if( pkt == pq->tail )
+    {
+        return( NULL );
+    }
+
+    int32_t             pos = ( (uint8_t*)pkt ) - pq->data;
+    pos = ( pos + pkt->hdr.mem_bytes ) % pq->size;
+    return( (pkt_queue_pkt*)( &pq->data[ pos ] ) );
+}
+
+void RMIIETH_HOT_FUNC( pkt_queue_consume_pkt )( pkt_queue* pq )
 {
     if( !pq->head )
     {
@@ -106,6 +217,14 @@ void pkt_queue_consume_pkt( pkt_queue* pq )
     pq->head = (pkt_queue_pkt*)( &pq->data[ rpos ] );
 }
 
+void RMIIETH_HOT_FUNC( pkt_queue_consume_pkts )( pkt_queue* pq, int count )
+{
+    while( count-- > 0 )
+    {
+        pkt_queue_consume_pkt( pq );
+    }
+}
+
 void pkt_queue_dump( pkt_queue* pq )
 {
     pkt_queue_pkt*        pkt = pq->head;
@@ -222,3 +341,111 @@ void pkt_queue_test( void )
     pkt_queue_dump( pq );
 }
 
+
+// split mode - every packet's contents must survive wrapping around the end of the buffer - returns the # of errors
+int pkt_queue_split_test( void )
+{
+    pkt_queue*          pq = &g_test_queue;
+    pkt_queue_pkt*      pkt;
+    int                 errors = 0;
+    int                 wrapped = 0;
+    uint8_t             wr_seq = 0;
+    uint8_t             rd_seq = 0;
+
+    pkt_queue_init( pq, g_test_buffer, sizeof( g_test_buffer ) );
+    pkt_queue_set_split( pq, true );
+
+    for( int i = 0 ; i < 100000 ; i++ )
+    {
+        int32_t     sz = ( rand() & 0x3ff ) + 0x200;
+
+        pkt = ( rand() & 1 ) ? pkt_queue_reserve_pkt( pq, sz ) : NULL;
+        if( pkt )
+        {
+            int32_t     actual = sz - ( rand() % sz );
+            int32_t     contig = pkt_queue_pkt_contig_bytes( pq, pkt );
+            wrapped += ( contig < sz );
+            for( int32_t j = 0 ; j < actual ; j++ )
+            {
+                uint8_t*    p = ( j < contig ) ? &pkt->data[ j ] : &pq->data[ j - contig ];
+                *p = (uint8_t)( wr_seq + j );
+            }
+            pkt_queue_commit_pkt( pq, pkt, actual );
+            wr_seq++;
+        }
+        else if( ( pkt = pkt_queue_peek_pkt( pq ) ) )
+        {
+            int32_t     contig = pkt_queue_pkt_contig_bytes( pq, pkt );
+            for( int32_t j = 0 ; j < pkt->hdr.data_bytes ; j++ )
+            {
+                uint8_t*    p = ( j < contig ) ? &pkt->data[ j ] : &pq->data[ j - contig ];
+                errors += ( *p != (uint8_t)( rd_seq + j ) );
+            }
+            pkt_queue_consume_pkt( pq );
+            rd_seq++;
+        }
+    }
+
+    printf( "pkt_queue_split_test: %d wrapped packets, %d errors\n", wrapped, errors );
+    return( errors );
+}
+
+// two queues sharing g_test_buffer, with a randomly moving boundary - packet contents must survive every move, and a
+// full queue mustn't hand out its read position again (see pkt_queue_reserve_pkt()) - returns the # of errors
+int pkt_queue_rebase_test( void )
+{
+    pkt_queue           qs[ 2 ];
+    uint8_t             wr_seq[ 2 ] = { 0, 0 };
+    uint8_t             rd_seq[ 2 ] = { 0, 0 };
+    int32_t             boundary = sizeof( g_test_buffer ) / 2;
+    int                 moves = 0;
+    int                 errors = 0;
+
+    pkt_queue_init( &qs[ 0 ], g_test_buffer, boundary );
+    pkt_queue_init( &qs[ 1 ], g_test_buffer + boundary, sizeof( g_test_buffer ) - boundary );
+
+    for( int i = 0 ; i < 100000 ; i++ )
+    {
+        int             q = rand() & 1;
+        pkt_queue*      pq = &qs[ q ];
+        pkt_queue_pkt*  pkt;
+
+        switch( rand() % 3 )
+        {
+            case 0:
+                if( ( pkt = pkt_queue_reserve_pkt( pq, ( rand() & 0x1ff ) + 1 ) ) )
+                {
+                    memset( pkt->data, wr_seq[ q ]++, pkt->hdr.data_bytes );
+                }
+                break;
+            case 1:
+                if( ( pkt = pkt_queue_peek_pkt( pq ) ) )
+                {
+                    for( int32_t j = 0 ; j < pkt->hdr.data_bytes ; j++ )
+                    {
+                        errors += ( pkt->data[ j ] != rd_seq[ q ] );
+                    }
+                    rd_seq[ q ]++;
+                    pkt_queue_consume_pkt( pq );
+                }
+                break;
+            case 2:
+            {
+                int32_t     nb = boundary + ( ( rand() % 9 ) - 4 ) * 64;
+                if( nb >= 1024 && nb <= (int32_t)sizeof( g_test_buffer ) - 1024 &&
+                    pkt_queue_can_rebase( &qs[ 0 ], g_test_buffer, nb ) &&
+                    pkt_queue_can_rebase( &qs[ 1 ], g_test_buffer + nb, sizeof( g_test_buffer ) - nb ) )
+                {
+                    pkt_queue_rebase( &qs[ 0 ], g_test_buffer, nb );
+                    pkt_queue_rebase( &qs[ 1 ], g_test_buffer + nb, sizeof( g_test_buffer ) - nb );
+                    moves += ( nb != boundary );
+                    boundary = nb;
+                }
+                break;
+            }
+        }
+    }
+
+    printf( "pkt_queue_rebase_test: %d moves, %d errors\n", moves, errors );
+    return( errors );
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 
 /*
  * pkt_queue
@@ -30,17 +31,40 @@
  * On the read side:
  * 
  *      pkt_queue_peek_pkt()      - returns the next available packet for reading (or NULL if the queue is empty)
+ *      pkt_queue_next_pkt()      - optional, returns the packet following a peeked one (or NULL if there isn't one)
  *      pkt_queue_consume_pkt()   - consumes the current packet, and release the space
+ *      pkt_queue_consume_pkts()  - consumes several packets at once
  * 
  * Note: If there's one reserved packet in the queue, and you're DMAing into it, pkt_queue_peek_pkt() will still return it.
  * If the packet is in use, you need to account for that.
  * 
+ * Split mode:
+ * 
+ * If 'split' is set (see pkt_queue_set_split()), the tail packet is never padded out to the end of the buffer - instead, a
+ * packet's data may run off the end of the buffer and continue at offset 0. Only the packet header is guaranteed to be
+ * contiguous. Use pkt_queue_pkt_contig_bytes() to find out how much of a packet's data comes before the wrap.
+ * 
+ * Rebasing:
+ * 
+ * pkt_queue_rebase() moves the queue onto a different window of memory without touching the packets - which is only
+ * possible if the packets currently in the queue don't wrap, and all lie within the new window (check with
+ * pkt_queue_can_rebase()). This lets two queues share one buffer, with a movable boundary between them.
+ * 
  */
 
+// PKT_QUEUE_TIMESTAMPS gives each packet header a timestamp - 4 more bytes per packet, so it's only built in when
+// something wants it (the RX capture, see RMIIETH_LWIP_CAPTURE in CMakeLists.txt)
+#ifndef PKT_QUEUE_TIMESTAMPS
+#define PKT_QUEUE_TIMESTAMPS    0
+#endif
+
 typedef struct pkt_queue_pkt_hdr
 {
     int32_t                 data_bytes;
     int32_t                 mem_bytes;
+#if PKT_QUEUE_TIMESTAMPS
+    uint32_t                timestamp;              // for the writer's use - the queue doesn't touch it (RX: time_us_32() at end of frame)
+#endif
 } pkt_queue_pkt_hdr;
 
 typedef struct pkt_queue_pkt
@@ -55,19 +79,29 @@ typedef struct pkt_queue
     pkt_queue_pkt*      tail;
     int32_t             size;
     uint8_t*            data;
+    bool                split;
 } pkt_queue;
 
 
 
 void pkt_queue_init( pkt_queue* pq, uint8_t* data, int32_t size );
+void pkt_queue_set_split( pkt_queue* pq, bool split );
+int32_t pkt_queue_pkt_contig_bytes( pkt_queue* pq, pkt_queue_pkt* pkt );
+int32_t pkt_queue_used_bytes( pkt_queue* pq );
+bool pkt_queue_can_rebase( pkt_queue* pq, uint8_t* data, int32_t size );
+void pkt_queue_rebase( pkt_queue* pq, uint8_t* data, int32_t size );
 pkt_queue_pkt* pkt_queue_reserve_pkt( pkt_queue* pq, int32_t max_size );
 void pkt_queue_commit_pkt( pkt_queue* pq, pkt_queue_pkt* pkt, int32_t actual_size );
 pkt_queue_pkt* pkt_queue_peek_pkt( pkt_queue* pq );
+pkt_queue_pkt* pkt_queue_next_pkt( pkt_queue* pq, pkt_queue_pkt* pkt );
 void pkt_queue_consume_pkt( pkt_queue* pq );
+void pkt_queue_consume_pkts( pkt_queue* pq, int count );
 
 
 void pkt_queue_dump( pkt_queue* pq );
 void pkt_queue_test( void );
+int pkt_queue_split_test( void );
+int pkt_queue_rebase_test( void );
 
 
 #endif // #ifndef PKT_QUEUE_INCLUDED
\ No newline at end of file
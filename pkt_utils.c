@@ -4,7 +4,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include "pkt_utils.h"
+#include "rmiieth_opts.h"
 
 static uint32_t g_grc_table[] =
 {
@@ -14,7 +16,7 @@ static uint32_t g_grc_table[] =
     0xD6D930AC, 0xCB6E20C8, 0xEDB71064, 0xF0000000
 };
 
-bool pkt_remove_preamble( uint8_t* pkt, int* pkt_len_ptr )
+bool RMIIETH_HOT_FUNC( pkt_remove_preamble )( uint8_t* pkt, int* pkt_len_ptr )
 {
     int                 len = *pkt_len_ptr;
     uint32_t            sync = 0;
@@ -44,7 +46,7 @@ bool pkt_remove_preamble( uint8_t* pkt, int* pkt_len_ptr )
     return( false );
 }
 
-int pkt_generate_fcs_and_determine_length( uint8_t* data, int max_length )
+int RMIIETH_HOT_FUNC( pkt_generate_fcs_and_determine_length )( uint8_t* data, int max_length )
 {
     uint32_t    crc = 0;
     uint32_t    next_bytes;
@@ -69,7 +71,7 @@ int pkt_generate_fcs_and_determine_length( uint8_t* data, int max_length )
     return( -1 );
 }
 
-uint32_t pkt_generate_fcs( uint8_t* data, int length )
+uint32_t RMIIETH_HOT_FUNC( pkt_generate_fcs )( uint8_t* data, int length )
 {
     uint32_t crc = 0;
     for( uint32_t i = 0 ; i < length ; i++ )
@@ -81,7 +83,7 @@ uint32_t pkt_generate_fcs( uint8_t* data, int length )
 }
 
 
-bool pkt_validate( uint8_t* pkt, int* pkt_len_ptr )
+bool RMIIETH_HOT_FUNC( pkt_validate )( uint8_t* pkt, int* pkt_len_ptr )
 {
     if( !pkt_remove_preamble( pkt, pkt_len_ptr ) )
     {
@@ -111,13 +113,246 @@ bool pkt_validate( uint8_t* pkt, int* pkt_len_ptr )
         *pkt_len_ptr = q;
     }
 
-#if PKT_DEBUG_PRINTS || 1
+#if PKT_DEBUG_PRINTS
     printf( "Received valid packet of %d bytes\n", *pkt_len_ptr );
 #endif
 
     return( true );
 }
 
+//
+// split packets
+//
+// In split RX mode, a packet may run off the end of the RX ring - bytes [0,split) are at 'pkt', and the remainder
+// continue at 'wrap'. These versions of the functions above work in place across the split, so after validation the
+// packet still changes buffer at offset 'split'.
+//
+
+static inline uint8_t* split_byte( uint8_t* pkt, int split, uint8_t* wrap, int i )
+{
+    return( ( i < split ) ? &pkt[ i ] : &wrap[ i - split ] );
+}
+
+bool RMIIETH_HOT_FUNC( pkt_remove_preamble_split )( uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr )
+{
+    int                 len = *pkt_len_ptr;
+    uint32_t            sync = 0;
+
+    for( int i = 0 ; i < len ; i++ )
+    {
+        uint8_t     byte;
+        byte = *split_byte( pkt, split, wrap, i );
+        for( int j = 0; j < 8 ; j+=2 )
+        {
+            if( sync == 0xaaaaaaab )
+            {
+                int nl = 0;
+                uint8_t     cur = *split_byte( pkt, split, wrap, i );
+                for( int k = i ; k < len-1 ; k++ )
+                {
+                    uint8_t     next = *split_byte( pkt, split, wrap, k+1 );
+                    *split_byte( pkt, split, wrap, nl++ ) = ( next << ( 8 - j ) ) | ( cur >> j );
+                    cur = next;
+                }
+                *pkt_len_ptr = nl;
+                return( true );
+            }
+            sync <<= 2;
+            sync |= ( byte & 1 ) << 1;
+            sync |= ( byte & 2 ) >> 1;
+            byte >>= 2;
+        }
+    }
+    return( false );
+}
+
+int RMIIETH_HOT_FUNC( pkt_generate_fcs_and_determine_length_split )( uint8_t* pkt, int split, uint8_t* wrap, int max_length )
+{
+    uint32_t    crc = 0;
+    uint32_t    next_bytes = 0;
+
+    for( int i = 0 ; i < 4 ; i++ )
+    {
+        next_bytes |= (uint32_t)*split_byte( pkt, split, wrap, i ) << ( i * 8 );
+    }
+
+    for( int i = 4 ; i <= max_length ; i++ )
+    {
+        if( crc == next_bytes )
+        {
+            return( i - 4 );
+        }
+        uint8_t     nb = next_bytes & 0xff;
+        crc = (crc >> 4) ^ g_grc_table[ ( crc ^ ( nb >> 0 ) ) & 0x0F ];
+        crc = (crc >> 4) ^ g_grc_table[ ( crc ^ ( nb >> 4 ) ) & 0x0F ];
+        next_bytes >>= 8;
+        if( i < max_length )
+        {
+            next_bytes |= ((uint32_t)*split_byte( pkt, split, wrap, i )) << 24;
+        }
+    }
+    return( -1 );
+}
+
+bool RMIIETH_HOT_FUNC( pkt_validate_split )( uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr )
+{
+    if( !wrap || *pkt_len_ptr <= split )
+    {
+        return( pkt_validate( pkt, pkt_len_ptr ) );
+    }
+
+    if( !pkt_remove_preamble_split( pkt, split, wrap, pkt_len_ptr ) )
+    {
+#if PKT_DEBUG_PRINTS
+        printf( "failed to find preamble/sfd (split)\n" );
+#endif
+        return( false );
+    }
+
+    int             len = *pkt_len_ptr;
+    if( len < 4 )
+    {
+        return( false );
+    }
+
+    int             q = pkt_generate_fcs_and_determine_length_split( pkt, split, wrap, len );
+    if( q < 0 )
+    {
+#if PKT_DEBUG_PRINTS
+        printf( "Unable to match FCS (split)\n" );
+#endif
+        return( false );
+    }
+    *pkt_len_ptr = q;
+    return( true );
+}
+
+//
+// incremental validation
+//
+// Realigns the frame in place, and runs the FCS over it, as far as the raw bytes received so far allow. The FCS
+// search works just like pkt_generate_fcs_and_determine_length() - after each realigned byte, the CRC of everything
+// before the last 4 bytes is compared with those 4 bytes - so once it matches, there's nothing more to do.
+//
+
+void pkt_progress_init( pkt_progress* pp )
+{
+    memset( pp, 0, sizeof( pkt_progress ) );
+    pp->sfd_pos = -1;
+    pp->length = -1;
+}
+
+void RMIIETH_HOT_FUNC( pkt_progress_feed )( pkt_progress* pp, uint8_t* pkt, int split, uint8_t* wrap, int avail )
+{
+    // look for the SFD
+    while( pp->sfd_pos < 0 && pp->in_pos < avail )
+    {
+        uint8_t     byte = *split_byte( pkt, split, wrap, pp->in_pos );
+        for( int j = 0; j < 8 ; j+=2 )
+        {
+            if( pp->sync == 0xaaaaaaab )
+            {
+                pp->sfd_pos = pp->in_pos;
+                pp->shift = j;
+                break;
+            }
+            pp->sync <<= 2;
+            pp->sync |= ( byte & 1 ) << 1;
+            pp->sync |= ( byte & 2 ) >> 1;
+            byte >>= 2;
+        }
+        if( pp->sfd_pos < 0 )
+        {
+            pp->in_pos++;
+        }
+    }
+    if( pp->sfd_pos < 0 || pp->length >= 0 )
+    {
+        return;
+    }
+
+    // realign and check the FCS - each output byte needs the next raw byte as well
+    int         j = pp->shift;
+    int         k = pp->sfd_pos + pp->out_pos;
+    uint32_t    crc = pp->crc;
+    uint32_t    next_bytes = pp->next_bytes;
+    uint8_t     cur = *split_byte( pkt, split, wrap, k );
+    while( k + 1 < avail )
+    {
+        uint8_t     next = *split_byte( pkt, split, wrap, k + 1 );
+        uint8_t     out = ( next << ( 8 - j ) ) | ( cur >> j );
+        *split_byte( pkt, split, wrap, pp->out_pos ) = out;
+        cur = next;
+        k++;
+
+        next_bytes = ( next_bytes >> 8 ) | ( (uint32_t)out << 24 );
+        pp->out_pos++;
+        if( pp->out_pos >= 4 )
+        {
+            if( crc == next_bytes )
+            {
+                pp->length = pp->out_pos - 4;
+                break;
+            }
+            uint8_t     nb = next_bytes & 0xff;
+            crc = (crc >> 4) ^ g_grc_table[ ( crc ^ ( nb >> 0 ) ) & 0x0F ];
+            crc = (crc >> 4) ^ g_grc_table[ ( crc ^ ( nb >> 4 ) ) & 0x0F ];
+        }
+    }
+    pp->crc = crc;
+    pp->next_bytes = next_bytes;
+}
+
+bool RMIIETH_HOT_FUNC( pkt_progress_finish )( pkt_progress* pp, uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr )
+{
+    pkt_progress_feed( pp, pkt, split, wrap, *pkt_len_ptr );
+    if( pp->length < 0 )
+    {
+        return( false );
+    }
+    *pkt_len_ptr = pp->length;
+    return( true );
+}
+
+//
+// header peek
+//
+// Used by the RX interrupt to look at the start of a frame before it's committed. The SFD is normally within the
+// first few bytes, so the search is bounded - a packet that doesn't find it by then isn't worth keeping anyway.
+//
+
+#define PEEK_MAX_SEARCH         32
+
+bool RMIIETH_HOT_FUNC( pkt_peek_header )( uint8_t* pkt, int split, uint8_t* wrap, int len, uint8_t* hdr, int hdr_len )
+{
+    uint32_t            sync = 0;
+
+    for( int i = 0 ; ( i + hdr_len < len ) && ( i < PEEK_MAX_SEARCH ) ; i++ )
+    {
+        uint8_t     byte;
+        byte = *split_byte( pkt, split, wrap, i );
+        for( int j = 0; j < 8 ; j+=2 )
+        {
+            if( sync == 0xaaaaaaab )
+            {
+                uint8_t     cur = *split_byte( pkt, split, wrap, i );
+                for( int k = 0 ; k < hdr_len ; k++ )
+                {
+                    uint8_t     next = *split_byte( pkt, split, wrap, i+k+1 );
+                    hdr[ k ] = ( next << ( 8 - j ) ) | ( cur >> j );
+                    cur = next;
+                }
+                return( true );
+            }
+            sync <<= 2;
+            sync |= ( byte & 1 ) << 1;
+            sync |= ( byte & 2 ) >> 1;
+            byte >>= 2;
+        }
+    }
+    return( false );
+}
+
 void pkt_dump( uint8_t* pkt, int len, int max_len )
 {
     if( len > max_len )
@@ -129,4 +364,403 @@ void pkt_dump( uint8_t* pkt, int len, int max_len )
         printf( "%02x ", pkt[ i ] );
     }
     printf( "\n" );
-}
\ No newline at end of file
+}
+//
+// internet checksum
+//
+// Partial sums are 16-bit one's complement sums of the data, taken in memory byte order (so they can be stored
+// straight back into a packet without swapping). Each call assumes that 'data' starts at an even offset within
+// the checksummed region - if it does not, swap the running sum before and after the call:
+//
+//      sum = pkt_checksum_swap( pkt_checksum_add( data, length, pkt_checksum_swap( sum ) ) );
+//
+
+static inline uint32_t checksum_fold( uint64_t acc )
+{
+    acc = ( acc & 0xffffffff ) + ( acc >> 32 );
+    acc = ( acc & 0xffffffff ) + ( acc >> 32 );
+    uint32_t    sum = (uint32_t)acc;
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    return( sum );
+}
+
+static inline __attribute__((always_inline)) uint32_t checksum_copy_generic( uint8_t* dst, const uint8_t* src, int length, uint32_t sum, bool copy )
+{
+    uint64_t    acc = 0;
+    uint32_t    lead = 0;
+    bool        swapped = false;
+
+    // an odd start address means we can never reach word alignment without breaking the 16-bit pairing - so sum the
+    // remainder on its own (which pairs the bytes the other way round) and swap it back afterwards
+    if( ( (uintptr_t)src & 1 ) && length > 1 )
+    {
+        lead = *src++;
+        if( copy )
+        {
+            *dst++ = (uint8_t)lead;
+        }
+        length--;
+        swapped = true;
+    }
+
+    // word-aligned fast path - only possible if source and destination agree on alignment
+    if( !copy || !( ( (uintptr_t)src ^ (uintptr_t)dst ) & 3 ) )
+    {
+        if( ( (uintptr_t)src & 2 ) && length >= 2 )
+        {
+            uint16_t    v = *(const uint16_t*)src;
+            if( copy )
+            {
+                *(uint16_t*)dst = v;
+                dst += 2;
+            }
+            acc += v;
+            src += 2;
+            length -= 2;
+        }
+
+        const uint32_t*     s32 = (const uint32_t*)src;
+        uint32_t*           d32 = (uint32_t*)dst;
+        while( length >= 16 )
+        {
+            uint32_t    w0 = s32[ 0 ];
+            uint32_t    w1 = s32[ 1 ];
+            uint32_t    w2 = s32[ 2 ];
+            uint32_t    w3 = s32[ 3 ];
+            if( copy )
+            {
+                d32[ 0 ] = w0;
+                d32[ 1 ] = w1;
+                d32[ 2 ] = w2;
+                d32[ 3 ] = w3;
+                d32 += 4;
+            }
+            acc += w0;
+            acc += w1;
+            acc += w2;
+            acc += w3;
+            s32 += 4;
+            length -= 16;
+        }
+        while( length >= 4 )
+        {
+            uint32_t    w = *s32++;
+            if( copy )
+            {
+                *d32++ = w;
+            }
+            acc += w;
+            length -= 4;
+        }
+        src = (const uint8_t*)s32;
+        dst = (uint8_t*)d32;
+    }
+    else if( !( ( (uintptr_t)src ^ (uintptr_t)dst ) & 1 ) )
+    {
+        // source and destination a halfword apart - e.g. TX, where lwIP word-aligns the TCP/UDP header, but the frame
+        // (and so the header) is 2 bytes off word alignment in the TX queue. Read words, and store them as halfwords
+        if( ( (uintptr_t)src & 2 ) && length >= 2 )
+        {
+            uint16_t    v = *(const uint16_t*)src;
+            *(uint16_t*)dst = v;
+            acc += v;
+            src += 2;
+            dst += 2;
+            length -= 2;
+        }
+
+        const uint32_t*     s32 = (const uint32_t*)src;
+        uint16_t*           d16 = (uint16_t*)dst;
+        while( length >= 8 )
+        {
+            uint32_t    w0 = s32[ 0 ];
+            uint32_t    w1 = s32[ 1 ];
+            d16[ 0 ] = (uint16_t)w0;
+            d16[ 1 ] = (uint16_t)( w0 >> 16 );
+            d16[ 2 ] = (uint16_t)w1;
+            d16[ 3 ] = (uint16_t)( w1 >> 16 );
+            acc += w0;
+            acc += w1;
+            s32 += 2;
+            d16 += 4;
+            length -= 8;
+        }
+        if( length >= 4 )
+        {
+            uint32_t    w = *s32++;
+            d16[ 0 ] = (uint16_t)w;
+            d16[ 1 ] = (uint16_t)( w >> 16 );
+            d16 += 2;
+            acc += w;
+            length -= 4;
+        }
+        src = (const uint8_t*)s32;
+        dst = (uint8_t*)d16;
+    }
+
+    // whatever is left (or everything, if the alignment didn't match) goes a byte pair at a time
+    while( length >= 2 )
+    {
+        uint8_t     b0 = src[ 0 ];
+        uint8_t     b1 = src[ 1 ];
+        if( copy )
+        {
+            dst[ 0 ] = b0;
+            dst[ 1 ] = b1;
+            dst += 2;
+        }
+        acc += (uint32_t)b0 | ( (uint32_t)b1 << 8 );
+        src += 2;
+        length -= 2;
+    }
+    if( length )
+    {
+        if( copy )
+        {
+            *dst = *src;
+        }
+        acc += *src;
+    }
+
+    uint32_t    result = checksum_fold( acc );
+    if( swapped )
+    {
+        result = pkt_checksum_swap( result );
+    }
+    return( checksum_fold( (uint64_t)result + lead + sum ) );
+}
+
+uint32_t RMIIETH_HOT_FUNC( pkt_checksum_add )( const uint8_t* data, int length, uint32_t sum )
+{
+    return( checksum_copy_generic( NULL, data, length, sum, false ) );
+}
+
+uint32_t RMIIETH_HOT_FUNC( pkt_checksum_copy )( uint8_t* dst, const uint8_t* src, int length, uint32_t sum )
+{
+    return( checksum_copy_generic( dst, src, length, sum, true ) );
+}
+
+uint32_t RMIIETH_HOT_FUNC( pkt_checksum_swap )( uint32_t sum )
+{
+    return( ( ( sum & 0xff ) << 8 ) | ( ( sum >> 8 ) & 0xff ) );
+}
+
+uint16_t RMIIETH_HOT_FUNC( pkt_checksum_finish )( uint32_t sum )
+{
+    return( (uint16_t)~sum );
+}
+
+// add two partial sums - 'add' must have been taken from an even offset after 'sum's start (or be swapped first)
+uint32_t RMIIETH_HOT_FUNC( pkt_checksum_combine )( uint32_t sum, uint32_t add )
+{
+    return( checksum_fold( (uint64_t)sum + add ) );
+}
+
+// there are only ever a handful of tables (one per file), so a linear search is fine
+bool RMIIETH_HOT_FUNC( pkt_checksum_lookup )( const pkt_checksum_table* tables, int count, const uint8_t* data, int length, uint32_t* sum )
+{
+    for( int i = 0 ; i < count ; i++ )
+    {
+        const pkt_checksum_table*   t = &tables[ i ];
+        if( data < t->data || data >= t->data + t->length )
+        {
+            continue;
+        }
+        int32_t     ofs = data - t->data;
+        int32_t     piece_len = t->length - ofs;
+        if( piece_len > t->piece )
+        {
+            piece_len = t->piece;
+        }
+        if( ( ofs % t->piece ) != 0 || length != piece_len )
+        {
+            return( false );
+        }
+        *sum = t->sums[ ofs / t->piece ];
+        return( true );
+    }
+    return( false );
+}
+
+// straightforward RFC 1071 implementation, for comparison
+static uint16_t checksum_reference( const uint8_t* data, int length )
+{
+    uint32_t    sum = 0;
+    for( int i = 0 ; i < length ; i += 2 )
+    {
+        uint32_t    w = (uint32_t)data[ i ] << 8;
+        if( i + 1 < length )
+        {
+            w |= data[ i + 1 ];
+        }
+        sum += w;
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+    }
+    return( (uint16_t)~sum );
+}
+
+static uint8_t      g_checksum_test_src[ 1600 ];
+static uint8_t      g_checksum_test_dst[ 1600 ];
+
+int pkt_checksum_test( void )
+{
+    int     failures = 0;
+
+    for( int i = 0 ; i < 20000 ; i++ )
+    {
+        int     src_ofs = rand() & 7;
+        int     dst_ofs = rand() & 7;
+        int     length = rand() % 1500;
+        int     split = length ? rand() % length : 0;
+        uint8_t fill = ( i & 1 ) ? 0xff : 0x00;
+
+        for( int j = 0 ; j < length ; j++ )
+        {
+            g_checksum_test_src[ src_ofs + j ] = ( i & 2 ) ? fill : (uint8_t)rand();
+        }
+        memset( g_checksum_test_dst, 0, sizeof( g_checksum_test_dst ) );
+
+        // checksum in two pieces, as we would across a pbuf chain
+        uint32_t    a = pkt_checksum_copy( &g_checksum_test_dst[ dst_ofs ], &g_checksum_test_src[ src_ofs ], split, 0 );
+        uint32_t    sum;
+        if( split & 1 )
+        {
+            sum = pkt_checksum_swap( pkt_checksum_copy( &g_checksum_test_dst[ dst_ofs + split ], &g_checksum_test_src[ src_ofs + split ], length - split, pkt_checksum_swap( a ) ) );
+        }
+        else
+        {
+            sum = pkt_checksum_copy( &g_checksum_test_dst[ dst_ofs + split ], &g_checksum_test_src[ src_ofs + split ], length - split, a );
+        }
+
+        // our sums are in memory byte order - the reference is big-endian
+        uint16_t    got = pkt_checksum_finish( sum );
+        uint16_t    expected = checksum_reference( &g_checksum_test_src[ src_ofs ], length );
+        uint16_t    got_be = (uint16_t)( ( ( (uint8_t*)&got )[ 0 ] << 8 ) | ( (uint8_t*)&got )[ 1 ] );
+
+        if( got_be != expected || memcmp( &g_checksum_test_dst[ dst_ofs ], &g_checksum_test_src[ src_ofs ], length ) ||
+            pkt_checksum_add( &g_checksum_test_src[ src_ofs ], length, 0 ) != sum )
+        {
+            if( failures++ < 10 )
+            {
+                printf( "checksum mismatch: len %d, src+%d, dst+%d, split %d -> %04x, expected %04x\n",
+                        length, src_ofs, dst_ofs, split, got_be, expected );
+            }
+        }
+    }
+
+    // precalculated pieces - only whole, aligned pieces are found
+    static uint16_t             sums[ 16 ];
+    const pkt_checksum_table    table = { g_checksum_test_src, 1500, 100, sums };
+    for( int i = 0 ; i < 15 ; i++ )
+    {
+        sums[ i ] = (uint16_t)pkt_checksum_add( &g_checksum_test_src[ i * 100 ], 100, 0 );
+    }
+    for( int i = 0 ; i < 1000 ; i++ )
+    {
+        int         ofs = rand() % 1500;
+        int         length = 1 + rand() % 100;
+        if( i & 1 )
+        {
+            ofs -= ofs % 100;
+            length = ( ofs + 100 > 1500 ) ? 1500 - ofs : 100;
+        }
+        uint32_t    sum;
+        bool        found = pkt_checksum_lookup( &table, 1, &g_checksum_test_src[ ofs ], length, &sum );
+        bool        whole = !( ofs % 100 ) && length == 100;
+        if( found != whole || ( found && sum != pkt_checksum_add( &g_checksum_test_src[ ofs ], length, 0 ) ) )
+        {
+            if( failures++ < 10 )
+            {
+                printf( "checksum lookup mismatch: ofs %d, len %d\n", ofs, length );
+            }
+        }
+    }
+    uint32_t    a = pkt_checksum_add( g_checksum_test_src, 600, 0 );
+    uint32_t    b = pkt_checksum_add( &g_checksum_test_src[ 600 ], 900, 0 );
+    if( pkt_checksum_combine( a, b ) != pkt_checksum_add( g_checksum_test_src, 1500, 0 ) )
+    {
+        failures++;
+        printf( "checksum combine mismatch\n" );
+    }
+
+    printf( "checksum test: %d failures\n", failures );
+    return( failures );
+}
+
+static uint8_t      g_progress_test_raw[ 1600 ];
+static uint8_t      g_progress_test_a[ 1600 ];
+static uint8_t      g_progress_test_b[ 1600 ];
+
+int pkt_progress_test( void )
+{
+    int     failures = 0;
+    int     valid = 0;
+
+    for( int i = 0 ; i < 5000 ; i++ )
+    {
+        // preamble, sfd, frame and fcs - shifted along by a few idle dibits, as the RX state machine would deliver it
+        uint8_t     frame[ 1540 ];
+        int         frame_len = 60 + rand() % 1454;
+        for( int j = 0 ; j < 7 ; j++ )
+        {
+            frame[ j ] = 0x55;
+        }
+        frame[ 7 ] = 0xd5;
+        for( int j = 0 ; j < frame_len ; j++ )
+        {
+            frame[ 8 + j ] = (uint8_t)rand();
+        }
+        uint32_t    fcs = pkt_generate_fcs( &frame[ 8 ], frame_len );
+        if( i & 1 )
+        {
+            fcs ^= 1u << ( rand() & 31 );                   // and some bad ones
+        }
+        for( int j = 0 ; j < 4 ; j++ )
+        {
+            frame[ 8 + frame_len + j ] = (uint8_t)( fcs >> ( j * 8 ) );
+        }
+
+        int         shift = ( rand() % 16 ) * 2;
+        int         raw_len = ( shift + ( 8 + frame_len + 4 ) * 8 + 7 ) / 8 + 1 + rand() % 4;
+        memset( g_progress_test_raw, 0, raw_len );
+        for( int j = 0 ; j < ( 8 + frame_len + 4 ) * 8 ; j++ )
+        {
+            int     bit = ( frame[ j / 8 ] >> ( j % 8 ) ) & 1;
+            g_progress_test_raw[ ( shift + j ) / 8 ] |= bit << ( ( shift + j ) % 8 );
+        }
+
+        // the reference, and the same thing a random chunk at a time - both across a random split
+        int         split = rand() % raw_len;
+        memcpy( g_progress_test_a, g_progress_test_raw, raw_len );
+        memcpy( g_progress_test_b, g_progress_test_raw, raw_len );
+
+        int         len_a = raw_len;
+        bool        ok_a = pkt_validate_split( g_progress_test_a, split, &g_progress_test_a[ split ], &len_a );
+
+        pkt_progress    pp;
+        int             avail = 0;
+        pkt_progress_init( &pp );
+        while( avail < raw_len )
+        {
+            avail += rand() % 200;
+            avail = ( avail > raw_len ) ? raw_len : avail;
+            pkt_progress_feed( &pp, g_progress_test_b, split, &g_progress_test_b[ split ], avail );
+        }
+        int         len_b = raw_len;
+        bool        ok_b = pkt_progress_finish( &pp, g_progress_test_b, split, &g_progress_test_b[ split ], &len_b );
+
+        valid += ok_a;
+        if( ok_a != ok_b || ( ok_a && ( len_a != len_b || memcmp( g_progress_test_a, g_progress_test_b, len_a ) ) ) )
+        {
+            if( failures++ < 10 )
+            {
+                printf( "progress mismatch: raw %d, split %d -> %d/%d, expected %d/%d\n",
+                        raw_len, split, ok_b, len_b, ok_a, len_a );
+            }
+        }
+    }
+
+    printf( "progress test: %d valid, %d failures\n", valid, failures );
+    return( failures );
+}
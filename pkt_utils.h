@@ -17,4 +17,56 @@ uint32_t    pkt_generate_fcs( uint8_t* data, int length );
 bool        pkt_validate( uint8_t* pkt, int* pkt_len_ptr );
 void        pkt_dump( uint8_t* pkt, int len, int max_len );
 
+// packets that continue at 'wrap' from offset 'split' (see split RX mode)
+bool        pkt_remove_preamble_split( uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr );
+int         pkt_generate_fcs_and_determine_length_split( uint8_t* pkt, int split, uint8_t* wrap, int max_length );
+bool        pkt_validate_split( uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr );
+
+// decode the first hdr_len bytes of a raw (still unaligned) packet into hdr, without modifying it - pass split = len
+// and wrap = NULL for packets that don't wrap
+bool        pkt_peek_header( uint8_t* pkt, int split, uint8_t* wrap, int len, uint8_t* hdr, int hdr_len );
+
+// incremental validation - the same work as pkt_validate_split(), done a piece at a time as the raw packet arrives:
+//
+//      pkt_progress_init( &pp );
+//      pkt_progress_feed( &pp, pkt, split, wrap, bytes_so_far );                  // as often as you like
+//      ok = pkt_progress_finish( &pp, pkt, split, wrap, &pkt_len );                // once the whole packet is there
+//
+typedef struct
+{
+    uint32_t    sync;                               // preamble search - last 16 dibits
+    int         in_pos;                             // raw bytes consumed by the preamble search
+    int         sfd_pos;                            // raw byte holding the start of the frame (-1 until the SFD is found)
+    int         shift;                              // bit offset of the frame within the raw bytes
+    int         out_pos;                            // realigned bytes written so far
+    uint32_t    crc;                                // FCS of the realigned bytes, up to out_pos - 4
+    uint32_t    next_bytes;                         // last 4 realigned bytes
+    int         length;                             // frame length, once the FCS has matched (-1 until then)
+} pkt_progress;
+
+void        pkt_progress_init( pkt_progress* pp );
+void        pkt_progress_feed( pkt_progress* pp, uint8_t* pkt, int split, uint8_t* wrap, int avail );
+bool        pkt_progress_finish( pkt_progress* pp, uint8_t* pkt, int split, uint8_t* wrap, int* pkt_len_ptr );
+int         pkt_progress_test( void );
+
+// internet (one's complement) checksum - sums are kept folded to 16 bits, in memory byte order
+uint32_t    pkt_checksum_add( const uint8_t* data, int length, uint32_t sum );
+uint32_t    pkt_checksum_copy( uint8_t* dst, const uint8_t* src, int length, uint32_t sum );
+uint32_t    pkt_checksum_swap( uint32_t sum );
+uint16_t    pkt_checksum_finish( uint32_t sum );
+uint32_t    pkt_checksum_combine( uint32_t sum, uint32_t add );
+int         pkt_checksum_test( void );
+
+// precalculated sums of const data, in pieces of 'piece' bytes from the start (the last may be shorter) - see
+// rmiieth_makefsdata.py. pkt_checksum_lookup() finds the sum of exactly one of those pieces, if that's what data is
+typedef struct
+{
+    const uint8_t*  data;
+    int32_t         length;
+    int32_t         piece;
+    const uint16_t* sums;                           // pkt_checksum_add( piece, piece_length, 0 ) for each piece
+} pkt_checksum_table;
+
+bool        pkt_checksum_lookup( const pkt_checksum_table* tables, int count, const uint8_t* data, int length, uint32_t* sum );
+
 #endif // #ifndef PKT_UTILS_H_INCLUDED
\ No newline at end of file
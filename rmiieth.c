@@ -2,43 +2,59 @@
  * (c) 2021 Ben Stragnell
  */
 
-#include "rmiieth.h"
+#include "rmiieth_common.h"
 #include "rmiieth_md.h"
 #include "rmii_ext_clk.pio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#if RMIIETH_IRQ_TIMING
+#include "hardware/structs/systick.h"
+#endif
 #include "pkt_utils.h"
 #include <string.h>
 
 static void rmiieth_rx_irq_handler( void );
+static void rmiieth_tx_irq_handler( void );
 static void rmiieth_rx_try_start( rmiieth_config* cfg );
+static void rmiieth_rx_arm( rmiieth_config* cfg );
 static void rmiieth_start_tx( rmiieth_config* cfg, pkt_queue_pkt* p );
 
 static rmiieth_config* g_cfg;
 
+//
+// the PIO, DMA and interrupt side of the driver - everything else is in rmiieth_common.c, which the host backend shares
+//
 
-void rmiieth_set_default_config( rmiieth_config* cfg )
-{
-    memset( cfg, 0, sizeof( rmiieth_config ) );
-    cfg->pio = pio0;
-    cfg->pin_mdc = 14;
-    cfg->pin_mdio = 15;
-    cfg->pin_clk = 10;
-    cfg->pin_rx_base = 11;
-    cfg->pin_rx_valid = 13;
-    cfg->pin_tx_base = 7;
-    cfg->pin_tx_valid = 9;
-    cfg->sleep_us = 1000;
-    cfg->phy_addr = 0x01;            // this happens to be the default
-    cfg->rx_dma_chan = 0;
-    cfg->tx_dma_chan = 1;
-    cfg->rx_irq = 0;
-    cfg->rx_lock_id = -1;
-
-    cfg->rx_queue_buffer_size = 8192;
-    cfg->tx_queue_buffer_size = 8192;
-    cfg->mtu = 1500;
-}
+#if RMIIETH_STATIC_BUFFERS
+// see rmiieth_opts.h
+static uint8_t g_rx_static_buffer[ RMIIETH_STATIC_RX_SIZE ] RMIIETH_STATIC_RX_PLACEMENT __attribute__((aligned(4)));
+static uint8_t g_tx_static_buffer[ RMIIETH_STATIC_TX_SIZE ] RMIIETH_STATIC_TX_PLACEMENT __attribute__((aligned(4)));
+#if RMIIETH_STATIC_RX_CTRL_SIZE
+static uint8_t g_rx_ctrl_static_buffer[ RMIIETH_STATIC_RX_CTRL_SIZE ] RMIIETH_STATIC_CTRL_PLACEMENT __attribute__((aligned(4)));
+#endif
+#if RMIIETH_STATIC_TX_CTRL_SIZE
+static uint8_t g_tx_ctrl_static_buffer[ RMIIETH_STATIC_TX_CTRL_SIZE ] RMIIETH_STATIC_CTRL_PLACEMENT __attribute__((aligned(4)));
+#endif
+
+#if defined( RMIIETH_STATIC_RX_IN_SRAM4 ) && defined( RMIIETH_STATE_IN_SRAM4 )
+_Static_assert( RMIIETH_STATIC_RX_SIZE + sizeof( rmiieth_config ) <= 4096,
+                "the RX ring and rmiieth_config don't fit in SRAM4 - reduce RMIIETH_STATIC_RX_SIZE" );
+#endif
+
+#if defined( RMIIETH_STATIC_TX_IN_SRAM5 )
+#ifndef PICO_STACK_SIZE
+#define PICO_STACK_SIZE                 0x800
+#endif
+// core 0's stack is at the top of SRAM5 - with the defaults, the two fill it exactly
+_Static_assert( RMIIETH_STATIC_TX_SIZE + PICO_STACK_SIZE <= 4096,
+                "the TX ring and core 0's stack don't fit in SRAM5 - reduce RMIIETH_STATIC_TX_SIZE" );
+#endif
+
+// with the default size, the TX ring holds one full-sized packet (counters, preamble, frame and FCS) - so transmission
+// is effectively unbuffered, and low_level_output() drops a large frame while the previous one is still going out
+_Static_assert( RMIIETH_STATIC_TX_SIZE >= sizeof( pkt_queue_pkt_hdr ) + 8 + 8 + 1514 + 4,
+                "RMIIETH_STATIC_TX_SIZE won't hold a full-sized packet" );
+#endif
 
 bool rmiieth_probe( rmiieth_config* cfg )
 {
@@ -62,6 +78,25 @@ void rmiieth_init( rmiieth_config* cfg )
 
     g_cfg = cfg;
 
+    // the hot paths use the board definition's values directly, so the config had better agree with them
+    assert( cfg->pio == RMIIETH_PIO( cfg ) );
+    assert( cfg->rx_dma_chan == RMIIETH_RX_DMA_CHAN( cfg ) );
+    assert( cfg->rx_dma_chan2 == RMIIETH_RX_DMA_CHAN2( cfg ) );
+    assert( cfg->tx_dma_chan == RMIIETH_TX_DMA_CHAN( cfg ) );
+    assert( cfg->tx_dma_irq == RMIIETH_TX_DMA_IRQ( cfg ) );
+    assert( cfg->mtu == RMIIETH_MTU( cfg ) );
+    assert( cfg->rx_split_dma == RMIIETH_RX_SPLIT_DMA( cfg ) );
+
+    // cut-through works on packets in place, so they mustn't be moved (arena) once committed
+    assert( !cfg->rx_cut_through || !cfg->arena_size );
+
+#if RMIIETH_IRQ_TIMING
+    // free-running 24-bit SysTick, at the processor clock
+    systick_hw->rvr = 0x00ffffff;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;
+#endif
+
     //
     // init the MD interface
     //
@@ -80,27 +115,85 @@ void rmiieth_init( rmiieth_config* cfg )
     cfg->rx_lock = spin_lock_init( cfg->rx_lock_id );
 
     //
-    // init buffers
+    // shared arena - RX gets the bottom part and TX the top, with the boundary moving at runtime (see rmiieth_arena_rebalance())
+    //
+
+    if( cfg->arena_size )
+    {
+        assert( cfg->arena_rx_min + cfg->arena_tx_min <= cfg->arena_size );
+        cfg->arena_size &= (~3);
+        if( !cfg->arena_buffer )
+        {
+            cfg->arena_buffer = (uint8_t*)malloc( cfg->arena_size );
+            if( !cfg->arena_buffer )
+            {
+                assert( false );
+            }
+        }
+        cfg->arena_rx_initial = ( cfg->arena_size / 2 ) & (~3);
+        cfg->rx_queue_buffer = cfg->arena_buffer;
+        cfg->rx_queue_buffer_size = cfg->arena_rx_initial;
+        cfg->tx_queue_buffer = cfg->arena_buffer + cfg->arena_rx_initial;
+        cfg->tx_queue_buffer_size = cfg->arena_size - cfg->arena_rx_initial;
+        cfg->arena_stats.rx_size = cfg->rx_queue_buffer_size;
+        cfg->arena_stats.tx_size = cfg->tx_queue_buffer_size;
+    }
+
+    //
+    // init buffers - anything not passed in, and not static, is malloc'd by rmiieth_init_queues()
     //
 
+#if RMIIETH_STATIC_BUFFERS
     if( !cfg->rx_queue_buffer )
     {
-        cfg->rx_queue_buffer = (uint8_t*)malloc( cfg->rx_queue_buffer_size );
-        if( !cfg->rx_queue_buffer )
+        if( cfg->rx_queue_buffer_size != sizeof( g_rx_static_buffer ) )
         {
-            assert( false );
+            printf( "rmiieth: rx_queue_buffer_size %d replaced by RMIIETH_STATIC_RX_SIZE (%d)\n",
+                    (int)cfg->rx_queue_buffer_size, RMIIETH_STATIC_RX_SIZE );
         }
+        cfg->rx_queue_buffer = g_rx_static_buffer;
+        cfg->rx_queue_buffer_size = sizeof( g_rx_static_buffer );
     }
-    pkt_queue_init( &cfg->rx_queue, cfg->rx_queue_buffer, cfg->rx_queue_buffer_size );
     if( !cfg->tx_queue_buffer )
     {
-        cfg->tx_queue_buffer = (uint8_t*)malloc( cfg->tx_queue_buffer_size );
-        if( !cfg->rx_queue_buffer )
+        if( cfg->tx_queue_buffer_size != sizeof( g_tx_static_buffer ) )
+        {
+            printf( "rmiieth: tx_queue_buffer_size %d replaced by RMIIETH_STATIC_TX_SIZE (%d)\n",
+                    (int)cfg->tx_queue_buffer_size, RMIIETH_STATIC_TX_SIZE );
+        }
+        cfg->tx_queue_buffer = g_tx_static_buffer;
+        cfg->tx_queue_buffer_size = sizeof( g_tx_static_buffer );
+    }
+    if( cfg->rx_ctrl_queue_size && !cfg->rx_ctrl_queue_buffer )
+    {
+#if RMIIETH_STATIC_RX_CTRL_SIZE
+        if( cfg->rx_ctrl_queue_size > RMIIETH_STATIC_RX_CTRL_SIZE )
         {
-            assert( false );
+            printf( "rmiieth: rx_ctrl_queue_size cut to RMIIETH_STATIC_RX_CTRL_SIZE (%d)\n", RMIIETH_STATIC_RX_CTRL_SIZE );
+            cfg->rx_ctrl_queue_size = RMIIETH_STATIC_RX_CTRL_SIZE;
         }
+        cfg->rx_ctrl_queue_buffer = g_rx_ctrl_static_buffer;
+#else
+        printf( "rmiieth: no static RX control queue (see RMIIETH_STATIC_RX_CTRL_SIZE) - disabled\n" );
+        cfg->rx_ctrl_queue_size = 0;
+#endif
     }
-    pkt_queue_init( &cfg->tx_queue, cfg->tx_queue_buffer, cfg->tx_queue_buffer_size );
+    if( cfg->tx_ctrl_queue_size && !cfg->tx_ctrl_queue_buffer )
+    {
+#if RMIIETH_STATIC_TX_CTRL_SIZE
+        if( cfg->tx_ctrl_queue_size > RMIIETH_STATIC_TX_CTRL_SIZE )
+        {
+            printf( "rmiieth: tx_ctrl_queue_size cut to RMIIETH_STATIC_TX_CTRL_SIZE (%d)\n", RMIIETH_STATIC_TX_CTRL_SIZE );
+            cfg->tx_ctrl_queue_size = RMIIETH_STATIC_TX_CTRL_SIZE;
+        }
+        cfg->tx_ctrl_queue_buffer = g_tx_ctrl_static_buffer;
+#else
+        printf( "rmiieth: no static TX control queue (see RMIIETH_STATIC_TX_CTRL_SIZE) - disabled\n" );
+        cfg->tx_ctrl_queue_size = 0;
+#endif
+    }
+#endif
+    rmiieth_init_queues( cfg );
 
     //
     // init IRQ - the RX state machine interrupts us at the end of a packet
@@ -133,14 +226,21 @@ void rmiieth_init( rmiieth_config* cfg )
     // allocate state-machines
     //
 
+#ifdef RMIIETH_BOARD_RX_SM
+    // the board definition fixes the RX SM, so claim it before the others get allocated
+    pio_sm_claim( cfg->pio, RMIIETH_BOARD_RX_SM );
+    cfg->rx_sm = RMIIETH_BOARD_RX_SM;
+#endif
     if( ( cfg->clk_sm = pio_claim_unused_sm( cfg->pio, false ) ) < 0 )
     {
         assert( false );
     }
+#ifndef RMIIETH_BOARD_RX_SM
     if( ( cfg->rx_sm = pio_claim_unused_sm( cfg->pio, false ) ) < 0 )
     {
         assert( false );
     }
+#endif
     if( ( cfg->tx_sm = pio_claim_unused_sm( cfg->pio, false ) ) < 0 )
     {
         assert( false );
@@ -188,6 +288,25 @@ void rmiieth_init( rmiieth_config* cfg )
         1,
         false
     );
+    cfg->rx_dma_config = c;
+
+    // split RX - the second channel picks up where the first one leaves off, at the start of the ring
+    if( cfg->rx_split_dma )
+    {
+        c = dma_channel_get_default_config( cfg->rx_dma_chan2 );
+        channel_config_set_read_increment( &c, false );
+        channel_config_set_write_increment( &c, true );
+        channel_config_set_dreq( &c, pio_get_dreq( cfg->pio, cfg->rx_sm, false ) );
+        channel_config_set_transfer_data_size( &c, DMA_SIZE_32 );
+        dma_channel_configure(
+            cfg->rx_dma_chan2,
+            &c,
+            cfg->rx_queue.data,
+            (void*)((uintptr_t)( &cfg->pio->rxf[ cfg->rx_sm ] ) ),
+            1,
+            false
+        );
+    }
 
     //
     // init the TX program
@@ -223,13 +342,17 @@ void rmiieth_init( rmiieth_config* cfg )
         false
     );
 
+    //
+    // init TX IRQ - the TX DMA interrupts us when a packet has been sent
+    //
 
+    dma_irqn_set_channel_enabled( cfg->tx_dma_irq, cfg->tx_dma_chan, true );
+    irq_set_exclusive_handler( DMA_IRQ_0 + cfg->tx_dma_irq, rmiieth_tx_irq_handler );
+    irq_set_enabled( DMA_IRQ_0 + cfg->tx_dma_irq, true );
 }
 
-static void rmiieth_start_tx( rmiieth_config* cfg, pkt_queue_pkt* p )
+static void RMIIETH_HOT_FUNC( rmiieth_start_tx )( rmiieth_config* cfg, pkt_queue_pkt* p )
 {
-    cfg->tx_current_pkt = p;
-
     // init SM
 //    pio_sm_init( cfg->pio, cfg->tx_sm, cfg->tx_offset, &cfg->tx_config );
 
@@ -244,21 +367,134 @@ static void rmiieth_start_tx( rmiieth_config* cfg, pkt_queue_pkt* p )
     pctrs[ 0 ] = bit_pair_ct - 1;
     pctrs[ 1 ] = extra_bytes - 1;
 
-    printf( "TX: %d bytes\n", p->hdr.data_bytes );
 #if PKT_DEBUG_PRINTS
+    printf( "TX: %d bytes\n", p->hdr.data_bytes );
     pkt_dump( p->data, ( p->hdr.data_bytes + extra_bytes + 8 ), 2048 );
 #endif
 
-    dma_channel_set_read_addr( cfg->tx_dma_chan, p->data, false );
-    dma_channel_set_trans_count( cfg->tx_dma_chan, ( p->hdr.data_bytes + extra_bytes + 8 ) >> 2, true );
+    dma_channel_set_read_addr( RMIIETH_TX_DMA_CHAN( cfg ), p->data, false );
+    dma_channel_set_trans_count( RMIIETH_TX_DMA_CHAN( cfg ), ( p->hdr.data_bytes + extra_bytes + 8 ) >> 2, true );
+}
+
+// NOTE: must hold rx spinlock on entry to this function
+static bool RMIIETH_HOT_FUNC( rmiieth_rx_dma_busy )( rmiieth_config* cfg )
+{
+    if( dma_channel_is_busy( RMIIETH_RX_DMA_CHAN( cfg ) ) )
+    {
+        return( true );
+    }
+
+    // a packet that wraps isn't full until the chained transfer has finished too - and that doesn't show as busy
+    // in the instant between the first channel completing and the chain trigger
+    int32_t     wrap_bytes = cfg->rx_current_pkt->hdr.data_bytes - cfg->rx_current_contig;
+    if( wrap_bytes > 0 )
+    {
+        return( dma_channel_is_busy( RMIIETH_RX_DMA_CHAN2( cfg ) ) ||
+                dma_channel_hw_addr( RMIIETH_RX_DMA_CHAN2( cfg ) )->write_addr != (uintptr_t)( cfg->rx_queue.data + wrap_bytes ) );
+    }
+    return( false );
+}
+
+// NOTE: must hold rx spinlock on entry to this function
+int32_t __time_critical_func(rmiieth_rx_dma_bytes)( rmiieth_config* cfg )
+{
+    pkt_queue_pkt*  pkt = cfg->rx_current_pkt;
+    int32_t         bytes = dma_channel_hw_addr( RMIIETH_RX_DMA_CHAN( cfg ) )->write_addr - (uintptr_t)( pkt->data );
+
+    // if the packet wraps, and the first transfer ran all the way to the end of the ring, the rest is at the start of it
+    if( cfg->rx_current_contig < pkt->hdr.data_bytes && bytes == cfg->rx_current_contig )
+    {
+        bytes += dma_channel_hw_addr( RMIIETH_RX_DMA_CHAN2( cfg ) )->write_addr - (uintptr_t)( cfg->rx_queue.data );
+    }
+    return( bytes );
+}
+
+//
+// shared arena
+//
+// The boundary between the RX and TX queues moves a reservation's worth at a time: towards TX when RX has stalled for
+// lack of space, and towards RX when a TX allocation has failed. Once the side that borrowed the space has gone idle,
+// the boundary drifts back to where it started. A move only happens if both queues' packets fit in their new windows.
+//
+
+static bool RMIIETH_HOT_FUNC( rmiieth_arena_move )( rmiieth_config* cfg, int32_t rx_size )
+{
+    uint8_t*            boundary = cfg->arena_buffer + rx_size;
+    int32_t             tx_size = cfg->arena_size - rx_size;
+    bool                moved = false;
+
+    if( rx_size < cfg->arena_rx_min || tx_size < cfg->arena_tx_min )
+    {
+        return( false );
+    }
+
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    if( pkt_queue_can_rebase( &cfg->rx_queue, cfg->arena_buffer, rx_size ) &&
+        pkt_queue_can_rebase( &cfg->tx_queue, boundary, tx_size ) )
+    {
+        pkt_queue_rebase( &cfg->rx_queue, cfg->arena_buffer, rx_size );
+        pkt_queue_rebase( &cfg->tx_queue, boundary, tx_size );
+        cfg->arena_stats.rx_size = rx_size;
+        cfg->arena_stats.tx_size = tx_size;
+        moved = true;
+    }
+    spin_unlock( cfg->rx_lock, ii );
+    return( moved );
+}
+
+static void RMIIETH_HOT_FUNC( rmiieth_arena_rebalance )( rmiieth_config* cfg )
+{
+    rmiieth_arena_stats*    st = &cfg->arena_stats;
+    int32_t                 step = RX_RESERVE_BYTES( cfg );
+
+    int32_t rx_used = pkt_queue_used_bytes( &cfg->rx_queue );
+    int32_t tx_used = pkt_queue_used_bytes( &cfg->tx_queue );
+    st->rx_high_water = rx_used > st->rx_high_water ? rx_used : st->rx_high_water;
+    st->tx_high_water = tx_used > st->tx_high_water ? tx_used : st->tx_high_water;
+
+    // rmiieth_poll() has just tried to restart RX - if there's still no current packet, it's out of space
+    bool rx_starved = !cfg->rx_current_pkt;
+    bool tx_starved = cfg->tx_alloc_failed;
+    cfg->tx_alloc_failed = false;
+
+    if( rx_starved && !tx_starved )
+    {
+        if( rmiieth_arena_move( cfg, st->rx_size + step ) )
+        {
+            st->rx_borrows++;
+        }
+    }
+    else if( tx_starved && !rx_starved )
+    {
+        if( rmiieth_arena_move( cfg, st->rx_size - step ) )
+        {
+            st->tx_borrows++;
+        }
+    }
+    else if( !rx_starved && !tx_starved )
+    {
+        int32_t target = st->rx_size;
+        if( st->rx_size > cfg->arena_rx_initial && !rmiieth_rx_packet_available( cfg ) )
+        {
+            target = st->rx_size - step > cfg->arena_rx_initial ? st->rx_size - step : cfg->arena_rx_initial;
+        }
+        else if( st->rx_size < cfg->arena_rx_initial && !pkt_queue_peek_pkt( &cfg->tx_queue ) )
+        {
+            target = st->rx_size + step < cfg->arena_rx_initial ? st->rx_size + step : cfg->arena_rx_initial;
+        }
+        if( target != st->rx_size && rmiieth_arena_move( cfg, target ) )
+        {
+            st->returns++;
+        }
+    }
 }
 
-void rmiieth_poll( rmiieth_config* cfg )
+void RMIIETH_HOT_FUNC( rmiieth_poll )( rmiieth_config* cfg )
 {
     // if we filled the current packet, the DMA will have halted - fake an interrupt
     {
         uint32_t ii = spin_lock_blocking( cfg->rx_lock );
-        if( cfg->rx_current_pkt && !dma_channel_is_busy( cfg->rx_dma_chan ) )
+        if( cfg->rx_current_pkt && !rmiieth_rx_dma_busy( cfg ) )
         {
             printf( "*** buffer overrun\n" );
             rmiieth_rx_irq_handler();
@@ -275,91 +511,101 @@ void rmiieth_poll( rmiieth_config* cfg )
         spin_unlock( cfg->rx_lock, ii );
     }
 
-    // consider starting a new TX
-    if( !dma_channel_is_busy( cfg->tx_dma_chan ) )
+    // get a head start on the frame that's arriving
+    if( cfg->rx_cut_through )
     {
-        if( cfg->tx_current_pkt )
-        {
-            pkt_queue_consume_pkt( &cfg->tx_queue );
-            cfg->tx_current_pkt = NULL;
-        }
+        rmiieth_rx_cut_through( cfg );
+    }
 
-        pkt_queue_pkt*      p;
-        p = pkt_queue_peek_pkt( &cfg->tx_queue );
+    // consider starting a new TX
+    if( !dma_channel_is_busy( RMIIETH_TX_DMA_CHAN( cfg ) ) )
+    {
+        pkt_queue_pkt*      p = rmiieth_tx_next( cfg );
         if( p )
         {
             rmiieth_start_tx( cfg, p );
         }
     }
 
+    rmiieth_tx_sample_stats( cfg );
+
+    if( cfg->arena_size )
+    {
+        rmiieth_arena_rebalance( cfg );
+    }
 
-}
 
-bool rmiieth_rx_packet_available( rmiieth_config* cfg )
-{
-    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
-    return( pkt && pkt != cfg->rx_current_pkt );
 }
 
-bool rmiieth_rx_get_packet( rmiieth_config* cfg, uint8_t** pkt_data, int* length )
+static void __time_critical_func(rmiieth_rx_irq_handler)( void )
 {
-    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
-    if( !pkt || pkt == cfg->rx_current_pkt )
+    rmiieth_config*     cfg = g_cfg;
+#if RMIIETH_IRQ_TIMING
+    uint32_t            start_cycles = systick_hw->cvr;
+#endif
+
+    // halt the dma
+    dma_channel_abort( RMIIETH_RX_DMA_CHAN( cfg ) );
+    if( RMIIETH_RX_SPLIT_DMA( cfg ) )
     {
-        return( false );
+        dma_channel_abort( RMIIETH_RX_DMA_CHAN2( cfg ) );
     }
-    *pkt_data = pkt->data;
-    *length = pkt->hdr.data_bytes;
-    return( true );
-}
 
-void rmiieth_rx_consume_packet( rmiieth_config* cfg )
-{
-    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
-    pkt_queue_consume_pkt( &cfg->rx_queue );
-    spin_unlock( cfg->rx_lock, ii );
-}
+    // compute the # of bytes received, and note when
+    pkt_queue_pkt* pkt = cfg->rx_current_pkt;
+    int32_t bytes = rmiieth_rx_dma_bytes( cfg );
+#if PKT_QUEUE_TIMESTAMPS
+    pkt->hdr.timestamp = time_us_32();
+#endif
 
-bool rmiieth_tx_alloc_packet( rmiieth_config* cfg, int length, uint8_t** data )
-{
-    assert( !cfg->tx_current_alloc_pkt );
+    // clear PIO irq
+    RMIIETH_PIO( cfg )->irq = 0x01;
 
-    // allocate 8 extra bytes at front, for the bit/byte counters
-    
-    cfg->tx_current_alloc_pkt = pkt_queue_reserve_pkt( &cfg->tx_queue, length + 8 );
-    if( !cfg->tx_current_alloc_pkt )
+    // filter it, police it, and pick out control frames - see rmiieth_rx_sort()
+    int sort = rmiieth_rx_sort( cfg, pkt, bytes );
+    if( sort != RMIIETH_RX_SORT_COMMIT )
     {
-        return( false );
+        // nothing's been committed, so just receive the next frame into the same space
+        rmiieth_rx_arm( cfg );
+    }
+    else
+    {
+        // the ring has to be truncated before the next reservation can be made
+        if( rmiieth_rx_ct_active( cfg, pkt ) )
+        {
+            cfg->rx_ct_committed = true;
+        }
+        cfg->rx_current_pkt = NULL;
+        pkt_queue_commit_pkt( &cfg->rx_queue, pkt, bytes );
+        rmiieth_rx_try_start( cfg );
     }
-    *data = cfg->tx_current_alloc_pkt->data + 8;
-    return( true );
-}
 
-bool rmiieth_tx_commit_packet( rmiieth_config* cfg, int length )
-{
-    assert( cfg->tx_current_alloc_pkt );
-    pkt_queue_commit_pkt( &cfg->tx_queue, cfg->tx_current_alloc_pkt, length );
-    cfg->tx_current_alloc_pkt = NULL;
+    if( sort != RMIIETH_RX_SORT_DROP && !cfg->rx_polling )
+    {
+        cfg->events |= RMIIETH_EVENT_RX;
+        __sev();
+    }
+
+#if RMIIETH_IRQ_TIMING
+    // SysTick counts down
+    uint32_t cycles = ( start_cycles - systick_hw->cvr ) & 0x00ffffff;
+    cfg->rx_irq_count++;
+    cfg->rx_irq_cycles_last = cycles;
+    if( cycles > cfg->rx_irq_cycles_max )
+    {
+        cfg->rx_irq_cycles_max = cycles;
+    }
+#endif
 }
 
-static void __time_critical_func(rmiieth_rx_irq_handler)( void )
+static void __time_critical_func(rmiieth_tx_irq_handler)( void )
 {
     rmiieth_config*     cfg = g_cfg;
 
-    // halt the dma
-    dma_channel_abort( cfg->rx_dma_chan );
-
-    // read the write address, compute the # of bytes received
-    uintptr_t write_addr = dma_channel_hw_addr( cfg->rx_dma_chan )->write_addr;
-    int32_t bytes = ( write_addr - (uintptr_t)(cfg->rx_current_pkt->data) );
-    pkt_queue_commit_pkt( &cfg->rx_queue, cfg->rx_current_pkt, bytes );
-    cfg->rx_current_pkt = NULL;
-
-    // clear PIO irq
-    cfg->pio->irq = 0x01;
-
-    // try to start a new transfer
-    rmiieth_rx_try_start( cfg );
+    // the next packet is started from rmiieth_poll() - just let the consumer know that it's time to call it
+    dma_irqn_acknowledge_channel( RMIIETH_TX_DMA_IRQ( cfg ), RMIIETH_TX_DMA_CHAN( cfg ) );
+    cfg->events |= RMIIETH_EVENT_TX;
+    __sev();
 }
 
 // NOTE: must hold rx spinlock on entry to this function
@@ -370,19 +616,43 @@ static void __time_critical_func(rmiieth_rx_try_start)( rmiieth_config* cfg )
         return;
     }
 
-    cfg->rx_current_pkt = pkt_queue_reserve_pkt( &cfg->rx_queue, ( cfg->mtu + 52 ) & (~3) );
+    cfg->rx_current_pkt = pkt_queue_reserve_pkt( &cfg->rx_queue, RX_RESERVE_BYTES( cfg ) );
     if( !cfg->rx_current_pkt )
     {
         return;
     }
 
-    pio_sm_init( cfg->pio, cfg->rx_sm, cfg->rx_offset, &cfg->rx_config );
+    rmiieth_rx_arm( cfg );
+}
+
+static void __time_critical_func(rmiieth_rx_arm)( rmiieth_config* cfg )
+{
+    // (whatever was in the packet before is gone - see rmiieth_rx_ct_active)
+    cfg->rx_arm_count++;
+
+    pio_sm_init( RMIIETH_PIO( cfg ), RMIIETH_RX_SM( cfg ), cfg->rx_offset, &cfg->rx_config );
+
+    // split RX - if the packet runs off the end of the ring, chain the second channel to receive the rest
+    int32_t bytes = cfg->rx_current_pkt->hdr.data_bytes;
+    cfg->rx_current_contig = bytes;
+    if( RMIIETH_RX_SPLIT_DMA( cfg ) )
+    {
+        cfg->rx_current_contig = pkt_queue_pkt_contig_bytes( &cfg->rx_queue, cfg->rx_current_pkt );
+        bool wraps = cfg->rx_current_contig < bytes;
+        if( wraps )
+        {
+            dma_channel_set_write_addr( RMIIETH_RX_DMA_CHAN2( cfg ), cfg->rx_queue.data, false );
+            dma_channel_set_trans_count( RMIIETH_RX_DMA_CHAN2( cfg ), ( bytes - cfg->rx_current_contig ) >> 2, false );
+        }
+        channel_config_set_chain_to( &cfg->rx_dma_config, wraps ? RMIIETH_RX_DMA_CHAN2( cfg ) : RMIIETH_RX_DMA_CHAN( cfg ) );
+        dma_channel_set_config( RMIIETH_RX_DMA_CHAN( cfg ), &cfg->rx_dma_config, false );
+    }
 
     // restart the DMA
-    dma_channel_set_write_addr( cfg->rx_dma_chan, cfg->rx_current_pkt->data, false );
-    dma_channel_set_trans_count( cfg->rx_dma_chan, cfg->rx_current_pkt->hdr.data_bytes >> 2, true );
+    dma_channel_set_write_addr( RMIIETH_RX_DMA_CHAN( cfg ), cfg->rx_current_pkt->data, false );
+    dma_channel_set_trans_count( RMIIETH_RX_DMA_CHAN( cfg ), cfg->rx_current_contig >> 2, true );
 
     // restart the state machine
-    pio_sm_set_enabled( cfg->pio, cfg->rx_sm, true );
+    pio_sm_set_enabled( RMIIETH_PIO( cfg ), RMIIETH_RX_SM( cfg ), true );
 }
 
@@ -9,7 +9,78 @@
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "rmiieth_opts.h"
 #include "pkt_queue.h"
+#include "pkt_utils.h"
+
+// event flags, posted by the driver's interrupt handlers - see rmiieth_take_events()
+#define RMIIETH_EVENT_RX                ( 1 << 0 )          // a packet has been received (not posted while polling)
+#define RMIIETH_EVENT_TX                ( 1 << 1 )          // a TX DMA transfer has completed
+
+// RX storm control classes - see rx_storm_control
+#define RMIIETH_STORM_BROADCAST         ( 0 )
+#define RMIIETH_STORM_MULTICAST         ( 1 )
+#define RMIIETH_STORM_UNKNOWN_UNICAST   ( 2 )               // unicast for another host (only seen when promiscuous)
+#define RMIIETH_STORM_CLASSES           ( 3 )
+
+// TX classes - see rmiieth_tx_alloc_packet_class()
+#define RMIIETH_TX_CLASS_CTRL           ( 0 )               // ARP, ICMP, DHCP, bare TCP ACKs - latency sensitive, and small
+#define RMIIETH_TX_CLASS_BULK           ( 1 )               // everything else
+#define RMIIETH_TX_CLASSES              ( 2 )
+
+// TX schedulers
+#define RMIIETH_TX_SCHED_STRICT         ( 0 )               // a queued control packet always goes next
+#define RMIIETH_TX_SCHED_WEIGHTED       ( 1 )               // up to tx_ctrl_weight control packets go for each bulk packet
+
+typedef struct
+{
+    uint8_t*        data;
+    int             length;
+    uint8_t*        wrap_data;                              // split RX: where the packet continues once it reaches the end of the ring (NULL if it doesn't)
+    int             wrap_offset;                            // split RX: offset within the packet at which it continues at wrap_data
+    int             validated;                              // cut-through: 1 if already validated (length is the frame length), -1 if it failed, 0 if not done
+    uint32_t        timestamp_us;                           // when the frame finished arriving (time_us_32() - 0 unless PKT_QUEUE_TIMESTAMPS is set)
+} rmiieth_rx_frame;
+
+// raw-frame consumers - see rmiieth_register_ethertype()
+#define RMIIETH_MAX_ETHERTYPE_HANDLERS  ( 4 )
+
+typedef void (*rmiieth_ethertype_fn)( void* ctx, const rmiieth_rx_frame* frame );
+
+typedef struct
+{
+    uint16_t                ethertype;
+    rmiieth_ethertype_fn    fn;                             // NULL if this entry is free
+    void*                   ctx;
+} rmiieth_ethertype_handler;
+
+typedef struct
+{
+    int32_t         rx_size;                                // current RX share of the arena
+    int32_t         tx_size;                                // current TX share of the arena
+    uint32_t        rx_borrows;                             // # of times RX has grown into TX space
+    uint32_t        tx_borrows;                             // # of times TX has grown into RX space
+    uint32_t        returns;                                // # of times borrowed space has been handed back
+    int32_t         rx_high_water;                          // max RX bytes in use (sampled by rmiieth_poll)
+    int32_t         tx_high_water;                          // max TX bytes in use (sampled by rmiieth_poll)
+} rmiieth_arena_stats;
+
+typedef struct
+{
+    uint32_t        sent;                                   // # of packets sent
+    uint32_t        dropped;                                // # of packets that couldn't be queued
+    int32_t         used;                                   // bytes currently queued (sampled by rmiieth_poll)
+    int32_t         high_water;                             // max bytes queued (sampled by rmiieth_poll)
+} rmiieth_tx_class_stats;
+
+typedef struct
+{
+    uint32_t        tokens;                                 // frames allowed, in millionths of a frame
+    uint32_t        last_us;                                // when the bucket was last topped up
+    uint32_t        passed;                                 // # of frames let through
+    uint32_t        dropped;                                // # of frames over the limit
+} rmiieth_storm_policer;
 
 typedef struct
 {
@@ -32,7 +103,33 @@ typedef struct
     uint8_t*        tx_queue_buffer;                        // either pass in a buffer, or NULL to have rmiieth_init() malloc one
     int32_t         tx_queue_buffer_size;                   // TX queue size
     int             rx_irq;                                 // RX IRQ number
+    int             tx_dma_irq;                             // DMA IRQ (0 or 1) used to signal TX completion
     int             mtu;                                    // max packet size
+    int             rx_poll_budget;                         // max packets to process per poll, before yielding
+    bool            rx_split_dma;                           // let packets wrap around the end of the RX ring, using a second DMA channel
+    int             rx_dma_chan2;                           // split RX: dma channel id for the part of a packet after the wrap
+    uint8_t*        arena_buffer;                           // shared RX/TX arena - pass in a buffer, or NULL to have rmiieth_init() malloc one
+    int32_t         arena_size;                             // shared RX/TX arena size (0 = separate RX and TX queue buffers)
+    int32_t         arena_rx_min;                           // arena: RX share never shrinks below this
+    int32_t         arena_tx_min;                           // arena: TX share never shrinks below this
+    uint8_t         mac_addr[ 6 ];                          // our MAC address - used by the RX filter
+    bool            rx_promiscuous;                         // accept every frame, rather than just those for mac_addr/broadcast/multicast
+    bool            rx_all_multicast;                       // accept every multicast frame, rather than just the groups added with rmiieth_rx_mcast_add()
+    bool            flow_control;                           // send 802.3x PAUSE frames as the RX ring fills up
+    int             rx_pause_high_pct;                      // flow control: pause the link partner once the RX ring is this % full
+    int             rx_pause_low_pct;                       // flow control: ... and let it resume once it's back down to this %
+    uint16_t        pause_quanta;                           // flow control: pause time to request, in 512-bit times
+    uint8_t*        rx_ctrl_queue_buffer;                   // either pass in a buffer, or NULL to have rmiieth_init() malloc one
+    int32_t         rx_ctrl_queue_size;                     // control-plane RX queue size (0 = ARP/ICMP/DHCP share the main RX queue)
+    int32_t         rx_ctrl_max_bytes;                      // control-plane RX: larger frames are treated as bulk
+    uint8_t*        tx_ctrl_queue_buffer;                   // either pass in a buffer, or NULL to have rmiieth_init() malloc one
+    int32_t         tx_ctrl_queue_size;                     // control TX queue size (0 = all classes share the TX queue)
+    int             tx_sched;                               // RMIIETH_TX_SCHED_xxx
+    int             tx_ctrl_weight;                         // weighted scheduling: control packets sent per bulk packet, when both are waiting
+    bool            rx_storm_control;                       // police broadcast/multicast/unknown unicast frames in the RX interrupt
+    uint32_t        rx_storm_rate[ RMIIETH_STORM_CLASSES ]; // storm control: sustained frames/sec allowed, per RMIIETH_STORM_xxx class (0 = no limit)
+    uint32_t        rx_storm_burst[ RMIIETH_STORM_CLASSES ];// storm control: frames allowed back-to-back (max 4000)
+    bool            rx_cut_through;                         // realign and check frames from rmiieth_poll() while they're still arriving
 
     // state
     uint8_t         clk_offset;
@@ -47,9 +144,46 @@ typedef struct
     spin_lock_t*    rx_lock;                                // spinlock for accessing RX queue
     pkt_queue       rx_queue;                               // the RX queue
     pkt_queue_pkt*  rx_current_pkt;                         // RX packet currently being received (NULL if stalled)
+    int32_t         rx_current_contig;                      // bytes of rx_current_pkt before the end of the ring
+    dma_channel_config rx_dma_config;                       // RX DMA config (split RX re-chains it per packet)
     pkt_queue       tx_queue;                               // the TX queue
     pkt_queue_pkt*  tx_current_pkt;                         // TX packet currently being transmitted
     pkt_queue_pkt*  tx_current_alloc_pkt;                   // TX packet currently allocated
+    int32_t         arena_rx_initial;                       // arena: initial RX share, which borrowed space drifts back to
+    bool            tx_alloc_failed;                        // a TX allocation has failed since the last rebalance
+    rmiieth_arena_stats arena_stats;
+    uint32_t        rx_filtered;                            // # of frames dropped by the RX filter
+    uint32_t        rx_mcast_hash[ 2 ];                     // multicast filter - 64 bins, indexed by the top 6 bits of the address' CRC
+    uint8_t         rx_mcast_refs[ 64 ];                    // multicast filter - # of groups in each bin
+    bool            rx_paused;                              // flow control: we've asked the link partner to pause
+    uint32_t        rx_pause_sent_us;                       // flow control: when the last PAUSE frame was sent
+    uint32_t        pause_frames_sent;                      // flow control: # of PAUSE frames sent (including refreshes)
+    uint32_t        resume_frames_sent;                     // flow control: # of zero-time PAUSE frames sent
+    pkt_queue       rx_ctrl_queue;                          // control-plane RX queue
+    uint32_t        rx_ctrl_frames;                         // control-plane RX: # of frames received
+    uint32_t        rx_ctrl_dropped;                        // control-plane RX: # of frames dropped because rx_ctrl_queue was full
+    uint32_t        rx_bulk_dropped;                        // control-plane RX: # of bulk frames dropped to keep room for control frames
+    pkt_queue       tx_ctrl_queue;                          // TX queue for RMIIETH_TX_CLASS_CTRL
+    int             tx_current_class;                       // class of tx_current_pkt (-1 for a PAUSE frame)
+    int             tx_current_alloc_class;                 // class of tx_current_alloc_pkt
+    int             tx_ctrl_run;                            // weighted scheduling: control packets sent since the last bulk packet
+    rmiieth_tx_class_stats tx_class_stats[ RMIIETH_TX_CLASSES ];
+    rmiieth_storm_policer rx_storm[ RMIIETH_STORM_CLASSES ];
+    rmiieth_ethertype_handler ethertype_handlers[ RMIIETH_MAX_ETHERTYPE_HANDLERS ];
+    uint32_t        rx_dispatched;                          // # of frames passed to an EtherType handler
+    uint32_t        rx_arm_count;                           // # of times the RX DMA has been (re)started
+    pkt_progress    rx_ct;                                  // cut-through: validation progress through rx_ct_pkt
+    pkt_queue_pkt*  rx_ct_pkt;                              // cut-through: the packet rx_ct refers to (NULL if none)
+    uint32_t        rx_ct_arm;                              // cut-through: rx_arm_count when rx_ct_pkt was started
+    bool            rx_ct_committed;                        // cut-through: the IRQ has committed rx_ct_pkt, and only the tail is left to do
+    pkt_queue_pkt*  rx_ct_done_pkt;                         // cut-through: last packet fully validated (NULL once consumed)
+    int             rx_ct_done_length;                      // cut-through: its frame length, or -1 if it failed
+    uint32_t        rx_ct_frames;                           // cut-through: # of frames validated ahead of the consumer
+    volatile uint32_t events;                               // RMIIETH_EVENT_xxx flags posted since the last rmiieth_take_events()
+    volatile bool   rx_polling;                             // consumer is polling - RX notifications are suppressed
+    uint32_t        rx_irq_count;                           // RMIIETH_IRQ_TIMING: # of RX interrupts timed
+    uint32_t        rx_irq_cycles_last;                     // RMIIETH_IRQ_TIMING: cycles spent in the last RX interrupt
+    uint32_t        rx_irq_cycles_max;                      // RMIIETH_IRQ_TIMING: worst case cycles spent in an RX interrupt
 
 } rmiieth_config;
 
@@ -62,8 +196,21 @@ extern void rmiieth_poll( rmiieth_config* cfg );
 extern bool rmiieth_rx_packet_available( rmiieth_config* cfg );
 extern bool rmiieth_rx_get_packet( rmiieth_config* cfg, uint8_t** pkt, int* length );
 extern void rmiieth_rx_consume_packet( rmiieth_config* cfg );
+extern int  rmiieth_rx_get_packets( rmiieth_config* cfg, rmiieth_rx_frame* frames, int max_frames );
+extern void rmiieth_rx_consume_packets( rmiieth_config* cfg, int count );
+extern int  rmiieth_rx_ctrl_get_packets( rmiieth_config* cfg, rmiieth_rx_frame* frames, int max_frames );
+extern void rmiieth_rx_ctrl_consume_packets( rmiieth_config* cfg, int count );
 extern bool rmiieth_tx_alloc_packet( rmiieth_config* cfg, int length, uint8_t** data );
+extern bool rmiieth_tx_alloc_packet_class( rmiieth_config* cfg, int tx_class, int length, uint8_t** data );
 extern bool rmiieth_tx_commit_packet( rmiieth_config* cfg, int length );
+extern uint32_t rmiieth_take_events( rmiieth_config* cfg );
+extern void rmiieth_rx_set_polling( rmiieth_config* cfg, bool polling );
+extern bool rmiieth_rx_in_progress( rmiieth_config* cfg );
+extern void rmiieth_rx_mcast_add( rmiieth_config* cfg, const uint8_t* mac );
+extern void rmiieth_rx_mcast_remove( rmiieth_config* cfg, const uint8_t* mac );
+extern bool rmiieth_register_ethertype( rmiieth_config* cfg, uint16_t ethertype, rmiieth_ethertype_fn fn, void* ctx );
+extern void rmiieth_unregister_ethertype( rmiieth_config* cfg, uint16_t ethertype );
+extern bool rmiieth_rx_dispatch( rmiieth_config* cfg, const rmiieth_rx_frame* frame );
 
 
 
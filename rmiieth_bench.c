@@ -0,0 +1,138 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_bench.h"
+#include "pkt_utils.h"
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include <string.h>
+#include <stdio.h>
+
+#define BENCH_FRAME_BYTES       1514
+#define BENCH_RAW_BYTES         ( 1 + 8 + BENCH_FRAME_BYTES + 4 + 4 )
+#define BENCH_ITERATIONS        200
+#define BENCH_DMA_RING_BITS     10                          // DMA target is a 1K ring
+
+static uint8_t  g_bench_raw[ BENCH_RAW_BYTES ];             // template received frame (preamble, 1 dibit out of phase)
+static uint8_t  g_bench_work[ BENCH_RAW_BYTES ];
+static uint8_t  g_bench_dst[ BENCH_RAW_BYTES ];
+static uint32_t g_bench_dma_striped[ 1 << ( BENCH_DMA_RING_BITS - 2 ) ] __attribute__((aligned( 1 << BENCH_DMA_RING_BITS )));
+static uint32_t g_bench_dma_sram4[ 1 << ( BENCH_DMA_RING_BITS - 2 ) ] __scratch_x( "rmiieth_bench" ) __attribute__((aligned( 1 << BENCH_DMA_RING_BITS )));
+
+typedef enum { BENCH_COPY, BENCH_CHECKSUM_COPY, BENCH_VALIDATE } bench_op;
+
+static void bench_build_raw_frame( void )
+{
+    uint8_t     frame[ 8 + BENCH_FRAME_BYTES + 4 ];
+    int         len = 0;
+
+    for( int i = 0 ; i < 7 ; i++ )
+    {
+        frame[ len++ ] = 0x55;
+    }
+    frame[ len++ ] = 0xd5;
+    for( int i = 0 ; i < BENCH_FRAME_BYTES ; i++ )
+    {
+        frame[ len++ ] = (uint8_t)( i * 7 + 1 );
+    }
+    uint32_t    fcs = pkt_generate_fcs( &frame[ 8 ], BENCH_FRAME_BYTES );
+    frame[ len++ ] = (uint8_t)( fcs >>  0 );
+    frame[ len++ ] = (uint8_t)( fcs >>  8 );
+    frame[ len++ ] = (uint8_t)( fcs >> 16 );
+    frame[ len++ ] = (uint8_t)( fcs >> 24 );
+
+    // the RX state machine starts capturing at an arbitrary dibit - shift everything up by one
+    memset( g_bench_raw, 0, sizeof( g_bench_raw ) );
+    for( int i = 0 ; i < len ; i++ )
+    {
+        g_bench_raw[ i + 1 ] |= (uint8_t)( frame[ i ] << 2 );
+        g_bench_raw[ i + 2 ] |= (uint8_t)( frame[ i ] >> 6 );
+    }
+}
+
+// returns the average time for one operation, in ns
+static uint32_t bench_run_op( bench_op op )
+{
+    uint64_t    total_us = 0;
+
+    for( int i = 0 ; i < BENCH_ITERATIONS ; i++ )
+    {
+        memcpy( g_bench_work, g_bench_raw, sizeof( g_bench_raw ) );
+
+        uint32_t    t0 = time_us_32();
+        switch( op )
+        {
+            case BENCH_COPY:
+                memcpy( g_bench_dst, g_bench_work, BENCH_FRAME_BYTES );
+                break;
+            case BENCH_CHECKSUM_COPY:
+                pkt_checksum_copy( g_bench_dst, g_bench_work, BENCH_FRAME_BYTES, 0 );
+                break;
+            case BENCH_VALIDATE:
+            {
+                int     len = sizeof( g_bench_work );
+                if( !pkt_validate( g_bench_work, &len ) || len != BENCH_FRAME_BYTES )
+                {
+                    printf( "bench: validate failed\n" );
+                }
+                break;
+            }
+        }
+        total_us += time_us_32() - t0;
+    }
+    return( (uint32_t)( ( total_us * 1000 ) / BENCH_ITERATIONS ) );
+}
+
+static void bench_start_dma( int chan, int timer, uint32_t* target, bool paced )
+{
+    dma_channel_config  c = dma_channel_get_default_config( chan );
+    channel_config_set_read_increment( &c, false );
+    channel_config_set_write_increment( &c, true );
+    channel_config_set_ring( &c, true, BENCH_DMA_RING_BITS );
+    channel_config_set_transfer_data_size( &c, DMA_SIZE_32 );
+    channel_config_set_dreq( &c, paced ? dma_get_timer_dreq( timer ) : DREQ_FORCE );
+
+    // read from the bootrom, so that only the writes touch SRAM
+    dma_channel_configure( chan, &c, target, (const void*)0x00000000, 0xffffffff, true );
+}
+
+void rmiieth_bench_bus_contention( void )
+{
+    static const char*  op_names[] = { "copy", "checksum+copy", "validate" };
+    static const char*  dma_names[] = { "no DMA", "striped, paced", "SRAM4, paced", "striped, unpaced", "SRAM4, unpaced" };
+
+    int         chan = dma_claim_unused_channel( true );
+    int         timer = dma_claim_unused_timer( true );
+
+    // one word every 80 cycles - the RX DMA rate at 100Mbit/sec, with a 250MHz system clock
+    dma_timer_set_fraction( timer, 1, 80 );
+
+    bench_build_raw_frame();
+
+    printf( "bus contention benchmark (%d byte frame, ns per operation):\n", BENCH_FRAME_BYTES );
+    printf( "%-18s %10s %14s %10s\n", "", op_names[ 0 ], op_names[ 1 ], op_names[ 2 ] );
+
+    for( int d = 0 ; d < 5 ; d++ )
+    {
+        if( d )
+        {
+            bench_start_dma( chan, timer, ( d & 1 ) ? g_bench_dma_striped : g_bench_dma_sram4, d < 3 );
+        }
+
+        unsigned    ns[ 3 ];
+        for( int op = 0 ; op < 3 ; op++ )
+        {
+            ns[ op ] = bench_run_op( (bench_op)op );
+        }
+
+        if( d )
+        {
+            dma_channel_abort( chan );
+        }
+        printf( "%-18s %10u %14u %10u\n", dma_names[ d ], ns[ 0 ], ns[ 1 ], ns[ 2 ] );
+    }
+
+    dma_timer_unclaim( timer );
+    dma_channel_unclaim( chan );
+}
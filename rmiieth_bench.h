@@ -0,0 +1,25 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_BENCH_H
+#define RMIIETH_BENCH_H
+
+/*
+ * rmiieth_bench_bus_contention
+ *
+ * Measures how much a concurrent DMA stream slows down the CPU's per-packet work - copying a 1514-byte frame (plain,
+ * and with the checksum accumulated), and validating a raw received frame (preamble search/realign and FCS) - with
+ * the DMA writing into the striped main SRAM (where malloc'd queue buffers live) versus SRAM4 (where
+ * RMIIETH_STATIC_BUFFERS puts the RX ring). The CPU's buffers are in striped SRAM in every case.
+ *
+ * The DMA runs both at the rate the RX DMA actually runs at (one word per 80 cycles, i.e. 100Mbit/sec at 250MHz),
+ * and unpaced, as a worst case.
+ *
+ * Call it before rmiieth_init() - it claims a DMA channel and timer of its own, and prints the results.
+ */
+
+extern void rmiieth_bench_bus_contention( void );
+
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_BOARD_DEFAULT_H
+#define RMIIETH_BOARD_DEFAULT_H
+
+/*
+ * Example board definition (see RMIIETH_BOARD_CONFIG in rmiieth_opts.h) - fixes the same resources and sizes that
+ * rmiieth_set_default_config() uses, so that the hot paths can be constant-folded.
+ *
+ * The clock SM is claimed first, so the RX SM needs to be something other than the first free SM.
+ */
+
+#define RMIIETH_BOARD_PIO               pio0
+#define RMIIETH_BOARD_RX_SM             1
+#define RMIIETH_BOARD_RX_DMA_CHAN       0
+#define RMIIETH_BOARD_RX_DMA_CHAN2      2
+#define RMIIETH_BOARD_TX_DMA_CHAN       1
+#define RMIIETH_BOARD_TX_DMA_IRQ        0
+#define RMIIETH_BOARD_MTU               1500
+#define RMIIETH_BOARD_RX_SPLIT_DMA      false
+
+
+#endif
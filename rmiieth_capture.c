@@ -0,0 +1,207 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_capture.h"
+#include <string.h>
+
+// pcapng block types and options
+#define PCAPNG_SHB              ( 0x0a0d0d0a )
+#define PCAPNG_IDB              ( 0x00000001 )
+#define PCAPNG_EPB              ( 0x00000006 )
+#define PCAPNG_BYTE_ORDER       ( 0x1a2b3c4d )
+#define PCAPNG_LINKTYPE_ETH     ( 1 )
+#define PCAPNG_OPT_END          ( 0 )
+#define PCAPNG_EPB_FLAGS        ( 2 )
+#define PCAPNG_EPB_DROPCOUNT    ( 4 )
+#define PCAPNG_FLAG_INBOUND     ( 1 )
+#define PCAPNG_FLAG_OUTBOUND    ( 2 )
+
+#define EPB_FIXED_BYTES         ( 28 + 4 )                  // header + trailing length
+
+//
+// ring - the producer only moves head, and the consumer only moves tail
+//
+
+static inline uint32_t ring_free( rmiieth_capture* cap )
+{
+    return( cap->size - ( cap->head - cap->tail ) );
+}
+
+// write at head + ofs, wrapping around the end of the buffer
+static void RMIIETH_HOT_FUNC( ring_write )( rmiieth_capture* cap, uint32_t ofs, const void* data, int length )
+{
+    uint32_t    pos = ( cap->head + ofs ) & ( cap->size - 1 );
+    uint32_t    contig = cap->size - pos;
+    if( contig >= (uint32_t)length )
+    {
+        memcpy( &cap->buffer[ pos ], data, length );
+    }
+    else
+    {
+        memcpy( &cap->buffer[ pos ], data, contig );
+        memcpy( &cap->buffer[ 0 ], (const uint8_t*)data + contig, length - contig );
+    }
+}
+
+static inline void ring_write32( rmiieth_capture* cap, uint32_t ofs, uint32_t v )
+{
+    ring_write( cap, ofs, &v, 4 );
+}
+
+// make a block visible to the consumer - only once it has been completely written
+static inline void ring_publish( rmiieth_capture* cap, uint32_t length )
+{
+    __dmb();
+    cap->head += length;
+}
+
+void rmiieth_capture_init( rmiieth_capture* cap, uint8_t* buffer, uint32_t size, rmiieth_capture_sink sink, void* sink_ctx )
+{
+    assert( size && !( size & ( size - 1 ) ) );
+
+    memset( cap, 0, sizeof( rmiieth_capture ) );
+    cap->buffer = buffer;
+    cap->size = size;
+    cap->sink = sink;
+    cap->sink_ctx = sink_ctx;
+    cap->snap_len = 1514;
+    cap->tx_enabled = false;
+    cap->last_timestamp = time_us_64();                     // the first frame is only extended from here
+
+    // section header - version 1.0, unknown section length
+    ring_write32( cap, 0, PCAPNG_SHB );
+    ring_write32( cap, 4, 28 );
+    ring_write32( cap, 8, PCAPNG_BYTE_ORDER );
+    ring_write32( cap, 12, 0x00000001 );
+    ring_write32( cap, 16, 0xffffffff );
+    ring_write32( cap, 20, 0xffffffff );
+    ring_write32( cap, 24, 28 );
+    ring_publish( cap, 28 );
+
+    // one ethernet interface - microsecond timestamps are the default
+    ring_write32( cap, 0, PCAPNG_IDB );
+    ring_write32( cap, 4, 20 );
+    ring_write32( cap, 8, PCAPNG_LINKTYPE_ETH );
+    ring_write32( cap, 12, cap->snap_len );
+    ring_write32( cap, 16, 20 );
+    ring_publish( cap, 20 );
+}
+
+//
+// producer
+//
+
+static bool RMIIETH_HOT_FUNC( capture_frame )( rmiieth_capture* cap, uint32_t flags, uint32_t timestamp_us,
+                                              const uint8_t* data, int contig, const uint8_t* wrap, int length )
+{
+    int         cap_len = ( length < cap->snap_len ) ? length : cap->snap_len;
+    uint32_t    pad_len = ( cap_len + 3 ) & (~3);
+    uint32_t    opt_len = 8 + ( cap->pending_drops ? 12 : 0 ) + 4;
+    uint32_t    block_len = EPB_FIXED_BYTES + pad_len + opt_len;
+
+    if( ring_free( cap ) < block_len )
+    {
+        cap->pending_drops++;
+        cap->dropped++;
+        return( false );
+    }
+
+    // extend the timestamp to 64 bits - frames aren't always captured in timestamp order (RX frames are stamped
+    // by the IRQ), so go by the signed difference
+    cap->last_timestamp += (int32_t)( timestamp_us - (uint32_t)cap->last_timestamp );
+
+    ring_write32( cap, 0, PCAPNG_EPB );
+    ring_write32( cap, 4, block_len );
+    ring_write32( cap, 8, 0 );                                                  // interface
+    ring_write32( cap, 12, (uint32_t)( cap->last_timestamp >> 32 ) );
+    ring_write32( cap, 16, (uint32_t)( cap->last_timestamp >>  0 ) );
+    ring_write32( cap, 20, cap_len );
+    ring_write32( cap, 24, length );
+
+    // the frame may be split across the end of the RX ring
+    int         first = ( contig < cap_len ) ? contig : cap_len;
+    ring_write( cap, 28, data, first );
+    if( cap_len > first )
+    {
+        ring_write( cap, 28 + first, wrap, cap_len - first );
+    }
+    if( pad_len > (uint32_t)cap_len )
+    {
+        uint32_t    zero = 0;
+        ring_write( cap, 28 + cap_len, &zero, pad_len - cap_len );
+    }
+
+    uint32_t    ofs = 28 + pad_len;
+    ring_write32( cap, ofs + 0, PCAPNG_EPB_FLAGS | ( 4 << 16 ) );
+    ring_write32( cap, ofs + 4, flags );
+    ofs += 8;
+    if( cap->pending_drops )
+    {
+        ring_write32( cap, ofs + 0, PCAPNG_EPB_DROPCOUNT | ( 8 << 16 ) );
+        ring_write32( cap, ofs + 4, cap->pending_drops );
+        ring_write32( cap, ofs + 8, 0 );
+        ofs += 12;
+        cap->pending_drops = 0;
+    }
+    ring_write32( cap, ofs, PCAPNG_OPT_END );
+    ring_write32( cap, ofs + 4, block_len );
+
+    ring_publish( cap, block_len );
+    cap->captured++;
+    return( true );
+}
+
+// a validated RX frame - as passed to rmiieth_rx_dispatch(). Without PKT_QUEUE_TIMESTAMPS, the driver doesn't stamp
+// frames as they arrive, so they're stamped as they're captured instead
+bool RMIIETH_HOT_FUNC( rmiieth_capture_rx )( rmiieth_capture* cap, const rmiieth_rx_frame* frame )
+{
+    int         contig = frame->wrap_data ? frame->wrap_offset : frame->length;
+#if PKT_QUEUE_TIMESTAMPS
+    uint32_t    timestamp_us = frame->timestamp_us;
+#else
+    uint32_t    timestamp_us = time_us_32();
+#endif
+    return( capture_frame( cap, PCAPNG_FLAG_INBOUND, timestamp_us, frame->data, contig, frame->wrap_data, frame->length ) );
+}
+
+// an outgoing frame, without preamble or FCS
+bool RMIIETH_HOT_FUNC( rmiieth_capture_tx )( rmiieth_capture* cap, const uint8_t* frame, int length )
+{
+    if( !cap->tx_enabled )
+    {
+        return( false );
+    }
+    return( capture_frame( cap, PCAPNG_FLAG_OUTBOUND, time_us_32(), frame, length, NULL, length ) );
+}
+
+//
+// consumer
+//
+
+void rmiieth_capture_drain( rmiieth_capture* cap )
+{
+    while( true )
+    {
+        uint32_t    head = cap->head;
+        __dmb();
+
+        uint32_t    avail = head - cap->tail;
+        if( !avail )
+        {
+            return;
+        }
+        uint32_t    pos = cap->tail & ( cap->size - 1 );
+        uint32_t    contig = cap->size - pos;
+        int         sent = cap->sink( cap->sink_ctx, &cap->buffer[ pos ], ( avail < contig ) ? avail : contig );
+        if( sent <= 0 )
+        {
+            return;
+        }
+
+        // the bytes must have been read before the producer can re-use them
+        __dmb();
+        cap->tail += sent;
+        cap->bytes_sent += sent;
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_CAPTURE_H
+#define RMIIETH_CAPTURE_H
+
+#include "rmiieth.h"
+
+/*
+ * rmiieth_capture
+ *
+ * Mirrors frames into a ring buffer as pcapng Enhanced Packet Blocks, and streams them to the host through a sink
+ * callback (UART, USB CDC...). The stream starts with a Section Header Block and an Interface Description Block, so
+ * the host can simply write it to a .pcapng file - rmiieth_capture.py does that, and copes with anything else (boot
+ * messages, say) that ends up on the same link.
+ *
+ * The ring is single-producer/single-consumer, without locks - frames are added from the RX/TX path, and the ring is
+ * drained from somewhere that can afford to wait for the link, such as the other core:
+ *
+ *      rmiieth_capture_init( &cap, buffer, size, sink, sink_ctx );
+ *
+ *      rmiieth_capture_rx( &cap, frame );                      // producer - after validation
+ *      rmiieth_capture_tx( &cap, frame_data, frame_len );      // producer - optional
+ *
+ *      rmiieth_capture_drain( &cap );                          // consumer - call repeatedly
+ *
+ * If the ring is too full for a frame, it's dropped and counted - the next frame that is captured carries the count
+ * in its epb_dropcount option, so the gap shows up in Wireshark.
+ *
+ * Note: the buffer size must be a power of 2.
+ * Note: only validated frames are captured - the driver needs rx_promiscuous set, to see other hosts' traffic.
+ * Note: RX frames carry the time they arrived only if PKT_QUEUE_TIMESTAMPS is set (see pkt_queue.h) - otherwise they're
+ *       stamped when they're captured.
+ */
+
+// returns the # of bytes the sink accepted - it may accept fewer than it was offered (or none), rather than block
+typedef int (*rmiieth_capture_sink)( void* ctx, const uint8_t* data, int length );
+
+typedef struct
+{
+    uint8_t*                buffer;
+    uint32_t                size;                           // ring size (power of 2)
+    volatile uint32_t       head;                           // written by the producer only - free-running
+    volatile uint32_t       tail;                           // written by the consumer only - free-running
+    rmiieth_capture_sink    sink;
+    void*                   sink_ctx;
+    int                     snap_len;                       // frames are truncated to this many bytes (set by rmiieth_capture_init())
+    bool                    tx_enabled;                     // mirror transmitted frames too
+    uint64_t                last_timestamp;                 // producer: last timestamp, extended to 64 bits (starts at time_us_64())
+    uint32_t                pending_drops;                  // producer: frames dropped since the last one captured
+    uint32_t                captured;                       // # of frames captured
+    uint32_t                dropped;                        // # of frames dropped because the ring was full
+    uint32_t                bytes_sent;                     // # of bytes handed to the sink
+} rmiieth_capture;
+
+
+extern void rmiieth_capture_init( rmiieth_capture* cap, uint8_t* buffer, uint32_t size, rmiieth_capture_sink sink, void* sink_ctx );
+extern bool rmiieth_capture_rx( rmiieth_capture* cap, const rmiieth_rx_frame* frame );
+extern bool rmiieth_capture_tx( rmiieth_capture* cap, const uint8_t* frame, int length );
+extern void rmiieth_capture_drain( rmiieth_capture* cap );
+
+
+#endif
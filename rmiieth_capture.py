@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+#
+# (c) 2021 Ben Stragnell
+#
+# Host side of rmiieth_capture - turns the pcapng stream from the capture UART (or a raw dump of it) into a .pcapng
+# file that Wireshark can open.
+#
+# The stream is written to the file block by block, once each block has been checked - anything before the first
+# Section Header Block (boot messages, say) is skipped, and if a block is corrupted in transit, the reader scans
+# forward for the next good one.
+#
+#     rmiieth_capture.py --port /dev/ttyUSB0 -o capture.pcapng       (needs pyserial - stop with ctrl-c)
+#     rmiieth_capture.py --input dump.bin -o capture.pcapng
+#     rmiieth_capture.py --self-test
+#
+
+import argparse
+import struct
+import sys
+
+SHB = 0x0a0d0d0a
+IDB = 0x00000001
+EPB = 0x00000006
+BYTE_ORDER = 0x1a2b3c4d
+OPT_END = 0
+EPB_FLAGS = 2
+EPB_DROPCOUNT = 4
+MAX_BLOCK = 65536 + 64
+
+
+class Reader:
+    """Splits a byte stream into pcapng blocks - feed() it bytes as they arrive."""
+
+    def __init__(self, out):
+        self.out = out
+        self.buf = bytearray()
+        self.endian = None                      # '<' or '>' once we've seen a section header
+        self.have_idb = False
+        self.sections = 0
+        self.frames = 0
+        self.dropped = 0                        # frames the device couldn't fit in its ring (epb_dropcount)
+        self.skipped = 0                        # bytes of garbage skipped
+
+    def feed(self, data):
+        self.buf += data
+        while self.next_block():
+            pass
+
+    # end of the stream - anything left is either a block that was cut short, or garbage that looked like the start
+    # of one, so keep rescanning a byte further on
+    def finish(self):
+        while self.buf:
+            if not self.next_block():
+                self.skip(1)
+
+    def skip(self, count):
+        self.skipped += count
+        del self.buf[:count]
+
+    # returns True if it made progress, False if it needs more data
+    def next_block(self):
+        if len(self.buf) < 12:
+            return False
+
+        # a section header can turn up at any time (the device was reset) - and tells us the byte order
+        if self.buf[0:4] == b'\x0a\x0d\x0d\x0a':
+            bom = self.buf[8:12]
+            endian = '<' if bom == b'\x4d\x3c\x2b\x1a' else '>' if bom == b'\x1a\x2b\x3c\x4d' else None
+            if endian:
+                length = struct.unpack(endian + 'I', self.buf[4:8])[0]
+                if length < 28 or length % 4 or length > MAX_BLOCK:
+                    self.skip(1)
+                    return True
+                if len(self.buf) < length:
+                    return False
+                if struct.unpack(endian + 'I', self.buf[length - 4:length])[0] != length:
+                    self.skip(1)
+                    return True
+                self.endian = endian
+                self.have_idb = False
+                self.sections += 1
+                self.emit(length)
+                return True
+
+        if not self.endian:
+            self.skip(1)
+            return True
+
+        block_type, length = struct.unpack(self.endian + 'II', self.buf[0:8])
+        if block_type not in (IDB, EPB) or length < 12 or length % 4 or length > MAX_BLOCK:
+            self.skip(1)
+            return True
+        if len(self.buf) < length:
+            return False
+        if struct.unpack(self.endian + 'I', self.buf[length - 4:length])[0] != length:
+            self.skip(1)
+            return True
+
+        if block_type == IDB:
+            self.have_idb = True
+        elif not self.have_idb or not self.check_epb(length):
+            # a packet we can't attribute to an interface would make the file invalid
+            self.skip(1)
+            return True
+        else:
+            self.frames += 1
+        self.emit(length)
+        return True
+
+    def check_epb(self, length):
+        if length < 32:
+            return False
+        cap_len = struct.unpack(self.endian + 'I', self.buf[20:24])[0]
+        pos = 28 + ((cap_len + 3) & ~3)
+        if pos + 4 > length:
+            return False
+        while pos + 4 <= length - 4:
+            code, opt_len = struct.unpack(self.endian + 'HH', self.buf[pos:pos + 4])
+            if code == OPT_END:
+                break
+            if code == EPB_DROPCOUNT and opt_len == 8:
+                self.dropped += struct.unpack(self.endian + 'Q', self.buf[pos + 4:pos + 12])[0]
+            pos += 4 + ((opt_len + 3) & ~3)
+        return True
+
+    def emit(self, length):
+        self.out.write(bytes(self.buf[:length]))
+        del self.buf[:length]
+
+    def summary(self):
+        return '%d section(s), %d frame(s), %d dropped by the device, %d bytes skipped' % (
+            self.sections, self.frames, self.dropped, self.skipped)
+
+
+#
+# self test - a synthetic stream, built the same way as rmiieth_capture.c builds it
+#
+
+def make_shb():
+    return struct.pack('<IIIHHqI', SHB, 28, BYTE_ORDER, 1, 0, -1, 28)
+
+
+def make_idb(snap_len=1514):
+    return struct.pack('<IIHHII', IDB, 20, 1, 0, snap_len, 20)
+
+
+def make_epb(frame, timestamp, inbound=True, drops=0):
+    pad = (4 - len(frame) % 4) % 4
+    opts = struct.pack('<HHI', EPB_FLAGS, 4, 1 if inbound else 2)
+    if drops:
+        opts += struct.pack('<HHQ', EPB_DROPCOUNT, 8, drops)
+    opts += struct.pack('<HH', OPT_END, 0)
+    length = 28 + len(frame) + pad + len(opts) + 4
+    return (struct.pack('<IIIIIII', EPB, length, 0, timestamp >> 32, timestamp & 0xffffffff, len(frame), len(frame)) +
+            frame + b'\0' * pad + opts + struct.pack('<I', length))
+
+
+def parse_file(data):
+    """Minimal pcapng parser, to check the output - returns the frames' data."""
+    frames = []
+    pos = 0
+    endian = '<'
+    while pos < len(data):
+        if data[pos:pos + 4] == b'\x0a\x0d\x0d\x0a':
+            endian = '<' if data[pos + 8:pos + 12] == b'\x4d\x3c\x2b\x1a' else '>'
+        block_type, length = struct.unpack(endian + 'II', data[pos:pos + 8])
+        assert struct.unpack(endian + 'I', data[pos + length - 4:pos + length])[0] == length
+        if block_type == EPB:
+            cap_len = struct.unpack(endian + 'I', data[pos + 20:pos + 24])[0]
+            frames.append(data[pos + 28:pos + 28 + cap_len])
+        pos += length
+    assert pos == len(data)
+    return frames
+
+
+def self_test():
+    import io
+    import random
+
+    rnd = random.Random(1)
+    failures = 0
+    for i in range(200):
+        frames = [bytes(rnd.getrandbits(8) for _ in range(rnd.randint(60, 1514))) for _ in range(rnd.randint(1, 20))]
+
+        # boot messages, then the stream - with some frames corrupted on the way
+        stream = b'hello world\n' + make_shb() + make_idb()
+        expected = []
+        for n, frame in enumerate(frames):
+            block = bytearray(make_epb(frame, 1000 * n, inbound=n % 2 == 0, drops=n % 3))
+            if rnd.random() < 0.1:
+                block = block[:rnd.randint(1, len(block) - 1)]          # bytes lost
+            elif rnd.random() < 0.1:
+                block[rnd.randint(0, 7)] ^= 0xff                        # block type or length garbled
+            else:
+                expected.append(frame)
+            stream += bytes(block)
+
+        out = io.BytesIO()
+        reader = Reader(out)
+        pos = 0
+        while pos < len(stream):
+            chunk = rnd.randint(1, 4096)
+            reader.feed(stream[pos:pos + chunk])
+            pos += chunk
+        reader.finish()
+
+        try:
+            got = parse_file(out.getvalue())
+        except (AssertionError, struct.error):
+            got = None
+        if got != expected:
+            failures += 1
+            if failures <= 10:
+                print('stream %d: got %s frames, expected %d' % (i, len(got) if got is not None else 'bad', len(expected)))
+
+    print('self test: %d failures' % failures)
+    return failures == 0
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Write the rmiieth capture stream to a .pcapng file')
+    ap.add_argument('--port', help='serial port the capture UART is connected to')
+    ap.add_argument('--baud', type=int, default=3000000, help='baud rate (RMIIETH_LWIP_CAPTURE_BAUD)')
+    ap.add_argument('--input', help='raw dump of the stream, rather than a serial port')
+    ap.add_argument('-o', '--output', help='.pcapng file to write')
+    ap.add_argument('--self-test', action='store_true', help='check the reader against a synthetic stream, and exit')
+    args = ap.parse_args()
+
+    if args.self_test:
+        return 0 if self_test() else 1
+    if not args.output or bool(args.port) == bool(args.input):
+        ap.error('need -o, and one of --port or --input')
+
+    with open(args.output, 'wb') as out:
+        reader = Reader(out)
+        if args.input:
+            with open(args.input, 'rb') as f:
+                reader.feed(f.read())
+        else:
+            import serial
+            port = serial.Serial(args.port, args.baud, timeout=0.1)
+            try:
+                while True:
+                    data = port.read(65536)
+                    if data:
+                        reader.feed(data)
+                        out.flush()
+            except KeyboardInterrupt:
+                pass
+        reader.finish()
+        print(reader.summary())
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
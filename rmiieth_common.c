@@ -0,0 +1,915 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_common.h"
+#include "pkt_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// see rmiieth_common.h - everything here is shared with the host backend, so none of it may touch the PIO or DMA
+//
+
+// flow control - preformatted PAUSE frames, in the same layout as a TX queue packet (see rmiieth_start_tx())
+#define PAUSE_PKT_BYTES                 ( 8 + 60 + 4 )
+static uint32_t g_pause_pkt[ ( sizeof( pkt_queue_pkt_hdr ) + 8 + PAUSE_PKT_BYTES + 4 ) / 4 ];
+static uint32_t g_resume_pkt[ ( sizeof( pkt_queue_pkt_hdr ) + 8 + PAUSE_PKT_BYTES + 4 ) / 4 ];
+
+static void rmiieth_build_pause( rmiieth_config* cfg, pkt_queue_pkt* pkt, uint16_t quanta );
+
+void rmiieth_set_default_config( rmiieth_config* cfg )
+{
+    memset( cfg, 0, sizeof( rmiieth_config ) );
+    cfg->pio = pio0;
+    cfg->pin_mdc = 14;
+    cfg->pin_mdio = 15;
+    cfg->pin_clk = 10;
+    cfg->pin_rx_base = 11;
+    cfg->pin_rx_valid = 13;
+    cfg->pin_tx_base = 7;
+    cfg->pin_tx_valid = 9;
+    cfg->sleep_us = 1000;
+    cfg->phy_addr = 0x01;            // this happens to be the default
+    cfg->rx_dma_chan = 0;
+    cfg->tx_dma_chan = 1;
+    cfg->rx_irq = 0;
+    cfg->tx_dma_irq = 0;
+    cfg->rx_lock_id = -1;
+
+    cfg->rx_queue_buffer_size = 8192;
+    cfg->tx_queue_buffer_size = 8192;
+    cfg->mtu = 1500;
+    cfg->rx_poll_budget = 4;
+    cfg->rx_split_dma = false;
+    cfg->rx_dma_chan2 = 2;
+    cfg->arena_size = 0;
+    cfg->arena_rx_min = 4096;
+    cfg->arena_tx_min = 4096;
+    cfg->rx_promiscuous = true;
+    cfg->rx_all_multicast = true;
+    cfg->flow_control = false;
+    cfg->rx_pause_high_pct = 75;
+    cfg->rx_pause_low_pct = 25;
+    cfg->pause_quanta = 0x0800;             // ~10ms at 100Mbit
+    cfg->rx_ctrl_queue_size = 0;
+    cfg->rx_ctrl_max_bytes = 640;           // enough for a DHCP packet, plus preamble
+    cfg->tx_ctrl_queue_size = 0;
+    cfg->tx_sched = RMIIETH_TX_SCHED_STRICT;
+    cfg->tx_ctrl_weight = 4;
+    cfg->rx_storm_control = false;
+    cfg->rx_storm_rate[ RMIIETH_STORM_BROADCAST ] = 1000;
+    cfg->rx_storm_burst[ RMIIETH_STORM_BROADCAST ] = 64;
+    cfg->rx_storm_rate[ RMIIETH_STORM_MULTICAST ] = 1000;
+    cfg->rx_storm_burst[ RMIIETH_STORM_MULTICAST ] = 64;
+    cfg->rx_storm_rate[ RMIIETH_STORM_UNKNOWN_UNICAST ] = 0;
+    cfg->rx_storm_burst[ RMIIETH_STORM_UNKNOWN_UNICAST ] = 0;
+    cfg->rx_cut_through = false;
+
+    // pick up anything fixed by the board definition (see RMIIETH_BOARD_CONFIG)
+    cfg->pio = RMIIETH_PIO( cfg );
+    cfg->rx_dma_chan = RMIIETH_RX_DMA_CHAN( cfg );
+    cfg->rx_dma_chan2 = RMIIETH_RX_DMA_CHAN2( cfg );
+    cfg->tx_dma_chan = RMIIETH_TX_DMA_CHAN( cfg );
+    cfg->tx_dma_irq = RMIIETH_TX_DMA_IRQ( cfg );
+    cfg->mtu = RMIIETH_MTU( cfg );
+    cfg->rx_split_dma = RMIIETH_RX_SPLIT_DMA( cfg );
+}
+
+//
+// init - allocates any queue buffers that the backend hasn't already provided
+//
+
+void rmiieth_init_queues( rmiieth_config* cfg )
+{
+    if( !cfg->rx_queue_buffer )
+    {
+        cfg->rx_queue_buffer = (uint8_t*)malloc( cfg->rx_queue_buffer_size );
+        if( !cfg->rx_queue_buffer )
+        {
+            assert( false );
+        }
+    }
+    pkt_queue_init( &cfg->rx_queue, cfg->rx_queue_buffer, cfg->rx_queue_buffer_size );
+    pkt_queue_set_split( &cfg->rx_queue, cfg->rx_split_dma );
+
+    // bulk frames are only committed while the ring keeps some headroom (see rmiieth_rx_bulk_fits()) - a
+    // ring much smaller than three reservations would then drop all but the smallest of them
+    int32_t     rx_min = cfg->arena_size ? cfg->arena_rx_min : cfg->rx_queue_buffer_size;
+    if( cfg->rx_ctrl_queue_size && rx_min < 3 * ( RX_RESERVE_BYTES( cfg ) + (int32_t)sizeof( pkt_queue_pkt_hdr ) ) )
+    {
+        printf( "rmiieth: a %d byte RX ring is too small for a control queue - disabled\n", (int)rx_min );
+        cfg->rx_ctrl_queue_size = 0;
+    }
+    if( cfg->rx_ctrl_queue_size )
+    {
+        if( !cfg->rx_ctrl_queue_buffer )
+        {
+            cfg->rx_ctrl_queue_buffer = (uint8_t*)malloc( cfg->rx_ctrl_queue_size );
+            if( !cfg->rx_ctrl_queue_buffer )
+            {
+                assert( false );
+            }
+        }
+        pkt_queue_init( &cfg->rx_ctrl_queue, cfg->rx_ctrl_queue_buffer, cfg->rx_ctrl_queue_size );
+    }
+    for( int i = 0 ; i < RMIIETH_STORM_CLASSES ; i++ )
+    {
+        // buckets start full
+        assert( cfg->rx_storm_burst[ i ] <= 4000 );
+        cfg->rx_storm[ i ].tokens = cfg->rx_storm_burst[ i ] * 1000000u;
+        cfg->rx_storm[ i ].last_us = time_us_32();
+    }
+    if( cfg->flow_control )
+    {
+        rmiieth_build_pause( cfg, (pkt_queue_pkt*)g_pause_pkt, cfg->pause_quanta );
+        rmiieth_build_pause( cfg, (pkt_queue_pkt*)g_resume_pkt, 0 );
+    }
+    if( !cfg->tx_queue_buffer )
+    {
+        cfg->tx_queue_buffer = (uint8_t*)malloc( cfg->tx_queue_buffer_size );
+        if( !cfg->tx_queue_buffer )
+        {
+            assert( false );
+        }
+    }
+    pkt_queue_init( &cfg->tx_queue, cfg->tx_queue_buffer, cfg->tx_queue_buffer_size );
+    if( cfg->tx_ctrl_queue_size )
+    {
+        if( !cfg->tx_ctrl_queue_buffer )
+        {
+            cfg->tx_ctrl_queue_buffer = (uint8_t*)malloc( cfg->tx_ctrl_queue_size );
+            if( !cfg->tx_ctrl_queue_buffer )
+            {
+                assert( false );
+            }
+        }
+        pkt_queue_init( &cfg->tx_ctrl_queue, cfg->tx_ctrl_queue_buffer, cfg->tx_ctrl_queue_size );
+    }
+}
+
+//
+// flow control
+//
+// Once the RX ring passes rx_pause_high_pct, the link partner is sent a PAUSE frame - and then another each time half
+// of the requested pause time has gone by, for as long as the ring stays above rx_pause_low_pct. When it drains below
+// that, a zero-time PAUSE lets the partner resume straight away. The frames don't go through the TX queue, which may
+// itself be full - rmiieth_tx_next() sends them ahead of anything queued, as soon as the TX channel is free.
+//
+
+static void rmiieth_build_pause( rmiieth_config* cfg, pkt_queue_pkt* pkt, uint16_t quanta )
+{
+    static const uint8_t    pause_dest[ 6 ] = { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x01 };
+
+    uint8_t*        data = pkt->data + 8;
+    uint8_t*        frame = data + 8;
+
+    memset( pkt, 0, sizeof( g_pause_pkt ) );
+    pkt->hdr.data_bytes = PAUSE_PKT_BYTES;
+    pkt->hdr.mem_bytes = sizeof( g_pause_pkt );
+
+    data[ 0 ] = 0x55;  data[ 1 ] = 0x55;  data[ 2 ] = 0x55;  data[ 3 ] = 0x55;
+    data[ 4 ] = 0x55;  data[ 5 ] = 0x55;  data[ 6 ] = 0x55;  data[ 7 ] = 0xd5;
+
+    memcpy( &frame[ 0 ], pause_dest, 6 );
+    memcpy( &frame[ 6 ], cfg->mac_addr, 6 );
+    frame[ 12 ] = 0x88;                             // MAC control
+    frame[ 13 ] = 0x08;
+    frame[ 14 ] = 0x00;                             // PAUSE opcode
+    frame[ 15 ] = 0x01;
+    frame[ 16 ] = (uint8_t)( quanta >> 8 );
+    frame[ 17 ] = (uint8_t)( quanta >> 0 );
+
+    uint32_t        fcs = pkt_generate_fcs( frame, 60 );
+    frame[ 60 ] = (uint8_t)( fcs >>  0 );
+    frame[ 61 ] = (uint8_t)( fcs >>  8 );
+    frame[ 62 ] = (uint8_t)( fcs >> 16 );
+    frame[ 63 ] = (uint8_t)( fcs >> 24 );
+}
+
+// returns the PAUSE frame to send next, if any
+static pkt_queue_pkt* RMIIETH_HOT_FUNC( rmiieth_flow_control )( rmiieth_config* cfg )
+{
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    int32_t     used_pct = ( pkt_queue_used_bytes( &cfg->rx_queue ) * 100 ) / cfg->rx_queue.size;
+    spin_unlock( cfg->rx_lock, ii );
+
+    uint32_t    now = time_us_32();
+    if( !cfg->rx_paused )
+    {
+        if( used_pct < cfg->rx_pause_high_pct )
+        {
+            return( NULL );
+        }
+        cfg->rx_paused = true;
+    }
+    else if( used_pct <= cfg->rx_pause_low_pct )
+    {
+        cfg->rx_paused = false;
+        cfg->resume_frames_sent++;
+        return( (pkt_queue_pkt*)g_resume_pkt );
+    }
+    else if( now - cfg->rx_pause_sent_us < ( (uint32_t)cfg->pause_quanta * 256 ) / 100 )
+    {
+        // the last PAUSE still has at least half its time to run
+        return( NULL );
+    }
+
+    cfg->rx_pause_sent_us = now;
+    cfg->pause_frames_sent++;
+    return( (pkt_queue_pkt*)g_pause_pkt );
+}
+
+//
+// TX scheduling
+//
+
+// pick the next packet to send
+static inline pkt_queue_pkt* tx_schedule( rmiieth_config* cfg )
+{
+    pkt_queue_pkt*  bulk = pkt_queue_peek_pkt( &cfg->tx_queue );
+    pkt_queue_pkt*  ctrl = cfg->tx_ctrl_queue_size ? pkt_queue_peek_pkt( &cfg->tx_ctrl_queue ) : NULL;
+
+    if( ctrl && ( !bulk || cfg->tx_sched == RMIIETH_TX_SCHED_STRICT || cfg->tx_ctrl_run < cfg->tx_ctrl_weight ) )
+    {
+        cfg->tx_ctrl_run++;
+        cfg->tx_current_class = RMIIETH_TX_CLASS_CTRL;
+        return( ctrl );
+    }
+    if( bulk )
+    {
+        cfg->tx_ctrl_run = 0;
+        cfg->tx_current_class = RMIIETH_TX_CLASS_BULK;
+        return( bulk );
+    }
+    return( NULL );
+}
+
+// call when the TX channel is idle - retires the packet it was sending, and returns the next one to send (which
+// becomes tx_current_pkt), or NULL if there's nothing to send
+pkt_queue_pkt* RMIIETH_HOT_FUNC( rmiieth_tx_next )( rmiieth_config* cfg )
+{
+    // (PAUSE frames don't live in a TX queue)
+    if( cfg->tx_current_pkt )
+    {
+        if( cfg->tx_current_class >= 0 )
+        {
+            pkt_queue_consume_pkt( tx_class_queue( cfg, cfg->tx_current_class ) );
+            cfg->tx_class_stats[ cfg->tx_current_class ].sent++;
+        }
+        cfg->tx_current_pkt = NULL;
+    }
+
+    pkt_queue_pkt*      p = NULL;
+    if( cfg->flow_control )
+    {
+        p = rmiieth_flow_control( cfg );
+        cfg->tx_current_class = -1;
+    }
+    if( !p )
+    {
+        p = tx_schedule( cfg );
+    }
+    cfg->tx_current_pkt = p;
+    return( p );
+}
+
+// TX occupancy
+void RMIIETH_HOT_FUNC( rmiieth_tx_sample_stats )( rmiieth_config* cfg )
+{
+    for( int i = 0 ; i < RMIIETH_TX_CLASSES ; i++ )
+    {
+        rmiieth_tx_class_stats* st = &cfg->tx_class_stats[ i ];
+        st->used = ( i == RMIIETH_TX_CLASS_CTRL && !cfg->tx_ctrl_queue_size ) ? 0 : pkt_queue_used_bytes( tx_class_queue( cfg, i ) );
+        if( st->used > st->high_water )
+        {
+            st->high_water = st->used;
+        }
+    }
+}
+
+//
+// cut-through - see rmiieth_rx_cut_through() in rmiieth.c
+//
+
+// NOTE: must hold rx spinlock on entry to this function
+void RMIIETH_HOT_FUNC( rmiieth_rx_ct_finish )( rmiieth_config* cfg )
+{
+    if( !cfg->rx_ct_committed )
+    {
+        return;
+    }
+
+    pkt_queue_pkt*  pkt = cfg->rx_ct_pkt;
+    int             len = pkt->hdr.data_bytes;
+    int32_t         contig = pkt_queue_pkt_contig_bytes( &cfg->rx_queue, pkt );
+    bool            ok = pkt_progress_finish( &cfg->rx_ct, pkt->data, contig, cfg->rx_queue.data, &len );
+
+    cfg->rx_ct_done_pkt = pkt;
+    cfg->rx_ct_done_length = ok ? len : -1;
+    cfg->rx_ct_pkt = NULL;
+    cfg->rx_ct_committed = false;
+    cfg->rx_ct_frames++;
+}
+
+// NOTE: must hold rx spinlock on entry to this function - and call before consuming packets, as the queue space
+// (and so the packet pointer) will be re-used
+static inline void rx_ct_forget( rmiieth_config* cfg, int count )
+{
+    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
+    for( int i = 0 ; i < count && pkt && cfg->rx_ct_done_pkt ; i++ )
+    {
+        if( pkt == cfg->rx_ct_done_pkt )
+        {
+            cfg->rx_ct_done_pkt = NULL;
+        }
+        pkt = pkt_queue_next_pkt( &cfg->rx_queue, pkt );
+    }
+}
+
+// cut-through: is a frame part-way through arriving? if so, it's worth polling rather than sleeping
+bool RMIIETH_HOT_FUNC( rmiieth_rx_in_progress )( rmiieth_config* cfg )
+{
+    if( !cfg->rx_cut_through )
+    {
+        return( false );
+    }
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    bool in_progress = cfg->rx_current_pkt && rmiieth_rx_dma_bytes( cfg ) > 0;
+    spin_unlock( cfg->rx_lock, ii );
+    return( in_progress );
+}
+
+//
+// consumer API
+//
+
+bool RMIIETH_HOT_FUNC( rmiieth_rx_packet_available )( rmiieth_config* cfg )
+{
+    if( cfg->rx_ctrl_queue_size && pkt_queue_peek_pkt( &cfg->rx_ctrl_queue ) )
+    {
+        return( true );
+    }
+    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
+    return( pkt && pkt != cfg->rx_current_pkt );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_rx_get_packet )( rmiieth_config* cfg, uint8_t** pkt_data, int* length )
+{
+    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
+    if( !pkt || pkt == cfg->rx_current_pkt )
+    {
+        return( false );
+    }
+
+    // split RX: a packet that wraps around the ring can only be fetched with rmiieth_rx_get_packets()
+    assert( !RMIIETH_RX_SPLIT_DMA( cfg ) || pkt_queue_pkt_contig_bytes( &cfg->rx_queue, pkt ) == pkt->hdr.data_bytes );
+
+    // ... as can one that cut-through may have already realigned
+    assert( !cfg->rx_cut_through );
+
+    *pkt_data = pkt->data;
+    *length = pkt->hdr.data_bytes;
+    return( true );
+}
+
+void RMIIETH_HOT_FUNC( rmiieth_rx_consume_packet )( rmiieth_config* cfg )
+{
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    rx_ct_forget( cfg, 1 );
+    pkt_queue_consume_pkt( &cfg->rx_queue );
+    spin_unlock( cfg->rx_lock, ii );
+}
+
+// fetch up to max_frames received packets at once - they stay in the queue until rmiieth_rx_consume_packets()
+int RMIIETH_HOT_FUNC( rmiieth_rx_get_packets )( rmiieth_config* cfg, rmiieth_rx_frame* frames, int max_frames )
+{
+    int ct = 0;
+
+    // the IRQ can pad out the last committed packet when it reserves the next one, so walk the queue under the lock
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    rmiieth_rx_ct_finish( cfg );
+    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_queue );
+    while( pkt && pkt != cfg->rx_current_pkt && ct < max_frames )
+    {
+        frames[ ct ].data = pkt->data;
+        frames[ ct ].length = pkt->hdr.data_bytes;
+        frames[ ct ].wrap_data = NULL;
+        frames[ ct ].wrap_offset = pkt->hdr.data_bytes;
+        frames[ ct ].validated = 0;
+        frames[ ct ].timestamp_us = RX_PKT_TIMESTAMP( pkt );
+        if( pkt == cfg->rx_ct_done_pkt )
+        {
+            frames[ ct ].validated = ( cfg->rx_ct_done_length >= 0 ) ? 1 : -1;
+            frames[ ct ].length = ( cfg->rx_ct_done_length >= 0 ) ? cfg->rx_ct_done_length : pkt->hdr.data_bytes;
+        }
+        if( RMIIETH_RX_SPLIT_DMA( cfg ) )
+        {
+            int32_t contig = pkt_queue_pkt_contig_bytes( &cfg->rx_queue, pkt );
+            if( contig < pkt->hdr.data_bytes )
+            {
+                frames[ ct ].wrap_data = cfg->rx_queue.data;
+                frames[ ct ].wrap_offset = contig;
+            }
+        }
+        ct++;
+        pkt = pkt_queue_next_pkt( &cfg->rx_queue, pkt );
+    }
+    spin_unlock( cfg->rx_lock, ii );
+    return( ct );
+}
+
+void RMIIETH_HOT_FUNC( rmiieth_rx_consume_packets )( rmiieth_config* cfg, int count )
+{
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    rx_ct_forget( cfg, count );
+    pkt_queue_consume_pkts( &cfg->rx_queue, count );
+    spin_unlock( cfg->rx_lock, ii );
+}
+
+// fetch up to max_frames control-plane packets - see rx_ctrl_queue_size
+int RMIIETH_HOT_FUNC( rmiieth_rx_ctrl_get_packets )( rmiieth_config* cfg, rmiieth_rx_frame* frames, int max_frames )
+{
+    int ct = 0;
+    if( !cfg->rx_ctrl_queue_size )
+    {
+        return( 0 );
+    }
+
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    pkt_queue_pkt* pkt = pkt_queue_peek_pkt( &cfg->rx_ctrl_queue );
+    while( pkt && ct < max_frames )
+    {
+        frames[ ct ].data = pkt->data;
+        frames[ ct ].length = pkt->hdr.data_bytes;
+        frames[ ct ].wrap_data = NULL;
+        frames[ ct ].wrap_offset = pkt->hdr.data_bytes;
+        frames[ ct ].validated = 0;
+        frames[ ct ].timestamp_us = RX_PKT_TIMESTAMP( pkt );
+        ct++;
+        pkt = pkt_queue_next_pkt( &cfg->rx_ctrl_queue, pkt );
+    }
+    spin_unlock( cfg->rx_lock, ii );
+    return( ct );
+}
+
+void RMIIETH_HOT_FUNC( rmiieth_rx_ctrl_consume_packets )( rmiieth_config* cfg, int count )
+{
+    uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+    pkt_queue_consume_pkts( &cfg->rx_ctrl_queue, count );
+    spin_unlock( cfg->rx_lock, ii );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_tx_alloc_packet )( rmiieth_config* cfg, int length, uint8_t** data )
+{
+    return( rmiieth_tx_alloc_packet_class( cfg, RMIIETH_TX_CLASS_BULK, length, data ) );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_tx_alloc_packet_class )( rmiieth_config* cfg, int tx_class, int length, uint8_t** data )
+{
+    assert( !cfg->tx_current_alloc_pkt );
+    assert( tx_class >= 0 && tx_class < RMIIETH_TX_CLASSES );
+
+    // allocate 8 extra bytes at front, for the bit/byte counters
+
+    pkt_queue*  pq = tx_class_queue( cfg, tx_class );
+    cfg->tx_current_alloc_pkt = pkt_queue_reserve_pkt( pq, length + 8 );
+    if( !cfg->tx_current_alloc_pkt )
+    {
+        if( pq == &cfg->tx_queue )
+        {
+            cfg->tx_alloc_failed = true;
+        }
+        cfg->tx_class_stats[ tx_class ].dropped++;
+        return( false );
+    }
+    cfg->tx_current_alloc_class = tx_class;
+    *data = cfg->tx_current_alloc_pkt->data + 8;
+    return( true );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_tx_commit_packet )( rmiieth_config* cfg, int length )
+{
+    assert( cfg->tx_current_alloc_pkt );
+    pkt_queue_commit_pkt( tx_class_queue( cfg, cfg->tx_current_alloc_class ), cfg->tx_current_alloc_pkt, length );
+    cfg->tx_current_alloc_pkt = NULL;
+    return( true );
+}
+
+uint32_t RMIIETH_HOT_FUNC( rmiieth_take_events )( rmiieth_config* cfg )
+{
+    uint32_t ii = save_and_disable_interrupts();
+    uint32_t events = cfg->events;
+    cfg->events = 0;
+    restore_interrupts( ii );
+    return( events );
+}
+
+//
+// NAPI-style RX: while traffic is light, the consumer waits for RMIIETH_EVENT_RX before looking at the RX queue.
+// Once it falls behind (i.e. it uses up its whole budget), it switches to polling - which suppresses the RX event -
+// until it has drained the queue.
+//
+
+void RMIIETH_HOT_FUNC( rmiieth_rx_set_polling )( rmiieth_config* cfg, bool polling )
+{
+    cfg->rx_polling = polling;
+
+    // a packet could have landed after the consumer last looked, but before we re-enabled notifications
+    if( !polling && rmiieth_rx_packet_available( cfg ) )
+    {
+        uint32_t ii = save_and_disable_interrupts();
+        cfg->events |= RMIIETH_EVENT_RX;
+        restore_interrupts( ii );
+    }
+}
+
+//
+// multicast filter
+//
+// Like most MACs, groups are hashed into 64 bins rather than matched exactly - so the odd frame for a group that
+// shares a bin with one of ours gets through, and is left for the stack to discard. Each bin counts the groups in it,
+// so that removing one group doesn't close the bin on another.
+//
+
+static inline uint32_t rmiieth_mcast_bin( const uint8_t* mac )
+{
+    return( pkt_generate_fcs( (uint8_t*)mac, 6 ) >> 26 );
+}
+
+void rmiieth_rx_mcast_add( rmiieth_config* cfg, const uint8_t* mac )
+{
+    uint32_t    bin = rmiieth_mcast_bin( mac );
+    if( cfg->rx_mcast_refs[ bin ]++ == 0 )
+    {
+        cfg->rx_mcast_hash[ bin >> 5 ] |= ( 1u << ( bin & 31 ) );
+    }
+}
+
+void rmiieth_rx_mcast_remove( rmiieth_config* cfg, const uint8_t* mac )
+{
+    uint32_t    bin = rmiieth_mcast_bin( mac );
+    assert( cfg->rx_mcast_refs[ bin ] > 0 );
+    if( --cfg->rx_mcast_refs[ bin ] == 0 )
+    {
+        cfg->rx_mcast_hash[ bin >> 5 ] &= ~( 1u << ( bin & 31 ) );
+    }
+}
+
+//
+// EtherType dispatch
+//
+// Frames with a registered EtherType go straight to their handler, rather than to the stack. The handler is given the
+// frame where it lies in the RX queue (validated, but still possibly wrapped - see rmiieth_rx_frame), and it's only
+// valid for the duration of the call.
+//
+
+bool rmiieth_register_ethertype( rmiieth_config* cfg, uint16_t ethertype, rmiieth_ethertype_fn fn, void* ctx )
+{
+    rmiieth_ethertype_handler*  free_entry = NULL;
+    for( int i = 0 ; i < RMIIETH_MAX_ETHERTYPE_HANDLERS ; i++ )
+    {
+        rmiieth_ethertype_handler*  h = &cfg->ethertype_handlers[ i ];
+        if( h->fn && h->ethertype == ethertype )
+        {
+            return( false );
+        }
+        if( !h->fn && !free_entry )
+        {
+            free_entry = h;
+        }
+    }
+    if( !free_entry )
+    {
+        return( false );
+    }
+    free_entry->ethertype = ethertype;
+    free_entry->ctx = ctx;
+    free_entry->fn = fn;
+    return( true );
+}
+
+void rmiieth_unregister_ethertype( rmiieth_config* cfg, uint16_t ethertype )
+{
+    for( int i = 0 ; i < RMIIETH_MAX_ETHERTYPE_HANDLERS ; i++ )
+    {
+        rmiieth_ethertype_handler*  h = &cfg->ethertype_handlers[ i ];
+        if( h->fn && h->ethertype == ethertype )
+        {
+            h->fn = NULL;
+        }
+    }
+}
+
+// call with a validated frame - returns true if a handler took it
+bool RMIIETH_HOT_FUNC( rmiieth_rx_dispatch )( rmiieth_config* cfg, const rmiieth_rx_frame* frame )
+{
+    if( frame->length < 14 )
+    {
+        return( false );
+    }
+
+    uint8_t     type_hi = ( !frame->wrap_data || 12 < frame->wrap_offset ) ? frame->data[ 12 ] : frame->wrap_data[ 12 - frame->wrap_offset ];
+    uint8_t     type_lo = ( !frame->wrap_data || 13 < frame->wrap_offset ) ? frame->data[ 13 ] : frame->wrap_data[ 13 - frame->wrap_offset ];
+    uint16_t    ethertype = ( type_hi << 8 ) | type_lo;
+
+    for( int i = 0 ; i < RMIIETH_MAX_ETHERTYPE_HANDLERS ; i++ )
+    {
+        rmiieth_ethertype_handler*  h = &cfg->ethertype_handlers[ i ];
+        if( h->fn && h->ethertype == ethertype )
+        {
+            h->fn( h->ctx, frame );
+            cfg->rx_dispatched++;
+            return( true );
+        }
+    }
+    return( false );
+}
+
+//
+// RX sorting - everything below runs in the RX interrupt
+//
+
+// bytes of the frame decoded by the RX interrupt - ethernet header, IPv4 header and UDP ports
+#define RX_PEEK_BYTES                   ( 14 + 20 + 4 )
+
+// early destination MAC filter - looks at the destination address, before the frame is validated or committed
+static inline bool rmiieth_rx_filter( rmiieth_config* cfg, const uint8_t* dest )
+{
+    static const uint8_t    broadcast[ 6 ] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+    // broadcast and multicast
+    if( dest[ 0 ] & 1 )
+    {
+        if( cfg->rx_all_multicast || memcmp( dest, broadcast, 6 ) == 0 )
+        {
+            return( true );
+        }
+        uint32_t    bin = rmiieth_mcast_bin( dest );
+        return( ( cfg->rx_mcast_hash[ bin >> 5 ] >> ( bin & 31 ) ) & 1 );
+    }
+
+    return( memcmp( dest, cfg->mac_addr, 6 ) == 0 );
+}
+
+//
+// storm control
+//
+// Each class of frame that isn't directly addressed to us has a token bucket, which is topped up at rx_storm_rate
+// frames/sec, and holds up to rx_storm_burst frames. Tokens are kept in millionths of a frame, so that the top-up is
+// just elapsed microseconds * rate.
+//
+
+static inline bool rmiieth_rx_storm_pass( rmiieth_config* cfg, const uint8_t* dest )
+{
+    int         storm_class;
+    if( dest[ 0 ] & 1 )
+    {
+        bool    broadcast = ( dest[ 0 ] & dest[ 1 ] & dest[ 2 ] & dest[ 3 ] & dest[ 4 ] & dest[ 5 ] ) == 0xff;
+        storm_class = broadcast ? RMIIETH_STORM_BROADCAST : RMIIETH_STORM_MULTICAST;
+    }
+    else if( memcmp( dest, cfg->mac_addr, 6 ) != 0 )
+    {
+        storm_class = RMIIETH_STORM_UNKNOWN_UNICAST;
+    }
+    else
+    {
+        return( true );
+    }
+
+    uint32_t                rate = cfg->rx_storm_rate[ storm_class ];
+    rmiieth_storm_policer*  pol = &cfg->rx_storm[ storm_class ];
+    if( !rate )
+    {
+        pol->passed++;
+        return( true );
+    }
+
+    uint32_t    now = time_us_32();
+    uint32_t    elapsed = now - pol->last_us;
+    uint32_t    full = cfg->rx_storm_burst[ storm_class ] * 1000000u;
+    pol->last_us = now;
+    if( elapsed >= full / rate )
+    {
+        pol->tokens = full;
+    }
+    else
+    {
+        uint32_t    top_up = elapsed * rate;
+        pol->tokens = ( top_up >= full - pol->tokens ) ? full : pol->tokens + top_up;
+    }
+
+    if( pol->tokens < 1000000u )
+    {
+        pol->dropped++;
+        return( false );
+    }
+    pol->tokens -= 1000000u;
+    pol->passed++;
+    return( true );
+}
+
+//
+// control-plane RX
+//
+// ARP, ICMP and DHCP frames are copied into their own small queue (rx_ctrl_queue) by the RX interrupt, which the
+// consumer services first - so bulk traffic can't crowd them out. Bulk frames are also only committed to the main ring
+// while it still has room for the next reception, so that the DMA never stalls for lack of space - which would lose
+// control frames along with everything else.
+//
+
+// cut-through may have realigned the start of the frame in place already, in which case it's carried on far enough
+// to cover the header (and the header is read from the realigned bytes)
+static inline bool rmiieth_rx_peek( rmiieth_config* cfg, pkt_queue_pkt* pkt, int32_t bytes, uint8_t* hdr )
+{
+    pkt_progress*   pp = &cfg->rx_ct;
+    if( !rmiieth_rx_ct_active( cfg, pkt ) || pp->sfd_pos < 0 )
+    {
+        return( pkt_peek_header( pkt->data, cfg->rx_current_contig, cfg->rx_queue.data, bytes, hdr, RX_PEEK_BYTES ) );
+    }
+
+    int32_t         avail = pp->sfd_pos + RX_PEEK_BYTES + 1;
+    pkt_progress_feed( pp, pkt->data, cfg->rx_current_contig, cfg->rx_queue.data, avail < bytes ? avail : bytes );
+    if( pp->out_pos < RX_PEEK_BYTES )
+    {
+        return( false );
+    }
+    for( int i = 0 ; i < RX_PEEK_BYTES ; i++ )
+    {
+        hdr[ i ] = ( i < cfg->rx_current_contig ) ? pkt->data[ i ] : cfg->rx_queue.data[ i - cfg->rx_current_contig ];
+    }
+    return( true );
+}
+
+static inline bool rmiieth_rx_is_ctrl( const uint8_t* hdr )
+{
+    uint16_t    type = ( hdr[ 12 ] << 8 ) | hdr[ 13 ];
+    if( type == 0x0806 )
+    {
+        return( true );                             // ARP
+    }
+    if( type != 0x0800 )
+    {
+        return( false );
+    }
+
+    const uint8_t*  ip = &hdr[ 14 ];
+    if( ip[ 9 ] == 1 )
+    {
+        return( true );                             // ICMP
+    }
+    if( ip[ 9 ] == 17 && ( ip[ 0 ] & 0x0f ) == 5 )
+    {
+        // DHCP - server or client port, either way
+        uint16_t    src_port = ( ip[ 20 ] << 8 ) | ip[ 21 ];
+        uint16_t    dst_port = ( ip[ 22 ] << 8 ) | ip[ 23 ];
+        return( src_port == 67 || src_port == 68 || dst_port == 67 || dst_port == 68 );
+    }
+    return( false );
+}
+
+static inline bool rmiieth_rx_ctrl_copy( rmiieth_config* cfg, pkt_queue_pkt* pkt, int32_t bytes )
+{
+    pkt_queue_pkt*  cp = pkt_queue_reserve_pkt( &cfg->rx_ctrl_queue, bytes );
+    if( !cp )
+    {
+        cfg->rx_ctrl_dropped++;
+        return( false );
+    }
+
+    // the raw frame may wrap around the end of the main ring
+    int32_t         contig = ( bytes < cfg->rx_current_contig ) ? bytes : cfg->rx_current_contig;
+    memcpy( cp->data, pkt->data, contig );
+    memcpy( cp->data + contig, cfg->rx_queue.data, bytes - contig );
+#if PKT_QUEUE_TIMESTAMPS
+    cp->hdr.timestamp = pkt->hdr.timestamp;
+#endif
+    pkt_queue_commit_pkt( &cfg->rx_ctrl_queue, cp, bytes );
+    cfg->rx_ctrl_frames++;
+    return( true );
+}
+
+// would the ring still have room for the next reservation, after committing this packet? wrap padding can waste up to
+// another reservation's worth - holding that back too would leave a small ring with no room for bulk frames at all, so
+// the headroom is one reservation plus an eighth of the ring. If the next reservation fails anyway, rmiieth_poll()
+// restarts RX as soon as the consumer has made room.
+static inline bool rmiieth_rx_bulk_fits( rmiieth_config* cfg, pkt_queue_pkt* pkt, int32_t bytes )
+{
+    int32_t     reserve = RX_RESERVE_BYTES( cfg ) + sizeof( pkt_queue_pkt_hdr );
+    int32_t     used = pkt_queue_used_bytes( &cfg->rx_queue ) - pkt->hdr.mem_bytes +
+                       ( ( bytes + sizeof( pkt_queue_pkt_hdr ) + 3 ) & (~3) );
+
+    return( cfg->rx_queue.size - used >= reserve + cfg->rx_queue.size / 8 );
+}
+
+// Called by the backend once a frame has arrived in rx_current_pkt, with the # of raw bytes received (and the
+// packet's timestamp already set). Filters it, polices it, and copies control frames to their own queue - the
+// return value (RMIIETH_RX_SORT_xxx) says whether the backend should commit it, or re-use its space.
+int __time_critical_func(rmiieth_rx_sort)( rmiieth_config* cfg, pkt_queue_pkt* pkt, int32_t bytes )
+{
+    // decode the start of the frame - for the filter, and to classify it
+    uint8_t     hdr[ RX_PEEK_BYTES ];
+    bool        peeked = false;
+    if( !cfg->rx_promiscuous || cfg->rx_ctrl_queue_size || cfg->rx_storm_control )
+    {
+        peeked = rmiieth_rx_peek( cfg, pkt, bytes, hdr );
+    }
+
+    if( !cfg->rx_promiscuous && !( peeked && rmiieth_rx_filter( cfg, hdr ) ) )
+    {
+        // not for us
+        cfg->rx_filtered++;
+        return( RMIIETH_RX_SORT_DROP );
+    }
+    if( cfg->rx_storm_control && peeked && !rmiieth_rx_storm_pass( cfg, hdr ) )
+    {
+        // over the limit for its class
+        return( RMIIETH_RX_SORT_DROP );
+    }
+    bool        ctrl = cfg->rx_ctrl_queue_size && peeked && rmiieth_rx_is_ctrl( hdr );
+    if( ctrl && bytes <= cfg->rx_ctrl_max_bytes && !rmiieth_rx_ct_active( cfg, pkt ) )
+    {
+        // control frame - copy it to its own queue (cut-through leaves these alone, see rmiieth_rx_ct_wanted())
+        return( rmiieth_rx_ctrl_copy( cfg, pkt, bytes ) ? RMIIETH_RX_SORT_COPIED : RMIIETH_RX_SORT_DROP );
+    }
+    if( cfg->rx_ctrl_queue_size && !ctrl && !rmiieth_rx_bulk_fits( cfg, pkt, bytes ) )
+    {
+        // committing this would leave no room to receive the next frame - keep that for control frames (including
+        // any too large for the control queue, which go through the ring)
+        cfg->rx_bulk_dropped++;
+        return( RMIIETH_RX_SORT_DROP );
+    }
+    return( RMIIETH_RX_SORT_COMMIT );
+}
+
+//
+// cut-through
+//
+// While a frame is arriving, rmiieth_poll() realigns it in place and runs the FCS over it, as far as the RX DMA has
+// got (see pkt_progress_feed). Once the IRQ has committed it, only the tail is left - that's done by the next poll, or
+// by rmiieth_rx_get_packets(), whichever comes first - and the consumer gets the frame already validated. Work on a
+// frame that's dropped by the IRQ (or re-armed) is simply abandoned. Only one frame is tracked at a time.
+//
+// With a control queue, a frame isn't taken on until its header has arrived: control frames are copied to their queue
+// raw (see rmiieth_rx_sort()), so they have to be left as they are, and only bulk frames are realigned ahead of time.
+//
+
+#define RX_CT_CHUNK_BYTES               ( 256 )             // max raw bytes to process per hold of the RX spinlock
+
+// NOTE: must hold rx spinlock on entry to this function
+static inline bool rmiieth_rx_ct_wanted( rmiieth_config* cfg, pkt_queue_pkt* pkt )
+{
+    uint8_t     hdr[ RX_PEEK_BYTES ];
+    if( !cfg->rx_ctrl_queue_size )
+    {
+        return( true );
+    }
+    return( pkt_peek_header( pkt->data, cfg->rx_current_contig, cfg->rx_queue.data, rmiieth_rx_dma_bytes( cfg ), hdr,
+                             RX_PEEK_BYTES ) && !rmiieth_rx_is_ctrl( hdr ) );
+}
+
+void RMIIETH_HOT_FUNC( rmiieth_rx_cut_through )( rmiieth_config* cfg )
+{
+    // a chunk at a time, so that the RX IRQ isn't held off for long
+    bool more = true;
+    while( more )
+    {
+        uint32_t ii = spin_lock_blocking( cfg->rx_lock );
+        rmiieth_rx_ct_finish( cfg );
+
+        pkt_queue_pkt* pkt = cfg->rx_current_pkt;
+        if( !pkt )
+        {
+            spin_unlock( cfg->rx_lock, ii );
+            return;
+        }
+        if( !rmiieth_rx_ct_active( cfg, pkt ) )
+        {
+            if( !rmiieth_rx_ct_wanted( cfg, pkt ) )
+            {
+                // not yet, or not this one
+                spin_unlock( cfg->rx_lock, ii );
+                return;
+            }
+            pkt_progress_init( &cfg->rx_ct );
+            cfg->rx_ct_pkt = pkt;
+            cfg->rx_ct_arm = cfg->rx_arm_count;
+        }
+
+        pkt_progress*   pp = &cfg->rx_ct;
+        int32_t         done = ( pp->sfd_pos < 0 ) ? pp->in_pos : ( pp->sfd_pos + pp->out_pos );
+        int32_t         avail = rmiieth_rx_dma_bytes( cfg );
+        if( avail > done + RX_CT_CHUNK_BYTES )
+        {
+            avail = done + RX_CT_CHUNK_BYTES;
+        }
+        else
+        {
+            more = false;
+        }
+        pkt_progress_feed( pp, pkt->data, cfg->rx_current_contig, cfg->rx_queue.data, avail );
+        more = more && pp->length < 0;
+        spin_unlock( cfg->rx_lock, ii );
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_COMMON_H
+#define RMIIETH_COMMON_H
+
+#include "rmiieth.h"
+
+/*
+ * rmiieth_common
+ *
+ * The parts of the driver that don't touch the PIO or DMA - queue setup, what the RX interrupt does with each frame,
+ * TX scheduling and flow control, and the consumer API. They're shared by rmiieth.c and the host backend
+ * (host/rmiieth_host.c), so that the host runs the same code as the Pico.
+ *
+ * Each backend provides rmiieth_init(), rmiieth_probe(), rmiieth_poll() and rmiieth_rx_dma_bytes(), and looks after
+ * cfg->rx_current_pkt: it reserves it in cfg->rx_queue, receives a frame into it, and hands it to
+ * rmiieth_rx_sort(), which decides what happens to the frame.
+ */
+
+// room for an MTU-sized frame, plus preamble, VLAN tag, FCS and the DMA's slack
+#define RX_RESERVE_BYTES( cfg )         ( ( RMIIETH_MTU( cfg ) + 52 ) & (~3) )
+
+// when an RX frame finished arriving - only kept if the packet headers have room for it
+#if PKT_QUEUE_TIMESTAMPS
+#define RX_PKT_TIMESTAMP( pkt )         ( (pkt)->hdr.timestamp )
+#else
+#define RX_PKT_TIMESTAMP( pkt )         ( 0 )
+#endif
+
+// what the backend should do with a frame that has just arrived - see rmiieth_rx_sort()
+#define RMIIETH_RX_SORT_DROP            ( 0 )               // dropped - receive the next frame into the same space
+#define RMIIETH_RX_SORT_COPIED          ( 1 )               // copied to the control queue - ditto
+#define RMIIETH_RX_SORT_COMMIT          ( 2 )               // commit it to the RX buffer
+
+//
+// TX queues - one per class, although the control class shares the main TX queue unless tx_ctrl_queue_size is set
+//
+
+static inline pkt_queue* tx_class_queue( rmiieth_config* cfg, int tx_class )
+{
+    if( tx_class == RMIIETH_TX_CLASS_CTRL && cfg->tx_ctrl_queue_size )
+    {
+        return( &cfg->tx_ctrl_queue );
+    }
+    return( &cfg->tx_queue );
+}
+
+// cut-through: is it working on this packet, as it's currently armed?
+static inline bool rmiieth_rx_ct_active( rmiieth_config* cfg, pkt_queue_pkt* pkt )
+{
+    return( cfg->rx_cut_through && cfg->rx_ct_pkt == pkt && cfg->rx_ct_arm == cfg->rx_arm_count );
+}
+
+// rmiieth_common.c
+extern void             rmiieth_init_queues( rmiieth_config* cfg );
+extern int              rmiieth_rx_sort( rmiieth_config* cfg, pkt_queue_pkt* pkt, int32_t bytes );
+extern void             rmiieth_rx_ct_finish( rmiieth_config* cfg );
+extern void             rmiieth_rx_cut_through( rmiieth_config* cfg );
+extern pkt_queue_pkt*   rmiieth_tx_next( rmiieth_config* cfg );
+extern void             rmiieth_tx_sample_stats( rmiieth_config* cfg );
+
+// the backend - # of raw bytes received so far into rx_current_pkt (must hold the rx spinlock)
+extern int32_t          rmiieth_rx_dma_bytes( rmiieth_config* cfg );
+
+
+#endif
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+#
+# (c) 2021 Ben Stragnell
+#
+# Builds an httpd fsdata file (see HTTPD_FSDATA_FILE) from a directory of content, with as little left for the Pico
+# to do per request as possible:
+#
+#  - bodies are gzipped (Content-Encoding: gzip), unless they're already compressed or it doesn't make them smaller
+#  - the HTTP headers are built in (FS_FILE_FLAGS_HEADER_INCLUDED), so httpd doesn't have to make them up
+#  - each file's data - header included - is summed in TCP_MSS sized pieces, both into lwIP's fsdata_chksum tables
+#    (for HTTPD_PRECALCULATED_CHECKSUM) and into pkt_checksum_table entries (rmiieth_fsdata_checksums[]), which the
+#    lwIP glue uses to skip summing the payload of segments that httpd sends straight from flash
+#
+#     rmiieth_makefsdata.py <content dir> -o rmiieth_fsdata.c
+#     rmiieth_makefsdata.py <content dir> -o rmiieth_fsdata.c --no-gzip --mss 1460
+#
+# Every browser accepts gzip, so compressed bodies are sent whatever the request's Accept-Encoding says. The output
+# only depends on the content, so it's the same from one build to the next.
+#
+
+import argparse
+import gzip
+import os
+import sys
+
+CONTENT_TYPES = {
+    'html': 'text/html',
+    'htm': 'text/html',
+    'shtml': 'text/html',
+    'css': 'text/css',
+    'js': 'application/javascript',
+    'json': 'application/json',
+    'txt': 'text/plain',
+    'xml': 'text/xml',
+    'svg': 'image/svg+xml',
+    'gif': 'image/gif',
+    'png': 'image/png',
+    'jpg': 'image/jpeg',
+    'jpeg': 'image/jpeg',
+    'ico': 'image/x-icon',
+    'bmp': 'image/bmp',
+    'woff': 'font/woff',
+    'woff2': 'font/woff2',
+}
+
+# formats that are already compressed - gzip would only add its header
+INCOMPRESSIBLE = {'gif', 'png', 'jpg', 'jpeg', 'ico', 'woff', 'woff2', 'gz', 'zip'}
+
+STATUS = {
+    '400': 'HTTP/1.0 400 Bad Request',
+    '404': 'HTTP/1.0 404 File not found',
+    '501': 'HTTP/1.0 501 Not Implemented',
+}
+
+
+def checksum(data):
+    """Internet checksum sum (not inverted) of data, as 16-bit big-endian words."""
+    if len(data) & 1:
+        data = data + b'\0'
+    s = 0
+    for i in range(0, len(data), 2):
+        s += (data[i] << 8) | data[i + 1]
+    while s >> 16:
+        s = (s & 0xffff) + (s >> 16)
+    return s
+
+
+def swap16(v):
+    return ((v & 0xff) << 8) | (v >> 8)
+
+
+def c_name(path):
+    return ''.join(c if c.isalnum() else '_' for c in path)
+
+
+def build_file(path, uri, use_gzip):
+    with open(path, 'rb') as f:
+        body = f.read()
+
+    ext = uri.rsplit('.', 1)[-1].lower() if '.' in uri else ''
+    content_type = CONTENT_TYPES.get(ext, 'application/octet-stream')
+
+    encoded = False
+    if use_gzip and ext not in INCOMPRESSIBLE and body:
+        packed = gzip.compress(body, compresslevel=9, mtime=0)
+        if len(packed) < len(body):
+            body = packed
+            encoded = True
+
+    base = os.path.basename(uri)
+    status = STATUS.get(base[:3], 'HTTP/1.0 200 OK')
+    header = status + '\r\n'
+    header += 'Server: lwIP/rmiieth\r\n'
+    header += 'Content-Length: %d\r\n' % len(body)
+    if encoded:
+        header += 'Content-Encoding: gzip\r\n'
+        header += 'Vary: Accept-Encoding\r\n'
+    header += 'Content-Type: %s\r\n\r\n' % content_type
+
+    return {'uri': uri, 'data': header.encode('ascii') + body, 'raw': os.path.getsize(path), 'body': len(body),
+            'gzip': encoded}
+
+
+def c_bytes(data, indent='    '):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append(indent + ''.join('0x%02x,' % b for b in data[i:i + 16]))
+    return '\n'.join(lines)
+
+
+def write_fsdata(out, files, mss):
+    out.write('/*\n * Generated by rmiieth_makefsdata.py - do not edit\n */\n\n')
+    out.write('#include "lwip/apps/fs.h"\n')
+    out.write('#include "lwip/def.h"\n')
+    out.write('#include "pkt_utils.h"\n\n')
+    out.write('#define file_NULL (struct fsdata_file *) NULL\n\n')
+    out.write('#ifndef FSDATA_ALIGN_PRE\n#define FSDATA_ALIGN_PRE\n#endif\n')
+    out.write('#ifndef FSDATA_ALIGN_POST\n#define FSDATA_ALIGN_POST\n#endif\n\n')
+
+    for f in files:
+        name = c_name(f['uri'])
+        uri = f['uri'].encode('ascii') + b'\0'
+        # keep the data that follows the name word aligned, as makefsdata does
+        uri += b'\0' * (-len(uri) & 3)
+        f['name'] = name
+        f['name_len'] = len(uri)
+        data = f['data']
+        f['pieces'] = [(ofs, min(mss, len(data) - ofs)) for ofs in range(0, len(data), mss)]
+
+        out.write('/* %s - %d bytes%s, %d byte header */\n' % (f['uri'], f['raw'],
+                  ' (%d gzipped)' % f['body'] if f['gzip'] else '', len(data) - f['body']))
+        out.write('static const unsigned char FSDATA_ALIGN_PRE data_%s[] FSDATA_ALIGN_POST = {\n' % name)
+        out.write(c_bytes(uri) + '\n')
+        out.write(c_bytes(data) + '\n};\n\n')
+
+        out.write('#if HTTPD_PRECALCULATED_CHECKSUM\n')
+        out.write('static const struct fsdata_chksum chksums_%s[] = {\n' % name)
+        for ofs, length in f['pieces']:
+            out.write('    { %d, 0x%04x, %d },\n' % (ofs, checksum(data[ofs:ofs + length]), length))
+        out.write('};\n#endif\n\n')
+
+        # the same sums, in memory byte order (the Pico, and the host, are little-endian) - see pkt_checksum_add()
+        out.write('static const uint16_t sums_%s[] = {\n' % name)
+        for ofs, length in f['pieces']:
+            out.write('    0x%04x,\n' % swap16(checksum(data[ofs:ofs + length])))
+        out.write('};\n\n')
+
+    prev = 'file_NULL'
+    for f in files:
+        out.write('const struct fsdata_file file_%s[] = { {\n' % f['name'])
+        out.write('    %s,\n' % prev)
+        out.write('    data_%s,\n' % f['name'])
+        out.write('    data_%s + %d,\n' % (f['name'], f['name_len']))
+        out.write('    sizeof( data_%s ) - %d,\n' % (f['name'], f['name_len']))
+        out.write('    FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_HEADER_PERSISTENT,\n')
+        out.write('#if HTTPD_PRECALCULATED_CHECKSUM\n')
+        out.write('    %d, chksums_%s,\n' % (len(f['pieces']), f['name']))
+        out.write('#endif\n')
+        out.write('} };\n\n')
+        prev = 'file_%s' % f['name']
+
+    out.write('#define FS_ROOT %s\n' % prev)
+    out.write('#define FS_NUMFILES %d\n\n' % len(files))
+
+    out.write('const pkt_checksum_table rmiieth_fsdata_checksums[] = {\n')
+    for f in files:
+        out.write('    { data_%s + %d, sizeof( data_%s ) - %d, %d, sums_%s },\n' % (
+            f['name'], f['name_len'], f['name'], f['name_len'], mss, f['name']))
+    out.write('};\n')
+    out.write('const int rmiieth_fsdata_checksum_count = %d;\n' % len(files))
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Build an httpd fsdata file with gzipped bodies, built-in headers and '
+                                             'precalculated checksums')
+    ap.add_argument('content', help='directory to serve - its index.html is "/index.html", and so on')
+    ap.add_argument('-o', '--output', required=True, help='.c file to write (HTTPD_FSDATA_FILE)')
+    ap.add_argument('--mss', type=int, default=1460, help='TCP_MSS - the size of the checksummed pieces')
+    ap.add_argument('--no-gzip', action='store_true', help="don't compress anything")
+    args = ap.parse_args()
+
+    files = []
+    for root, dirs, names in os.walk(args.content):
+        dirs.sort()
+        for n in sorted(names):
+            path = os.path.join(root, n)
+            uri = '/' + os.path.relpath(path, args.content).replace(os.sep, '/')
+            files.append(build_file(path, uri, not args.no_gzip))
+    if not files:
+        sys.exit('no files in %s' % args.content)
+
+    # httpd searches the list in order - put index.html and the error pages first
+    files.sort(key=lambda f: (os.path.basename(f['uri']) not in ('index.html', '404.html'), f['uri']))
+    files.reverse()                             # ... and the list is built back to front
+
+    with open(args.output, 'w') as out:
+        write_fsdata(out, files, args.mss)
+
+    raw = sum(f['raw'] for f in files)
+    sent = sum(len(f['data']) for f in files)
+    print('%s: %d files, %d bytes of content -> %d bytes to send (headers included)' % (args.output, len(files), raw,
+                                                                                       sent))
+
+
+if __name__ == '__main__':
+    main()
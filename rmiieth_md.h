@@ -22,6 +22,12 @@
 #define RMII_REG_INT_MSK                ( 30 )
 #define RMII_REG_PHY_SPECIAL_CS         ( 31 )
 
+// RMII_REG_AUTONEG_ADVERT bits
+#define RMII_ADVERT_SELECTOR_802_3      ( 1 << 0 )
+#define RMII_ADVERT_100_FULL_DUPLEX     ( 1 << 8 )
+#define RMII_ADVERT_100_HALF_DUPLEX     ( 1 << 7 )
+#define RMII_ADVERT_PAUSE               ( 1 << 10 )
+
 
 extern void     rmiieth_md_init( rmiieth_config* cfg );
 extern uint32_t rmiieth_md_readreg( rmiieth_config* cfg, uint32_t regAddr );
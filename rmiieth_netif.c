@@ -0,0 +1,664 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_netif.h"
+#include "pkt_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/snmp.h"
+#include "lwip/ethip6.h"
+#include "lwip/etharp.h"
+#include "lwip/igmp.h"
+#include "lwip/timeouts.h"
+#include "netif/ethernet.h"
+
+#define IFNAME0 'b'
+#define IFNAME1 'b'
+
+// longest time we sleep for without checking in - RX overruns don't raise an interrupt, so we need to notice them
+#define RMIIETH_LWIP_MAX_SLEEP_MS       10
+
+// max packets fetched from the RX queue at once
+#define RMIIETH_LWIP_RX_BATCH           8
+
+
+#if RMIIETH_CHECKSUM_OFFLOAD
+
+//
+// checksum offload
+//
+// lwIP is built with CHECKSUM_GEN_* and CHECKSUM_CHECK_* disabled for IP, UDP and TCP - instead, we accumulate the
+// TCP/UDP checksum during the copy between the pbufs and the packet queues, and only go back to patch (or check)
+// the IP header and the L4 checksum field afterwards.
+//
+// Fragmented datagrams can't be checksummed a frame at a time - outgoing UDP fragments are left with a checksum of
+// 0 (i.e. none), and incoming fragments only have their IP header checked.
+//
+
+typedef struct
+{
+    int         ip_start;                                   // offset of the IP header (0 if not IPv4)
+    int         ip_hdr_len;
+    int         l4_start;                                   // offset of the TCP/UDP header (0 if not offloaded)
+    int         l3_end;                                     // offset of the end of the IP datagram
+    uint8_t     proto;
+} csum_frame_info;
+
+// 'hdr_len' bytes of the frame must be contiguous at 'frame' - 'len' is the length of the whole frame
+static bool RMIIETH_HOT_FUNC( csum_parse_frame )( const uint8_t* frame, int hdr_len, int len, csum_frame_info* ci )
+{
+    memset( ci, 0, sizeof( csum_frame_info ) );
+    if( hdr_len < 14 + 20 || frame[ 12 ] != 0x08 || frame[ 13 ] != 0x00 || ( frame[ 14 ] >> 4 ) != 4 )
+    {
+        return( false );
+    }
+
+    int         ip_hdr_len = ( frame[ 14 ] & 0x0f ) * 4;
+    int         ip_len = ( frame[ 14 + 2 ] << 8 ) | frame[ 14 + 3 ];
+    if( ip_hdr_len < 20 || 14 + ip_hdr_len > hdr_len || ip_len < ip_hdr_len || 14 + ip_len > len )
+    {
+        return( false );
+    }
+
+    ci->ip_start = 14;
+    ci->ip_hdr_len = ip_hdr_len;
+    ci->l3_end = 14 + ip_len;
+    ci->proto = frame[ 14 + 9 ];
+
+    // only unfragmented TCP/UDP gets its L4 checksum offloaded
+    bool        fragment = ( ( frame[ 14 + 6 ] & 0x3f ) | frame[ 14 + 7 ] ) != 0;
+    int         l4_len = ip_len - ip_hdr_len;
+    if( !fragment && ( ( ci->proto == 6 && l4_len >= 20 ) || ( ci->proto == 17 && l4_len >= 8 ) ) )
+    {
+        ci->l4_start = 14 + ip_hdr_len;
+    }
+    return( true );
+}
+
+// copy a piece of the frame that sits at offset 'pos', accumulating the checksum of any bytes within [sum_start, sum_end)
+static uint32_t RMIIETH_HOT_FUNC( csum_copy_range )( uint8_t* dst, const uint8_t* src, int len, int pos, int sum_start, int sum_end, uint32_t sum )
+{
+    int         a = pos > sum_start ? pos : sum_start;
+    int         b = ( pos + len ) < sum_end ? ( pos + len ) : sum_end;
+
+    if( a >= b )
+    {
+        memcpy( dst, src, len );
+        return( sum );
+    }
+
+    memcpy( dst, src, a - pos );
+    if( ( a - sum_start ) & 1 )
+    {
+        sum = pkt_checksum_swap( pkt_checksum_copy( &dst[ a - pos ], &src[ a - pos ], b - a, pkt_checksum_swap( sum ) ) );
+    }
+    else
+    {
+        sum = pkt_checksum_copy( &dst[ a - pos ], &src[ a - pos ], b - a, sum );
+    }
+    memcpy( &dst[ b - pos ], &src[ b - pos ], pos + len - b );
+    return( sum );
+}
+
+static uint32_t RMIIETH_HOT_FUNC( csum_l4_pseudo_header )( const uint8_t* frame, const csum_frame_info* ci, uint32_t sum )
+{
+    int         l4_len = ci->l3_end - ci->l4_start;
+    uint8_t     tmp[ 4 ] = { 0, ci->proto, (uint8_t)( l4_len >> 8 ), (uint8_t)l4_len };
+
+    sum = pkt_checksum_add( &frame[ ci->ip_start + 12 ], 8, sum );          // source and destination address
+    return( pkt_checksum_add( tmp, 4, sum ) );
+}
+
+static inline int csum_l4_field_offset( const csum_frame_info* ci )
+{
+    return( ci->l4_start + ( ci->proto == 6 ? 16 : 6 ) );
+}
+
+static void RMIIETH_HOT_FUNC( csum_finish_tx )( uint8_t* frame, const csum_frame_info* ci, uint32_t l4_sum )
+{
+    uint16_t    csum;
+
+    frame[ ci->ip_start + 10 ] = 0;
+    frame[ ci->ip_start + 11 ] = 0;
+    csum = pkt_checksum_finish( pkt_checksum_add( &frame[ ci->ip_start ], ci->ip_hdr_len, 0 ) );
+    frame[ ci->ip_start + 10 ] = (uint8_t)( csum >> 0 );
+    frame[ ci->ip_start + 11 ] = (uint8_t)( csum >> 8 );
+
+    if( ci->l4_start )
+    {
+        // lwIP leaves the checksum field zeroed when CHECKSUM_GEN_xxx is off, so it hasn't contributed to the sum
+        csum = pkt_checksum_finish( csum_l4_pseudo_header( frame, ci, l4_sum ) );
+        if( ci->proto == 17 && csum == 0 )
+        {
+            csum = 0xffff;
+        }
+        int     ofs = csum_l4_field_offset( ci );
+        frame[ ofs + 0 ] = (uint8_t)( csum >> 0 );
+        frame[ ofs + 1 ] = (uint8_t)( csum >> 8 );
+    }
+}
+
+static bool RMIIETH_HOT_FUNC( csum_check_rx )( const uint8_t* frame, const csum_frame_info* ci, uint32_t l4_sum )
+{
+    if( pkt_checksum_finish( pkt_checksum_add( &frame[ ci->ip_start ], ci->ip_hdr_len, 0 ) ) != 0 )
+    {
+        return( false );
+    }
+
+    if( ci->l4_start )
+    {
+        int     ofs = csum_l4_field_offset( ci );
+        if( ci->proto == 17 && !frame[ ofs ] && !frame[ ofs + 1 ] )
+        {
+            return( true );         // no UDP checksum
+        }
+        if( pkt_checksum_finish( csum_l4_pseudo_header( frame, ci, l4_sum ) ) != 0 )
+        {
+            return( false );
+        }
+    }
+    return( true );
+}
+
+#endif // #if RMIIETH_CHECKSUM_OFFLOAD
+
+static void ethernetif_input(struct netif *netif, const rmiieth_rx_frame* frame);
+
+// received frames can wrap around the end of the RX ring (split RX) - bytes from 'split' onwards are at 'wrap'.
+// Returns where the frame's byte at 'pos' is, and trims *len so that it doesn't cross the wrap.
+static inline const uint8_t* rx_frame_src( const uint8_t* pkt, int split, const uint8_t* wrap, int pos, int* len )
+{
+    if( pos < split )
+    {
+        if( *len > split - pos )
+        {
+            *len = split - pos;
+        }
+        return( &pkt[ pos ] );
+    }
+    return( &wrap[ pos - split ] );
+}
+
+#if LWIP_IGMP
+static err_t igmp_mac_filter( struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action )
+{
+    struct ethernetif *ethernetif = netif->state;
+    rmiieth_config* cfg = (rmiieth_config*)ethernetif->rmiieth_cfg;
+
+    // 01:00:5e, followed by the bottom 23 bits of the group address
+    uint8_t     mac[ 6 ] = { 0x01, 0x00, 0x5e, ip4_addr2( group ) & 0x7f, ip4_addr3( group ), ip4_addr4( group ) };
+    if( action == NETIF_ADD_MAC_FILTER )
+    {
+        rmiieth_rx_mcast_add( cfg, mac );
+    }
+    else
+    {
+        rmiieth_rx_mcast_remove( cfg, mac );
+    }
+    return( ERR_OK );
+}
+#endif
+
+static void low_level_init(struct netif *netif)
+{
+    struct ethernetif *ethernetif = netif->state;
+    struct pbuf *q;
+    rmiieth_config* cfg = (rmiieth_config*)ethernetif->rmiieth_cfg;
+
+    netif->hwaddr_len = ETHARP_HWADDR_LEN;
+    for( int i = 0 ; i < 6 ; i++ )
+    {
+        netif->hwaddr[ i ] = cfg->mac_addr[ i ];
+    }
+    netif->mtu = cfg->mtu;
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
+#if LWIP_IGMP
+    // only receive the multicast groups that IGMP has joined
+    netif->flags |= NETIF_FLAG_IGMP;
+    netif->igmp_mac_filter = igmp_mac_filter;
+    cfg->rx_all_multicast = false;
+#endif
+}
+
+// ARP, ICMP, DHCP and bare TCP ACKs go in the control TX queue, so that they don't wait behind bulk data
+static int RMIIETH_HOT_FUNC( tx_classify )( struct pbuf* p )
+{
+    const uint8_t*  f = (const uint8_t*)p->payload;
+    if( p->len < 14 )
+    {
+        return( RMIIETH_TX_CLASS_BULK );
+    }
+
+    uint16_t        type = ( f[ 12 ] << 8 ) | f[ 13 ];
+    if( type == 0x0806 )                        // ARP
+    {
+        return( RMIIETH_TX_CLASS_CTRL );
+    }
+    if( type != 0x0800 || p->len < 14 + 20 )
+    {
+        return( RMIIETH_TX_CLASS_BULK );
+    }
+
+    const uint8_t*  ip = &f[ 14 ];
+    int             ihl = ( ip[ 0 ] & 0x0f ) * 4;
+    int             ip_len = ( ip[ 2 ] << 8 ) | ip[ 3 ];
+    if( ip[ 9 ] == 1 )                          // ICMP
+    {
+        return( RMIIETH_TX_CLASS_CTRL );
+    }
+    if( p->len < 14 + ihl + 14 )
+    {
+        return( RMIIETH_TX_CLASS_BULK );
+    }
+
+    const uint8_t*  l4 = &ip[ ihl ];
+    if( ip[ 9 ] == 17 )                         // UDP - DHCP
+    {
+        uint16_t    src_port = ( l4[ 0 ] << 8 ) | l4[ 1 ];
+        return( ( src_port == 67 || src_port == 68 ) ? RMIIETH_TX_CLASS_CTRL : RMIIETH_TX_CLASS_BULK );
+    }
+    if( ip[ 9 ] == 6 )                          // TCP
+    {
+        // no payload - an ACK, SYN or RST. A FIN has to stay behind the flow's data
+        int         tcp_hdr_len = ( l4[ 12 ] >> 4 ) * 4;
+        bool        fin = l4[ 13 ] & 0x01;
+        return( ( ip_len == ihl + tcp_hdr_len && !fin ) ? RMIIETH_TX_CLASS_CTRL : RMIIETH_TX_CLASS_BULK );
+    }
+    return( RMIIETH_TX_CLASS_BULK );
+}
+
+static err_t RMIIETH_HOT_FUNC( low_level_output )(struct netif *netif, struct pbuf *p)
+{
+    struct ethernetif *ethernetif = netif->state;
+    struct pbuf *q;
+    rmiieth_config* cfg = (rmiieth_config*)ethernetif->rmiieth_cfg;
+
+#if ETH_PAD_SIZE
+    pbuf_remove_header(p, ETH_PAD_SIZE); /* drop the padding word */
+#endif
+
+    //
+    // compute required size
+    //
+
+    int cc_len = 0;
+    for( q = p; q != NULL; q = q->next )
+    {
+        cc_len += q->len;
+    }
+    cc_len += 8;      // preamble
+    cc_len += 4;
+    if( cc_len < 72 ) // min length = 8 + 60 + 4 = 72
+    {
+        cc_len = 72;
+    }
+
+    //
+    // allocate packet
+    //
+
+    uint8_t*    tx_buffer;
+    int32_t     tx_len = 0;
+
+    if( !rmiieth_tx_alloc_packet_class( cfg, tx_classify( p ), cc_len, &tx_buffer) )
+    {
+        return( ERR_OK );           /// ?
+    }
+
+    //
+    // construct TX packet, including preamble and fcs
+    //
+
+    tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;
+    tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0x55;  tx_buffer[ tx_len++ ] = 0xd5;
+#if RMIIETH_CHECKSUM_OFFLOAD
+    {
+        // the headers are normally all in the first pbuf - if not, we fall back to a separate checksum pass
+        csum_frame_info ci;
+        bool            is_ip = csum_parse_frame( p->payload, p->len, p->tot_len, &ci );
+        uint32_t        l4_sum = 0;
+        int             pos = 0;
+
+        for( q = p; q != NULL; q = q->next )
+        {
+            // payload that lwIP sent by reference may already have been summed (see csum_tables)
+            uint32_t    piece_sum;
+            if( ethernetif->csum_table_count && q != p && ci.l4_start && pos >= ci.l4_start && pos + q->len <= ci.l3_end &&
+                pkt_checksum_lookup( ethernetif->csum_tables, ethernetif->csum_table_count, q->payload, q->len, &piece_sum ) )
+            {
+                memcpy( &tx_buffer[ tx_len ], q->payload, q->len );
+                l4_sum = pkt_checksum_combine( l4_sum, ( ( pos - ci.l4_start ) & 1 ) ? pkt_checksum_swap( piece_sum ) : piece_sum );
+                ethernetif->csum_pieces_used++;
+            }
+            else
+            {
+                l4_sum = csum_copy_range( &tx_buffer[ tx_len ], q->payload, q->len, pos, ci.l4_start, ci.l4_start ? ci.l3_end : 0, l4_sum );
+            }
+            tx_len += q->len;
+            pos += q->len;
+        }
+
+        if( !is_ip && csum_parse_frame( &tx_buffer[ 8 ], pos, pos, &ci ) )
+        {
+            is_ip = true;
+            if( ci.l4_start )
+            {
+                l4_sum = pkt_checksum_add( &tx_buffer[ 8 + ci.l4_start ], ci.l3_end - ci.l4_start, 0 );
+            }
+        }
+        if( is_ip )
+        {
+            csum_finish_tx( &tx_buffer[ 8 ], &ci, l4_sum );
+        }
+    }
+#else
+    for( q = p; q != NULL; q = q->next )
+    {
+        memcpy( &tx_buffer[ tx_len ], q->payload, q->len );
+        tx_len += q->len;
+    }
+#endif
+    while( tx_len < 8 + 64 - 4 )
+    {
+        tx_buffer[ tx_len++ ] = 0x00;
+    }
+    uint32_t fcs = pkt_generate_fcs( &tx_buffer[ 8 ], tx_len - 8 );
+    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >>  0 );
+    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >>  8 );
+    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >> 16 );
+    tx_buffer[ tx_len++ ] = (uint8_t)( fcs >> 24 );
+
+    assert( cc_len == tx_len );
+
+    if( ethernetif->capture )
+    {
+        rmiieth_capture_tx( ethernetif->capture, &tx_buffer[ 8 ], tx_len - 8 - 4 );
+    }
+    rmiieth_tx_commit_packet( cfg, tx_len );
+
+    MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+    if (((u8_t *)p->payload)[0] & 1) {
+        /* broadcast or multicast packet*/
+        MIB2_STATS_NETIF_INC(netif, ifoutnucastpkts);
+    } else {
+        /* unicast packet */
+        MIB2_STATS_NETIF_INC(netif, ifoutucastpkts);
+    }
+    /* increase ifoutdiscards or ifouterrors on error */
+
+#if ETH_PAD_SIZE
+    pbuf_add_header(p, ETH_PAD_SIZE); /* reclaim the padding word */
+#endif
+
+    LINK_STATS_INC(link.xmit);
+
+    return ERR_OK;
+}
+
+
+
+// NOTE: the caller is responsible for consuming the packet from the RX queue afterwards
+static struct pbuf *RMIIETH_HOT_FUNC( low_level_input )(struct netif *netif, const rmiieth_rx_frame* frame)
+{
+    struct ethernetif *ethernetif = netif->state;
+    struct pbuf *p = NULL;
+    struct pbuf *q;
+    uint8_t*    pkt = frame->data;
+    uint8_t*    wrap = frame->wrap_data;
+    int         pkt_len = frame->length;
+    int         split = wrap ? frame->wrap_offset : pkt_len;
+
+    // (cut-through may have validated it already - see rx_cut_through)
+    if( frame->validated < 0 || ( !frame->validated && !pkt_validate_split( pkt, split, wrap, &pkt_len ) ) )
+    {
+        LINK_STATS_INC(link.drop);
+        MIB2_STATS_NETIF_INC(netif, ifindiscards);
+        return( NULL );
+    }
+    if( split > pkt_len )
+    {
+        split = pkt_len;
+    }
+
+    // frames with a registered EtherType (see rmiieth_register_ethertype) are handled in place, and never reach lwIP
+    {
+        rmiieth_rx_frame    validated = { pkt, pkt_len, ( split < pkt_len ) ? wrap : NULL, split, 1, frame->timestamp_us };
+        if( ethernetif->capture )
+        {
+            rmiieth_capture_rx( ethernetif->capture, &validated );
+        }
+        if( rmiieth_rx_dispatch( ethernetif->rmiieth_cfg, &validated ) )
+        {
+            return( NULL );
+        }
+    }
+
+    // ARP requests and pings for us are answered straight from the RX queue (the responder needs them contiguous)
+    if( ethernetif->responder && split == pkt_len && rmiieth_responder_input( ethernetif->responder, pkt, pkt_len ) )
+    {
+        return( NULL );
+    }
+
+    p = pbuf_alloc(PBUF_RAW, pkt_len, PBUF_POOL);
+    if( !p )
+    {
+        return( NULL );
+    }
+
+    // we're good
+#if RMIIETH_CHECKSUM_OFFLOAD
+    // the headers need to be contiguous - gather them if the frame wraps part way through them
+    uint8_t         hdr_buf[ 14 + 60 ];
+    const uint8_t*  hdr = pkt;
+    int             hdr_len = split;
+    if( split < pkt_len && split < (int)sizeof( hdr_buf ) )
+    {
+        hdr_len = pkt_len < (int)sizeof( hdr_buf ) ? pkt_len : (int)sizeof( hdr_buf );
+        memcpy( hdr_buf, pkt, split );
+        memcpy( &hdr_buf[ split ], wrap, hdr_len - split );
+        hdr = hdr_buf;
+    }
+
+    csum_frame_info ci;
+    bool            is_ip = csum_parse_frame( hdr, hdr_len, pkt_len, &ci );
+    uint32_t        l4_sum = 0;
+    int             pos = 0;
+    for( q = p; q != NULL; q = q->next )
+    {
+        for( int done = 0 ; done < q->len ; )
+        {
+            int             n = q->len - done;
+            const uint8_t*  src = rx_frame_src( pkt, split, wrap, pos, &n );
+            l4_sum = csum_copy_range( (uint8_t*)q->payload + done, src, n, pos, ci.l4_start, ci.l4_start ? ci.l3_end : 0, l4_sum );
+            done += n;
+            pos += n;
+        }
+    }
+
+    if( is_ip && !csum_check_rx( hdr, &ci, l4_sum ) )
+    {
+        LINK_STATS_INC(link.chkerr);
+        MIB2_STATS_NETIF_INC(netif, ifinerrors);
+        pbuf_free( p );
+        return( NULL );
+    }
+#else
+    int pos = 0;
+    for( q = p; q != NULL; q = q->next )
+    {
+        for( int done = 0 ; done < q->len ; )
+        {
+            int             n = q->len - done;
+            const uint8_t*  src = rx_frame_src( pkt, split, wrap, pos, &n );
+            memcpy( (uint8_t*)q->payload + done, src, n );
+            done += n;
+            pos += n;
+        }
+    }
+#endif
+
+    MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
+    if (((u8_t *)p->payload)[0] & 1) {
+        MIB2_STATS_NETIF_INC(netif, ifinnucastpkts);
+    } else {
+        MIB2_STATS_NETIF_INC(netif, ifinucastpkts);
+    }
+    LINK_STATS_INC(link.recv);
+    return p;
+}
+
+static void RMIIETH_HOT_FUNC( ethernetif_input )(struct netif *netif, const rmiieth_rx_frame* frame)
+{
+  struct ethernetif *ethernetif;
+  struct eth_hdr *ethhdr;
+  struct pbuf *p;
+
+  ethernetif = netif->state;
+
+  p = low_level_input(netif, frame);
+  if (p != NULL) {
+    if (netif->input(p, netif) != ERR_OK) {
+      LWIP_DEBUGF(NETIF_DEBUG, ("ethernetif_input: IP input error\n"));
+      pbuf_free(p);
+      p = NULL;
+    }
+  }
+}
+
+
+err_t ethernetif_init(struct netif *netif)
+{
+  struct ethernetif *ethernetif;
+
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+#if LWIP_NETIF_HOSTNAME
+  /* Initialize interface hostname */
+  netif->hostname = "lwip";
+#endif /* LWIP_NETIF_HOSTNAME */
+
+  /*
+   * Initialize the snmp variables and counters inside the struct netif.
+   * The last argument should be replaced with your link speed, in units
+   * of bits per second.
+   */
+  MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
+
+  netif->name[0] = IFNAME0;
+  netif->name[1] = IFNAME1;
+  /* We directly use etharp_output() here to sethernetifave a function call.
+   * You can instead declare your own function an call etharp_output()
+   * from it if you have to do some checks before sending (e.g. if link
+   * is available...) */
+#if LWIP_IPV4
+  netif->output = etharp_output;
+#endif /* LWIP_IPV4 */
+#if LWIP_IPV6
+  netif->output_ip6 = ethip6_output;
+#endif /* LWIP_IPV6 */
+  netif->linkoutput = low_level_output;
+
+//  ethernetif->ethaddr = (struct eth_addr *) & (netif->hwaddr[0]);
+
+  /* initialize the hardware */
+  low_level_init(netif);
+
+  return ERR_OK;
+}
+
+
+//
+//
+//
+//
+//
+
+
+
+// returns true if the RX budget was used up, and there are still packets waiting
+bool RMIIETH_HOT_FUNC( rmiieth_lwip_poll )( struct netif* netif )
+{
+    struct ethernetif* ethernetif = netif->state;
+    rmiieth_config* cfg = ethernetif->rmiieth_cfg;
+
+    // collect events before polling, so that anything which happens during the poll wakes the next wait
+    uint32_t events = rmiieth_take_events( cfg );
+    rmiieth_poll( cfg );
+
+    // unless we're already polling, only look at the RX queue when the driver tells us something arrived
+    if( !cfg->rx_polling && !( events & RMIIETH_EVENT_RX ) )
+    {
+        return( false );
+    }
+
+    // control-plane packets (ARP, ICMP, DHCP) take strict priority - their queue is small, so just drain it
+    while( true )
+    {
+        rmiieth_rx_frame    frames[ RMIIETH_LWIP_RX_BATCH ];
+        int                 ct = rmiieth_rx_ctrl_get_packets( cfg, frames, RMIIETH_LWIP_RX_BATCH );
+        if( !ct )
+        {
+            break;
+        }
+        for( int i = 0 ; i < ct ; i++ )
+        {
+            ethernetif_input( netif, &frames[ i ] );
+        }
+        rmiieth_rx_ctrl_consume_packets( cfg, ct );
+    }
+
+    // process a limited number of packets, so that timers and TX get a look-in under heavy RX load
+    int budget = cfg->rx_poll_budget;
+    while( budget > 0 )
+    {
+        rmiieth_rx_frame    frames[ RMIIETH_LWIP_RX_BATCH ];
+        int                 ct = rmiieth_rx_get_packets( cfg, frames, budget < RMIIETH_LWIP_RX_BATCH ? budget : RMIIETH_LWIP_RX_BATCH );
+        if( !ct )
+        {
+            break;
+        }
+        for( int i = 0 ; i < ct ; i++ )
+        {
+            ethernetif_input( netif, &frames[ i ] );
+        }
+        rmiieth_rx_consume_packets( cfg, ct );
+        budget -= ct;
+    }
+
+    // if we didn't drain the queue, carry on polling - otherwise, go back to waiting for notifications
+    bool more = rmiieth_rx_packet_available( cfg );
+    rmiieth_rx_set_polling( cfg, more );
+    return( more );
+}
+
+// sleep until the driver posts an event (RX packet, TX complete), or the next lwIP timeout is due
+void rmiieth_lwip_wait( struct netif* netif )
+{
+    struct ethernetif* ethernetif = netif->state;
+    rmiieth_config* cfg = ethernetif->rmiieth_cfg;
+
+    // kick off any TX that lwIP queued since the last poll - its completion will wake us
+    rmiieth_poll( cfg );
+
+    // don't sleep through a frame that cut-through could be getting on with
+    if( cfg->events || cfg->rx_polling || rmiieth_rx_in_progress( cfg ) )
+    {
+        return;
+    }
+
+    u32_t sleep_ms = sys_timeouts_sleeptime();
+    if( sleep_ms > RMIIETH_LWIP_MAX_SLEEP_MS )
+    {
+        sleep_ms = RMIIETH_LWIP_MAX_SLEEP_MS;
+    }
+
+    // an event posted after the check above still sets the event register, so the WFE returns straight away
+    best_effort_wfe_or_timeout( make_timeout_time_ms( sleep_ms ) );
+}
@@ -0,0 +1,54 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_NETIF_H
+#define RMIIETH_NETIF_H
+
+#include "rmiieth.h"
+#include "rmiieth_responder.h"
+#include "rmiieth_capture.h"
+#include "pkt_utils.h"
+#include "lwip/netif.h"
+
+/*
+ * rmiieth_netif
+ *
+ * The lwIP (NO_SYS) network interface for the rmiieth driver - moves frames between the driver's packet queues and
+ * pbufs, with checksum offload (see RMIIETH_CHECKSUM_OFFLOAD in lwipopts.h), TX classes and the IGMP multicast
+ * filter. It only uses the rmiieth_xxx API, so it builds just the same against the host backend (see host/).
+ *
+ *      static struct ethernetif    eth = { cfg };
+ *      netif_add_noaddr( &netif, &eth, ethernetif_init, ethernet_input );
+ *
+ *      while( true )
+ *      {
+ *          sys_check_timeouts();
+ *          if( !rmiieth_lwip_poll( &netif ) )
+ *          {
+ *              rmiieth_lwip_wait( &netif );
+ *          }
+ *      }
+ *
+ * The MAC address is taken from cfg->mac_addr.
+ *
+ * With checksum offload, csum_tables can give the checksums of const data that lwIP sends by reference (httpd's
+ * content, from rmiieth_makefsdata.py) - a pbuf that is exactly one of their pieces is copied without being summed.
+ */
+
+struct ethernetif {
+    rmiieth_config*     rmiieth_cfg;
+    rmiieth_responder*  responder;                          // optional - answer ARP/ping before lwIP sees them (NULL = off)
+    rmiieth_capture*    capture;                            // optional - mirror RX and TX frames (NULL = off)
+    const pkt_checksum_table* csum_tables;                  // optional - precalculated sums of data sent by reference (e.g. rmiieth_fsdata_checksums)
+    int                 csum_table_count;
+    uint32_t            csum_pieces_used;                   // # of pbufs whose checksum came from csum_tables
+};
+
+
+extern err_t ethernetif_init( struct netif* netif );
+extern bool rmiieth_lwip_poll( struct netif* netif );
+extern void rmiieth_lwip_wait( struct netif* netif );
+
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_OPTS_H
+#define RMIIETH_OPTS_H
+
+#include "pico.h"
+
+/*
+ * Compile-time options
+ *
+ * RMIIETH_STATIC_BUFFERS
+ *
+ * By default, rmiieth_init() mallocs any queue buffers that aren't passed in - which puts them in the striped main
+ * SRAM, where the RX DMA, the TX DMA and the CPU's copies all compete for the same banks. With RMIIETH_STATIC_BUFFERS
+ * set, it uses statically allocated buffers instead, which are placed via linker sections:
+ *
+ *      RX ring             SRAM4 (scratch_x)       RMIIETH_STATIC_RX_SIZE bytes
+ *      TX ring             SRAM5 (scratch_y)       RMIIETH_STATIC_TX_SIZE bytes
+ *      driver state        SRAM4 (scratch_x)       the rmiieth_config in main.c
+ *      control queues      main SRAM               RMIIETH_STATIC_RX_CTRL_SIZE / RMIIETH_STATIC_TX_CTRL_SIZE bytes
+ *
+ * SRAM4 and SRAM5 are only 4K each, so the defaults are about as big as they can be:
+ *
+ *      SRAM4       the RX ring, which holds two MTU-sized reservations, and leaves RMIIETH_STATIC_STATE_BYTES for the
+ *                  rmiieth_config (a little under 800 bytes)
+ *      SRAM5       the TX ring, which holds a single full-sized packet, and core 0's stack (PICO_STACK_SIZE, 2K by
+ *                  default) - which fills it exactly
+ *
+ * rmiieth.c checks both budgets at compile time, as long as the default placements are used. If core 1 is used, its
+ * stack goes in SRAM4 as well, and the RX ring will need to shrink. The linker will complain if a bank overflows.
+ *
+ * The control queues (rx_ctrl_queue_size, tx_ctrl_queue_size) are static too, and no larger than the sizes here. The
+ * default RX ring is too small for an RX control queue (see rmiieth_init_queues()), so there's no buffer for one
+ * unless RMIIETH_STATIC_RX_CTRL_SIZE is set.
+ *
+ * Any of the _PLACEMENT macros can be redefined (e.g. to nothing, for the striped SRAM) to move things around.
+ * Statically allocated buffers aren't used for the shared arena (see arena_size), which needs a single buffer.
+ */
+
+#ifndef RMIIETH_STATIC_BUFFERS
+#define RMIIETH_STATIC_BUFFERS              0
+#endif
+
+#ifndef RMIIETH_STATIC_STATE_BYTES
+#define RMIIETH_STATIC_STATE_BYTES          832
+#endif
+
+#ifndef RMIIETH_STATIC_RX_SIZE
+#define RMIIETH_STATIC_RX_SIZE              ( 4096 - RMIIETH_STATIC_STATE_BYTES )
+#endif
+
+#ifndef RMIIETH_STATIC_TX_SIZE
+#define RMIIETH_STATIC_TX_SIZE              2048
+#endif
+
+#ifndef RMIIETH_STATIC_RX_CTRL_SIZE
+#define RMIIETH_STATIC_RX_CTRL_SIZE         0
+#endif
+
+#ifndef RMIIETH_STATIC_TX_CTRL_SIZE
+#define RMIIETH_STATIC_TX_CTRL_SIZE         2048
+#endif
+
+#ifndef RMIIETH_STATIC_RX_PLACEMENT
+#define RMIIETH_STATIC_RX_PLACEMENT         __scratch_x( "rmiieth_rx" )
+#define RMIIETH_STATIC_RX_IN_SRAM4          1
+#endif
+
+#ifndef RMIIETH_STATIC_TX_PLACEMENT
+#define RMIIETH_STATIC_TX_PLACEMENT         __scratch_y( "rmiieth_tx" )
+#define RMIIETH_STATIC_TX_IN_SRAM5          1
+#endif
+
+#ifndef RMIIETH_STATIC_CTRL_PLACEMENT
+#define RMIIETH_STATIC_CTRL_PLACEMENT
+#endif
+
+#ifndef RMIIETH_STATE_PLACEMENT
+#if RMIIETH_STATIC_BUFFERS
+#define RMIIETH_STATE_PLACEMENT             __scratch_x( "rmiieth_state" )
+#define RMIIETH_STATE_IN_SRAM4              1
+#else
+#define RMIIETH_STATE_PLACEMENT
+#endif
+#endif
+
+/*
+ * RMIIETH_RAM_HOT_PATH
+ *
+ * The interrupt handlers and the queue reserve/commit functions always run from SRAM. With RMIIETH_RAM_HOT_PATH set,
+ * so does everything else a packet passes through in the driver and main.c's lwIP glue - preamble removal, FCS,
+ * checksums, the queue read side, rmiieth_poll() and low_level_input/output() - so that none of it can stall on an
+ * XIP cache miss. Functions opt in by being defined with RMIIETH_HOT_FUNC( name ).
+ *
+ * The CRC table (g_grc_table) is already in SRAM, as it isn't const. lwIP itself still runs from flash.
+ *
+ * The build writes rmiieth_placement.txt next to the ELF, listing where each driver function ended up.
+ */
+
+#ifndef RMIIETH_RAM_HOT_PATH
+#define RMIIETH_RAM_HOT_PATH                0
+#endif
+
+#if RMIIETH_RAM_HOT_PATH
+#define RMIIETH_HOT_FUNC( func_name )       __not_in_flash_func( func_name )
+#else
+#define RMIIETH_HOT_FUNC( func_name )       func_name
+#endif
+
+/*
+ * RMIIETH_BOARD_CONFIG
+ *
+ * If defined, this names a header (e.g. "rmiieth_board_default.h") that fixes the values the interrupt handlers and
+ * poll loop use on every packet at compile time - so that they're constant-folded, rather than loaded from the
+ * rmiieth_config on each access. The board header can define any of:
+ *
+ *      RMIIETH_BOARD_PIO, RMIIETH_BOARD_RX_SM, RMIIETH_BOARD_RX_DMA_CHAN, RMIIETH_BOARD_RX_DMA_CHAN2,
+ *      RMIIETH_BOARD_TX_DMA_CHAN, RMIIETH_BOARD_TX_DMA_IRQ, RMIIETH_BOARD_MTU, RMIIETH_BOARD_RX_SPLIT_DMA
+ *
+ * rmiieth_set_default_config() copies them into the config, and rmiieth_init() asserts that the config still agrees.
+ * Anything not defined by the board header is read from the config, as usual - so without a board header, nothing
+ * changes. The driver code reads these values through the RMIIETH_xxx( cfg ) accessors below.
+ */
+
+#ifdef RMIIETH_BOARD_CONFIG
+#include RMIIETH_BOARD_CONFIG
+#endif
+
+#ifdef RMIIETH_BOARD_PIO
+#define RMIIETH_PIO( cfg )                  ( RMIIETH_BOARD_PIO )
+#else
+#define RMIIETH_PIO( cfg )                  ( (cfg)->pio )
+#endif
+
+#ifdef RMIIETH_BOARD_RX_SM
+#define RMIIETH_RX_SM( cfg )                ( RMIIETH_BOARD_RX_SM )
+#else
+#define RMIIETH_RX_SM( cfg )                ( (cfg)->rx_sm )
+#endif
+
+#ifdef RMIIETH_BOARD_RX_DMA_CHAN
+#define RMIIETH_RX_DMA_CHAN( cfg )          ( RMIIETH_BOARD_RX_DMA_CHAN )
+#else
+#define RMIIETH_RX_DMA_CHAN( cfg )          ( (cfg)->rx_dma_chan )
+#endif
+
+#ifdef RMIIETH_BOARD_RX_DMA_CHAN2
+#define RMIIETH_RX_DMA_CHAN2( cfg )         ( RMIIETH_BOARD_RX_DMA_CHAN2 )
+#else
+#define RMIIETH_RX_DMA_CHAN2( cfg )         ( (cfg)->rx_dma_chan2 )
+#endif
+
+#ifdef RMIIETH_BOARD_TX_DMA_CHAN
+#define RMIIETH_TX_DMA_CHAN( cfg )          ( RMIIETH_BOARD_TX_DMA_CHAN )
+#else
+#define RMIIETH_TX_DMA_CHAN( cfg )          ( (cfg)->tx_dma_chan )
+#endif
+
+#ifdef RMIIETH_BOARD_TX_DMA_IRQ
+#define RMIIETH_TX_DMA_IRQ( cfg )           ( RMIIETH_BOARD_TX_DMA_IRQ )
+#else
+#define RMIIETH_TX_DMA_IRQ( cfg )           ( (cfg)->tx_dma_irq )
+#endif
+
+#ifdef RMIIETH_BOARD_MTU
+#define RMIIETH_MTU( cfg )                  ( RMIIETH_BOARD_MTU )
+#else
+#define RMIIETH_MTU( cfg )                  ( (cfg)->mtu )
+#endif
+
+#ifdef RMIIETH_BOARD_RX_SPLIT_DMA
+#define RMIIETH_RX_SPLIT_DMA( cfg )         ( RMIIETH_BOARD_RX_SPLIT_DMA )
+#else
+#define RMIIETH_RX_SPLIT_DMA( cfg )         ( (cfg)->rx_split_dma )
+#endif
+
+/*
+ * RMIIETH_IRQ_TIMING
+ *
+ * If set, the RX interrupt handler measures its own execution time with the SysTick counter (in system clock cycles),
+ * and keeps the last and worst-case values in cfg->rx_irq_cycles_last / rx_irq_cycles_max. Useful for comparing
+ * builds - e.g. with and without RMIIETH_BOARD_CONFIG or RMIIETH_RAM_HOT_PATH.
+ */
+
+#ifndef RMIIETH_IRQ_TIMING
+#define RMIIETH_IRQ_TIMING                  0
+#endif
+
+
+#endif // #ifndef RMIIETH_OPTS_H
@@ -0,0 +1,57 @@
+#
+# Post-build size/placement report for the driver's functions and data - see RMIIETH_RAM_HOT_PATH in rmiieth_opts.h
+#
+# usage: cmake -DNM=<nm> -DELF=<elf> -DOUT=<report file> -P rmiieth_placement.cmake
+#
+
+execute_process( COMMAND ${NM} -S --size-sort ${ELF} OUTPUT_VARIABLE symbols RESULT_VARIABLE rc )
+if( NOT rc EQUAL 0 )
+    message( WARNING "rmiieth_placement: unable to run ${NM} on ${ELF}" )
+    return()
+endif()
+
+string( REPLACE "\n" ";" lines "${symbols}" )
+
+set( report "" )
+set( flash_funcs "" )
+set( ram_text_bytes 0 )
+set( flash_text_bytes 0 )
+
+foreach( line IN LISTS lines )
+    # only our own symbols - address, size, type, name
+    if( NOT line MATCHES "^([0-9a-fA-F]+) ([0-9a-fA-F]+) ([tTdDbB]) ((pkt_|rmiieth_|low_level_|ethernetif_|csum_|g_grc_).*)$" )
+        continue()
+    endif()
+    set( addr "${CMAKE_MATCH_1}" )
+    set( type "${CMAKE_MATCH_3}" )
+    set( name "${CMAKE_MATCH_4}" )
+    math( EXPR size "0x${CMAKE_MATCH_2}" )
+
+    if( addr MATCHES "^20040" )
+        set( region "SRAM4" )
+    elseif( addr MATCHES "^20041" )
+        set( region "SRAM5" )
+    elseif( addr MATCHES "^2" )
+        set( region "SRAM" )
+    else()
+        set( region "FLASH" )
+    endif()
+
+    if( type MATCHES "[tT]" )
+        if( region STREQUAL "FLASH" )
+            math( EXPR flash_text_bytes "${flash_text_bytes} + ${size}" )
+            list( APPEND flash_funcs "${name}" )
+        else()
+            math( EXPR ram_text_bytes "${ram_text_bytes} + ${size}" )
+        endif()
+    endif()
+
+    string( APPEND report "${region}\t0x${addr}\t${size}\t${type}\t${name}\n" )
+endforeach()
+
+list( LENGTH flash_funcs flash_count )
+string( PREPEND report "rmiieth placement report for ${ELF}\n"
+                       "code in SRAM: ${ram_text_bytes} bytes, code in flash: ${flash_text_bytes} bytes (${flash_count} functions)\n\n"
+                       "region\taddress\t\tsize\ttype\tsymbol\n" )
+file( WRITE ${OUT} "${report}" )
+message( STATUS "rmiieth: driver code in SRAM ${ram_text_bytes} bytes, in flash ${flash_text_bytes} bytes - see ${OUT}" )
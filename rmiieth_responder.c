@@ -0,0 +1,189 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_responder.h"
+#include "pkt_utils.h"
+#include <string.h>
+
+#define ETH_HDR_OFS     ( 0 )
+#define ARP_OFS         ( 14 )
+#define IP_HDR_OFS      ( 14 )
+
+static inline uint16_t get_be16( const uint8_t* p )
+{
+    return( ( (uint16_t)p[ 0 ] << 8 ) | p[ 1 ] );
+}
+
+static inline uint32_t get_be32( const uint8_t* p )
+{
+    return( ( (uint32_t)p[ 0 ] << 24 ) | ( (uint32_t)p[ 1 ] << 16 ) | ( (uint32_t)p[ 2 ] << 8 ) | p[ 3 ] );
+}
+
+static inline void put_be16( uint8_t* p, uint16_t v )
+{
+    p[ 0 ] = (uint8_t)( v >> 8 );
+    p[ 1 ] = (uint8_t)( v >> 0 );
+}
+
+void rmiieth_responder_init( rmiieth_responder* r, rmiieth_config* cfg )
+{
+    memset( r, 0, sizeof( rmiieth_responder ) );
+    r->cfg = cfg;
+}
+
+void rmiieth_responder_set_ip( rmiieth_responder* r, uint32_t ip_addr )
+{
+    r->ip_addr = ip_addr;
+}
+
+//
+// TX - the request is copied into a TX queue slot, and turned into the reply there
+//
+
+static uint8_t* RMIIETH_HOT_FUNC( responder_copy )( rmiieth_responder* r, const uint8_t* frame, int length )
+{
+    // preamble + frame (padded to the minimum size) + fcs
+    int         frame_len = ( length < 60 ) ? 60 : length;
+    uint8_t*    data;
+    if( !rmiieth_tx_alloc_packet_class( r->cfg, RMIIETH_TX_CLASS_CTRL, 8 + frame_len + 4, &data ) )
+    {
+        r->tx_full++;
+        return( NULL );
+    }
+
+    data[ 0 ] = 0x55;  data[ 1 ] = 0x55;  data[ 2 ] = 0x55;  data[ 3 ] = 0x55;
+    data[ 4 ] = 0x55;  data[ 5 ] = 0x55;  data[ 6 ] = 0x55;  data[ 7 ] = 0xd5;
+    memcpy( &data[ 8 ], frame, length );
+    memset( &data[ 8 + length ], 0, frame_len - length );
+    return( &data[ 8 ] );
+}
+
+static void RMIIETH_HOT_FUNC( responder_send )( rmiieth_responder* r, uint8_t* reply, int length )
+{
+    int         frame_len = ( length < 60 ) ? 60 : length;
+
+    // the reply goes back where the request came from
+    memcpy( &reply[ ETH_HDR_OFS + 0 ], &reply[ ETH_HDR_OFS + 6 ], 6 );
+    memcpy( &reply[ ETH_HDR_OFS + 6 ], r->cfg->mac_addr, 6 );
+
+    uint32_t    fcs = pkt_generate_fcs( reply, frame_len );
+    reply[ frame_len++ ] = (uint8_t)( fcs >>  0 );
+    reply[ frame_len++ ] = (uint8_t)( fcs >>  8 );
+    reply[ frame_len++ ] = (uint8_t)( fcs >> 16 );
+    reply[ frame_len++ ] = (uint8_t)( fcs >> 24 );
+    rmiieth_tx_commit_packet( r->cfg, 8 + frame_len );
+}
+
+//
+// ARP
+//
+
+static bool RMIIETH_HOT_FUNC( responder_arp )( rmiieth_responder* r, const uint8_t* frame, int length )
+{
+    const uint8_t*  arp = &frame[ ARP_OFS ];
+    if( length < ARP_OFS + 28 ||
+        get_be16( &arp[ 0 ] ) != 1 ||                       // ethernet
+        get_be16( &arp[ 2 ] ) != 0x0800 ||                  // IPv4
+        arp[ 4 ] != 6 || arp[ 5 ] != 4 ||
+        get_be16( &arp[ 6 ] ) != 1 ||                       // request
+        get_be32( &arp[ 24 ] ) != r->ip_addr )              // for us
+    {
+        return( false );
+    }
+
+    uint8_t*        reply = responder_copy( r, frame, ARP_OFS + 28 );
+    if( reply )
+    {
+        uint8_t*    rarp = &reply[ ARP_OFS ];
+        put_be16( &rarp[ 6 ], 2 );                          // reply
+        memcpy( &rarp[ 18 ], &arp[ 8 ], 10 );               // target = the sender's hw/protocol address
+        memcpy( &rarp[ 8 ], r->cfg->mac_addr, 6 );          // sender = us
+        memcpy( &rarp[ 14 ], &arp[ 24 ], 4 );
+        responder_send( r, reply, ARP_OFS + 28 );
+        r->arp_replies++;
+    }
+    return( true );
+}
+
+//
+// ICMP echo
+//
+// Only the ICMP type changes, so its checksum is updated incrementally (RFC 1624) rather than recomputed over the
+// whole payload. Checksums here are kept in memory byte order, as in pkt_utils.
+//
+
+static bool RMIIETH_HOT_FUNC( responder_echo )( rmiieth_responder* r, const uint8_t* frame, int length )
+{
+    const uint8_t*  ip = &frame[ IP_HDR_OFS ];
+    if( length < IP_HDR_OFS + 20 )
+    {
+        return( false );
+    }
+
+    int             ihl = ( ip[ 0 ] & 0x0f ) * 4;
+    int             ip_len = get_be16( &ip[ 2 ] );
+    if( ( ip[ 0 ] >> 4 ) != 4 || ihl < 20 || ip_len < ihl + 8 || IP_HDR_OFS + ip_len > length ||
+        ( get_be16( &ip[ 6 ] ) & 0x3fff ) != 0 ||           // not fragmented
+        ip[ 9 ] != 1 ||                                     // ICMP
+        get_be32( &ip[ 16 ] ) != r->ip_addr ||
+        ip[ ihl + 0 ] != 8 || ip[ ihl + 1 ] != 0 )          // echo request
+    {
+        return( false );
+    }
+    if( pkt_checksum_finish( pkt_checksum_add( ip, ihl, 0 ) ) != 0 )
+    {
+        // let the stack drop it
+        return( false );
+    }
+
+    uint8_t*        reply = responder_copy( r, frame, IP_HDR_OFS + ip_len );
+    if( reply )
+    {
+        uint8_t*    rip = &reply[ IP_HDR_OFS ];
+        uint8_t*    icmp = &rip[ ihl ];
+
+        // IP - swap the addresses, fresh TTL, and recompute the (small) header checksum
+        memcpy( &rip[ 12 ], &ip[ 16 ], 4 );
+        memcpy( &rip[ 16 ], &ip[ 12 ], 4 );
+        rip[ 8 ] = 64;
+        rip[ 10 ] = 0;
+        rip[ 11 ] = 0;
+        uint16_t    csum = pkt_checksum_finish( pkt_checksum_add( rip, ihl, 0 ) );
+        rip[ 10 ] = (uint8_t)( csum >> 0 );
+        rip[ 11 ] = (uint8_t)( csum >> 8 );
+
+        // ICMP - type 8 -> 0, so HC' = ~( ~HC + ~m + m' ) with m = 0x0008, m' = 0 (in memory byte order)
+        uint32_t    sum = (uint16_t)~( icmp[ 2 ] | ( icmp[ 3 ] << 8 ) );
+        sum += (uint16_t)~0x0008;
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+        csum = (uint16_t)~sum;
+        icmp[ 0 ] = 0;
+        icmp[ 2 ] = (uint8_t)( csum >> 0 );
+        icmp[ 3 ] = (uint8_t)( csum >> 8 );
+
+        responder_send( r, reply, IP_HDR_OFS + ip_len );
+        r->echo_replies++;
+    }
+    return( true );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_responder_input )( rmiieth_responder* r, const uint8_t* frame, int length )
+{
+    if( !r->ip_addr || length < 14 )
+    {
+        return( false );
+    }
+
+    uint16_t        type = get_be16( &frame[ ETH_HDR_OFS + 12 ] );
+    if( type == 0x0806 )
+    {
+        return( responder_arp( r, frame, length ) );
+    }
+    if( type == 0x0800 )
+    {
+        return( responder_echo( r, frame, length ) );
+    }
+    return( false );
+}
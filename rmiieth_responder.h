@@ -0,0 +1,45 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_RESPONDER_H
+#define RMIIETH_RESPONDER_H
+
+#include "rmiieth.h"
+
+/*
+ * rmiieth_responder
+ *
+ * Answers ARP requests for our IP address, and ICMP echo requests addressed to it, without going through lwIP. The
+ * reply is built in the TX queue slot - a copy of the request, with the addresses swapped and the checksums patched -
+ * and queued in the control TX class (see tx_ctrl_queue_size).
+ *
+ * Received frames are offered to the responder once they've been validated:
+ *
+ *      if( !rmiieth_responder_input( &responder, frame, frame_len ) )
+ *      {
+ *          // ... not handled - pass it on to the stack as usual ...
+ *      }
+ *
+ * Note: nothing is answered until rmiieth_responder_set_ip() has been given an address.
+ * Note: ARP requests that are answered here aren't seen by the stack, so it won't learn the requester's address from
+ *       them - it will ARP for it itself, if it ever needs it.
+ * Note: as with any other TX packet, rmiieth_poll() must be called for replies to be sent.
+ */
+
+typedef struct
+{
+    rmiieth_config* cfg;
+    uint32_t        ip_addr;                                // our address, in host byte order (0 = don't answer)
+    uint32_t        arp_replies;                            // # of ARP replies sent
+    uint32_t        echo_replies;                           // # of ICMP echo replies sent
+    uint32_t        tx_full;                                // # of replies dropped because the TX queue was full
+} rmiieth_responder;
+
+
+extern void rmiieth_responder_init( rmiieth_responder* r, rmiieth_config* cfg );
+extern void rmiieth_responder_set_ip( rmiieth_responder* r, uint32_t ip_addr );
+extern bool rmiieth_responder_input( rmiieth_responder* r, const uint8_t* frame, int length );
+
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#include "rmiieth_udp.h"
+#include "pkt_utils.h"
+#include <string.h>
+
+#define ETH_HDR_OFS     ( 0 )
+#define IP_HDR_OFS      ( 14 )
+#define UDP_HDR_OFS     ( 14 + 20 )
+
+static inline void put_be16( uint8_t* p, uint16_t v )
+{
+    p[ 0 ] = (uint8_t)( v >> 8 );
+    p[ 1 ] = (uint8_t)( v >> 0 );
+}
+
+static inline void put_be32( uint8_t* p, uint32_t v )
+{
+    p[ 0 ] = (uint8_t)( v >> 24 );
+    p[ 1 ] = (uint8_t)( v >> 16 );
+    p[ 2 ] = (uint8_t)( v >>  8 );
+    p[ 3 ] = (uint8_t)( v >>  0 );
+}
+
+void rmiieth_udp_stream_init( rmiieth_udp_stream* s, rmiieth_config* cfg,
+                              const uint8_t* src_mac, const uint8_t* dst_mac,
+                              uint32_t src_ip, uint32_t dst_ip,
+                              uint16_t src_port, uint16_t dst_port )
+{
+    uint8_t*    h = s->hdr;
+
+    memset( s, 0, sizeof( rmiieth_udp_stream ) );
+    s->cfg = cfg;
+
+    //
+    // ethernet header
+    //
+
+    memcpy( &h[ ETH_HDR_OFS + 0 ], dst_mac, 6 );
+    memcpy( &h[ ETH_HDR_OFS + 6 ], src_mac, 6 );
+    put_be16( &h[ ETH_HDR_OFS + 12 ], 0x0800 );
+
+    //
+    // IPv4 header - total length, id and checksum are patched per datagram
+    //
+
+    h[ IP_HDR_OFS + 0 ] = 0x45;                             // version 4, 5-word header
+    h[ IP_HDR_OFS + 1 ] = 0x00;                             // tos
+    put_be16( &h[ IP_HDR_OFS + 6 ], 0x4000 );               // don't fragment
+    h[ IP_HDR_OFS + 8 ] = 64;                               // ttl
+    h[ IP_HDR_OFS + 9 ] = 17;                               // UDP
+    put_be32( &h[ IP_HDR_OFS + 12 ], src_ip );
+    put_be32( &h[ IP_HDR_OFS + 16 ], dst_ip );
+
+    uint32_t    sum = 0;
+    for( int i = 0 ; i < 20 ; i += 2 )
+    {
+        sum += ( (uint32_t)h[ IP_HDR_OFS + i ] << 8 ) | h[ IP_HDR_OFS + i + 1 ];
+    }
+    s->ip_partial_sum = sum;
+
+    //
+    // UDP header - length is patched per datagram, checksum is left as 0
+    //
+
+    put_be16( &h[ UDP_HDR_OFS + 0 ], src_port );
+    put_be16( &h[ UDP_HDR_OFS + 2 ], dst_port );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_udp_stream_alloc )( rmiieth_udp_stream* s, int max_payload, uint8_t** payload )
+{
+    int         frame_len = RMIIETH_UDP_HDR_BYTES + max_payload;
+    if( frame_len < 60 )
+    {
+        frame_len = 60;
+    }
+
+    // preamble + frame + fcs
+    uint8_t*    data;
+    if( !rmiieth_tx_alloc_packet( s->cfg, 8 + frame_len + 4, &data ) )
+    {
+        return( false );
+    }
+
+    data[ 0 ] = 0x55;  data[ 1 ] = 0x55;  data[ 2 ] = 0x55;  data[ 3 ] = 0x55;
+    data[ 4 ] = 0x55;  data[ 5 ] = 0x55;  data[ 6 ] = 0x55;  data[ 7 ] = 0xd5;
+    memcpy( &data[ 8 ], s->hdr, RMIIETH_UDP_HDR_BYTES );
+
+    s->tx_data = data;
+    s->max_payload = max_payload;
+    *payload = &data[ 8 + RMIIETH_UDP_HDR_BYTES ];
+    return( true );
+}
+
+bool RMIIETH_HOT_FUNC( rmiieth_udp_stream_send )( rmiieth_udp_stream* s, int payload_len )
+{
+    uint8_t*    data = s->tx_data;
+    uint8_t*    frame = &data[ 8 ];
+
+    assert( data );
+    assert( payload_len <= s->max_payload );
+
+    //
+    // patch lengths, id and the IP header checksum
+    //
+
+    uint16_t    ip_len = 20 + 8 + payload_len;
+    uint16_t    ip_id = s->ip_id++;
+    put_be16( &frame[ IP_HDR_OFS + 2 ], ip_len );
+    put_be16( &frame[ IP_HDR_OFS + 4 ], ip_id );
+    put_be16( &frame[ UDP_HDR_OFS + 4 ], 8 + payload_len );
+
+    uint32_t    sum = s->ip_partial_sum + ip_len + ip_id;
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    put_be16( &frame[ IP_HDR_OFS + 10 ], (uint16_t)~sum );
+
+    //
+    // pad out to the minimum frame size, and append the fcs
+    //
+
+    int         frame_len = RMIIETH_UDP_HDR_BYTES + payload_len;
+    while( frame_len < 60 )
+    {
+        frame[ frame_len++ ] = 0x00;
+    }
+    uint32_t    fcs = pkt_generate_fcs( frame, frame_len );
+    frame[ frame_len++ ] = (uint8_t)( fcs >>  0 );
+    frame[ frame_len++ ] = (uint8_t)( fcs >>  8 );
+    frame[ frame_len++ ] = (uint8_t)( fcs >> 16 );
+    frame[ frame_len++ ] = (uint8_t)( fcs >> 24 );
+
+    s->tx_data = NULL;
+    return( rmiieth_tx_commit_packet( s->cfg, 8 + frame_len ) );
+}
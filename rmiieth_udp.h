@@ -0,0 +1,53 @@
+/*
+ * (c) 2021 Ben Stragnell
+ */
+
+#ifndef RMIIETH_UDP_H
+#define RMIIETH_UDP_H
+
+#include "rmiieth.h"
+
+/*
+ * rmiieth_udp_stream
+ *
+ * Raw UDP datagram output that bypasses lwIP entirely. The Ethernet/IPv4/UDP header is built once, at init time -
+ * each datagram then only needs the IP length, IP identification and IP header checksum patching in. The checksum
+ * is updated incrementally from a precomputed partial sum of the constant header fields.
+ *
+ * The payload is written by the caller directly into the TX queue slot:
+ *
+ *      uint8_t*    payload;
+ *      if( rmiieth_udp_stream_alloc( &stream, 256, &payload ) )
+ *      {
+ *          // ... fill in up to 256 bytes of payload ...
+ *          rmiieth_udp_stream_send( &stream, payload_len );
+ *      }
+ *
+ * Note: the UDP checksum is sent as 0 (i.e. not computed), which is permitted for UDP over IPv4.
+ * Note: the destination MAC must be known up front (e.g. the gateway, or a static ARP entry) - no ARP is performed.
+ * Note: as with any other TX packet, rmiieth_poll() must be called for queued datagrams to be sent.
+ */
+
+#define RMIIETH_UDP_HDR_BYTES       ( 14 + 20 + 8 )
+
+typedef struct
+{
+    rmiieth_config* cfg;
+    uint8_t         hdr[ RMIIETH_UDP_HDR_BYTES ];          // templated Ethernet/IPv4/UDP header
+    uint32_t        ip_partial_sum;                         // IP header sum, excluding total-length, id and checksum
+    uint16_t        ip_id;                                  // next IP identification value
+    uint8_t*        tx_data;                                // TX queue slot currently allocated (NULL if none)
+    int             max_payload;                            // payload size requested in the current allocation
+} rmiieth_udp_stream;
+
+
+// addresses and ports are given in host byte order (e.g. 192.168.0.1 == 0xc0a80001)
+extern void rmiieth_udp_stream_init( rmiieth_udp_stream* s, rmiieth_config* cfg,
+                                     const uint8_t* src_mac, const uint8_t* dst_mac,
+                                     uint32_t src_ip, uint32_t dst_ip,
+                                     uint16_t src_port, uint16_t dst_port );
+extern bool rmiieth_udp_stream_alloc( rmiieth_udp_stream* s, int max_payload, uint8_t** payload );
+extern bool rmiieth_udp_stream_send( rmiieth_udp_stream* s, int payload_len );
+
+
+#endif